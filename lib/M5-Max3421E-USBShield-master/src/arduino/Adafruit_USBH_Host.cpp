@@ -25,6 +25,8 @@
 #ifdef ARDUINO_ARCH_ESP32
 #include "arduino/ports/esp32/tusb_config_esp32.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include <Arduino.h>
 #endif
 
@@ -43,6 +45,7 @@ M5_USBH_Host::M5_USBH_Host(void) {
 #if defined(CFG_TUH_MAX3421) && CFG_TUH_MAX3421
     _spi = NULL;
     _cs = _intr = _sck = _mosi = _miso = -1;
+    _async_spi = false;
 #endif
 }
 
@@ -58,9 +61,51 @@ extern "C" bool tuh_max3421_reg_write(uint8_t rhport, uint8_t reg, uint8_t data,
 
 static void max3421_isr(void);
 
+// SPI statistics, updated while CS is asserted (serialized by the driver)
+static struct {
+    uint32_t xact;
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    uint64_t busy_ticks;
+    uint32_t cs_start;
+} max3421_spi_stats;
+
+// Time base of spi_busy_us: CPU cycle counter on ESP32 since a short register
+// access is below 1 us, micros() otherwise
+static inline uint32_t max3421_spi_ticks(void) {
+#if defined(ARDUINO_ARCH_ESP32)
+    return ESP.getCycleCount();
+#else
+    return micros();
+#endif
+}
+
+static inline uint32_t max3421_spi_ticks_per_us(void) {
+#if defined(ARDUINO_ARCH_ESP32)
+    return getCpuFrequencyMhz();
+#else
+    return 1;
+#endif
+}
+
 #if defined(ARDUINO_ARCH_ESP32)
 SemaphoreHandle_t max3421_intr_sem;
 static void max3421_intr_task(void *param);
+static M5_USBH_Host::max3421_intr_stats_t max3421_intr_stats;
+
+// Asynchronous SPI transactions, executed by max3421_spi_task
+typedef struct {
+    uint8_t rhport;
+    tuh_max3421_spi_xact_t *xact;
+} max3421_spi_req_t;
+
+static QueueHandle_t max3421_spi_queue;
+static void max3421_spi_task(void *param);
+
+// One-shot timer waking up the interrupt task when the HCD scheduler is due,
+// FRAME_IRQ is not serviced every frame meanwhile
+static esp_timer_handle_t max3421_wakeup_timer;
+static void max3421_wakeup_cb(void *arg);
 #endif
 
 M5_USBH_Host::M5_USBH_Host(SPIClass *spi, int8_t cs, int8_t intr) {
@@ -70,6 +115,7 @@ M5_USBH_Host::M5_USBH_Host(SPIClass *spi, int8_t cs, int8_t intr) {
     _cs                           = cs;
     _intr                         = intr;
     _sck = _mosi = _miso = -1;
+    _async_spi                    = false;
 }
 
 M5_USBH_Host::M5_USBH_Host(SPIClass *spi, int8_t sck, int8_t mosi,
@@ -82,6 +128,7 @@ M5_USBH_Host::M5_USBH_Host(SPIClass *spi, int8_t sck, int8_t mosi,
     _sck                          = sck;
     _mosi                         = mosi;
     _miso                         = miso;
+    _async_spi                    = false;
 }
 
 uint8_t M5_USBH_Host::max3421_readRegister(uint8_t reg, bool in_isr) {
@@ -93,6 +140,40 @@ bool M5_USBH_Host::max3421_writeRegister(uint8_t reg, uint8_t data,
     return tuh_max3421_reg_write(_rhport, reg, data, in_isr);
 }
 
+#if defined(ARDUINO_ARCH_ESP32)
+void M5_USBH_Host::max3421_getIntrStats(max3421_intr_stats_t *stats) {
+    *stats = max3421_intr_stats;
+}
+#endif
+
+void M5_USBH_Host::max3421_getStats(max3421_stats_t *stats) {
+    stats->spi_xact     = max3421_spi_stats.xact;
+    stats->spi_tx_bytes = max3421_spi_stats.tx_bytes;
+    stats->spi_rx_bytes = max3421_spi_stats.rx_bytes;
+    stats->spi_busy_us =
+        (uint32_t)(max3421_spi_stats.busy_ticks / max3421_spi_ticks_per_us());
+    tuh_max3421_spi_stats(_rhport, NULL, &stats->usb_xact);
+    stats->interrupts = tuh_max3421_int_stats(_rhport);
+}
+
+bool M5_USBH_Host::max3421_getNakCount(uint8_t daddr, uint8_t ep_addr,
+                                       uint32_t *count) {
+    return tuh_max3421_nak_stats(_rhport, daddr, ep_addr, count);
+}
+
+void M5_USBH_Host::max3421_resetStats(void) {
+    // a transaction in flight may be counted partially
+    max3421_spi_stats.xact       = 0;
+    max3421_spi_stats.tx_bytes   = 0;
+    max3421_spi_stats.rx_bytes   = 0;
+    max3421_spi_stats.busy_ticks = 0;
+    tuh_max3421_stats_reset(_rhport);
+#if defined(ARDUINO_ARCH_ESP32)
+    memset(&max3421_intr_stats, 0, sizeof(max3421_intr_stats));
+#endif
+    tuh_xfer_stats_reset();
+}
+
 #endif
 
 bool M5_USBH_Host::configure(uint8_t rhport, uint32_t cfg_id,
@@ -127,11 +208,38 @@ bool M5_USBH_Host::begin(uint8_t rhport) {
     max3421_intr_sem = xSemaphoreCreateBinary();
     xTaskCreateUniversal(max3421_intr_task, "max3421 intr", 2048, NULL, 5, NULL,
                          ARDUINO_RUNNING_CORE);
+
+    if (_async_spi) {
+        // on the other core (if any) so that the USB stack can run while
+        // waiting for the transfer
+#if CONFIG_FREERTOS_UNICORE
+        BaseType_t const spi_core = ARDUINO_RUNNING_CORE;
+#else
+        BaseType_t const spi_core = ARDUINO_RUNNING_CORE ? 0 : 1;
+#endif
+        max3421_spi_queue = xQueueCreate(1, sizeof(max3421_spi_req_t));
+        xTaskCreatePinnedToCore(max3421_spi_task, "max3421 spi", 2048, NULL, 5,
+                                NULL, spi_core);
+    }
+
+    // before tuh_init(): HCD checks the timer APIs when initialized
+    esp_timer_create_args_t const timer_args = {
+        .callback        = max3421_wakeup_cb,
+        .arg             = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name            = "max3421 wakeup",
+    };
+    if (esp_timer_create(&timer_args, &max3421_wakeup_timer) != ESP_OK) {
+        max3421_wakeup_timer = NULL;
+    }
 #else
     _spi->begin();
 #endif
 
-    // Interrupt pin
+    // Interrupt pin: the GPIO interrupt is edge triggered even when the
+    // MAX3421E holds INT low while an IRQ is pending (CFG_TUH_MAX3421_INT_LEVEL).
+    // Another IRQ raised before INT deasserts makes no new edge, so the ESP32
+    // interrupt task keeps servicing while the pin reads low
     pinMode(_intr, INPUT_PULLUP);
     attachInterrupt(_intr, max3421_isr, FALLING);
 #endif
@@ -144,6 +252,117 @@ void M5_USBH_Host::task(uint32_t timeout_ms, bool in_isr) {
     tuh_task_ext(timeout_ms, in_isr);
 }
 
+void M5_USBH_Host::getXferStats(tuh_xfer_stats_t *stats) {
+    tuh_xfer_stats_get(stats);
+}
+
+void M5_USBH_Host::getEnumStats(tuh_enum_stats_t *stats) {
+    tuh_enum_stats_get(stats);
+}
+
+#if defined(ARDUINO_ARCH_ESP32) && CFG_TUH_DESC_CACHE
+
+//--------------------------------------------------------------------+
+// Descriptor cache in NVS
+// key: VID, PID, 'c' (configuration) or 'r' (report), index, hash of the
+// whole cache key (device descriptor and serial number)
+// blob: cache key (validity check) followed by the descriptor
+//--------------------------------------------------------------------+
+
+#define DESC_CACHE_NAMESPACE "usbh_desc"
+
+static bool desc_cache_enabled;
+static nvs_handle_t desc_cache_nvs;
+static uint8_t desc_cache_blob[sizeof(tuh_desc_cache_key_t) +
+                               CFG_TUH_ENUMERATION_BUFSIZE];
+
+static bool desc_cache_open(void) {
+    if (!desc_cache_nvs &&
+        nvs_open(DESC_CACHE_NAMESPACE, NVS_READWRITE, &desc_cache_nvs) !=
+            ESP_OK) {
+        desc_cache_nvs = 0;
+        return false;
+    }
+    return true;
+}
+
+static void desc_cache_key(char *key, tuh_desc_cache_key_t const *cache_key,
+                           uint8_t desc_type, uint8_t index) {
+    // FNV-1a, units of the same model get their own entries
+    uint8_t const *p = (uint8_t const *)cache_key;
+    uint32_t hash    = 2166136261u;
+    for (size_t i = 0; i < sizeof(tuh_desc_cache_key_t); i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+
+    // NVS key is at most 15 characters
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%04x%04x%c%02x%04x",
+             cache_key->desc_device.idVendor, cache_key->desc_device.idProduct,
+             (desc_type == TUSB_DESC_CONFIGURATION) ? 'c' : 'r', index,
+             (unsigned)((hash ^ (hash >> 16)) & 0xffff));
+}
+
+void M5_USBH_Host::setDescriptorCache(bool enabled) {
+    desc_cache_enabled = enabled;
+}
+
+bool M5_USBH_Host::clearDescriptorCache(void) {
+    if (!desc_cache_open()) {
+        return false;
+    }
+    return nvs_erase_all(desc_cache_nvs) == ESP_OK &&
+           nvs_commit(desc_cache_nvs) == ESP_OK;
+}
+
+uint16_t tuh_descriptor_cache_load_cb(tuh_desc_cache_key_t const *cache_key,
+                                      uint8_t desc_type, uint8_t index,
+                                      uint8_t *buf, uint16_t bufsize) {
+    if (!desc_cache_enabled || !desc_cache_open()) {
+        return 0;
+    }
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    desc_cache_key(key, cache_key, desc_type, index);
+
+    size_t size = sizeof(desc_cache_blob);
+    if (nvs_get_blob(desc_cache_nvs, key, desc_cache_blob, &size) != ESP_OK ||
+        size <= sizeof(tuh_desc_cache_key_t) ||
+        size - sizeof(tuh_desc_cache_key_t) > bufsize) {
+        return 0;
+    }
+
+    // other device with the same hash, or device was changed (e.g. max
+    // packet size)
+    if (memcmp(desc_cache_blob, cache_key, sizeof(tuh_desc_cache_key_t))) {
+        return 0;
+    }
+
+    uint16_t const len = (uint16_t)(size - sizeof(tuh_desc_cache_key_t));
+    memcpy(buf, desc_cache_blob + sizeof(tuh_desc_cache_key_t), len);
+    return len;
+}
+
+void tuh_descriptor_cache_store_cb(tuh_desc_cache_key_t const *cache_key,
+                                   uint8_t desc_type, uint8_t index,
+                                   uint8_t const *desc, uint16_t len) {
+    if (!desc_cache_enabled || len > CFG_TUH_ENUMERATION_BUFSIZE ||
+        !desc_cache_open()) {
+        return;
+    }
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    desc_cache_key(key, cache_key, desc_type, index);
+
+    memcpy(desc_cache_blob, cache_key, sizeof(tuh_desc_cache_key_t));
+    memcpy(desc_cache_blob + sizeof(tuh_desc_cache_key_t), desc, len);
+    if (nvs_set_blob(desc_cache_nvs, key, desc_cache_blob,
+                     sizeof(tuh_desc_cache_key_t) + len) == ESP_OK) {
+        nvs_commit(desc_cache_nvs);
+    }
+}
+
+#endif
+
 // Invoked when device with hid interface is mounted
 // Report descriptor is also available for use.
 // tuh_hid_parse_report_descriptor() can be used to parse common/simple enough
@@ -192,17 +411,102 @@ extern "C" void hcd_int_handler_esp32(uint8_t rhport, bool in_isr);
 
 #endif
 
+// Rate limit of interrupt servicing: when the handler has been busy for more
+// than MAX3421_BUSY_BUDGET_US within MAX3421_BUSY_WINDOW_US (e.g. NAK retries
+// on an idle interrupt endpoint), sleep one tick so that the USB host task and
+// others on the same core can run. Otherwise interrupts are serviced at once.
+#define MAX3421_BUSY_WINDOW_US 1000
+#define MAX3421_BUSY_BUDGET_US 500
+
 static void max3421_intr_task(void *param) {
     (void)param;
 
+    gpio_num_t const intr = (gpio_num_t)M5_USBH_Host::_instance->_intr;
+    uint32_t window_start = micros();
+    uint32_t busy_us      = 0;
+
     while (1) {
         xSemaphoreTake(max3421_intr_sem, portMAX_DELAY);
-        tuh_int_handler_esp32(1, false);
-        vTaskDelay(5 / portTICK_PERIOD_MS);
+        max3421_intr_stats.wakeups++;
+
+        uint32_t start = micros();
+        if (start - window_start >= MAX3421_BUSY_WINDOW_US) {
+            window_start = start;
+            busy_us      = 0;
+        }
+        if (busy_us >= MAX3421_BUSY_BUDGET_US) {
+            max3421_intr_stats.throttled++;
+            vTaskDelay(1);
+            start        = micros();
+            window_start = start;
+            busy_us      = 0;
+        }
+
+        // Woken by a falling edge only, but INT stays low while any IRQ is
+        // pending (CFG_TUH_MAX3421_INT_LEVEL): service until it deasserts or
+        // the budget is used up
+        // While an asynchronous RCVFIFO read is in flight, the SPI task resumes
+        // the pass and wakes this task up if INT is still asserted
+        uint32_t passes = 0;
+        uint32_t elapsed;
+        do {
+            tuh_int_handler_esp32(1, false);
+            passes++;
+            elapsed = micros() - start;
+        } while (gpio_get_level(intr) == 0 && !tuh_max3421_spi_async_pending(1) &&
+                 busy_us + elapsed < MAX3421_BUSY_BUDGET_US);
+        busy_us += elapsed;
+
+        max3421_intr_stats.passes += passes;
+        max3421_intr_stats.busy_us += elapsed;
+        if (passes > max3421_intr_stats.max_passes) {
+            max3421_intr_stats.max_passes = passes;
+        }
+
+        // still asserted: no new falling edge will come, service again (after
+        // the throttle above)
+        if (gpio_get_level(intr) == 0 && !tuh_max3421_spi_async_pending(1)) {
+            xSemaphoreGive(max3421_intr_sem);
+        }
+    }
+}
+
+static void max3421_wakeup_cb(void *arg) {
+    (void)arg;
+    xSemaphoreGive(max3421_intr_sem);
+}
+
+static void max3421_spi_task(void *param) {
+    (void)param;
+
+    gpio_num_t const intr = (gpio_num_t)M5_USBH_Host::_instance->_intr;
+
+    while (1) {
+        max3421_spi_req_t req;
+        xQueueReceive(max3421_spi_queue, &req, portMAX_DELAY);
+        tuh_max3421_spi_xact_t *xact = req.xact;
+
+        // same SPIClass as synchronous access: bus is shared with other
+        // devices (LCD, SD) by its transaction lock
+        tuh_max3421_spi_cs_api(req.rhport, true);
+        bool const ok =
+            tuh_max3421_spi_xfer_api(req.rhport, &xact->cmd, &xact->status, 1) &&
+            tuh_max3421_spi_xfer_api(req.rhport, xact->tx_buf, xact->rx_buf,
+                                     xact->len);
+        tuh_max3421_spi_cs_api(req.rhport, false);
+
+        // resume the interrupt pass
+        xact->complete_cb(req.rhport, xact, ok);
+
+        if (gpio_get_level(intr) == 0) {
+            xSemaphoreGive(max3421_intr_sem);
+        }
     }
 }
 
 static void max3421_isr(void) {
+    tuh_max3421_isr_cb(1);
+
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     xSemaphoreGiveFromISR(max3421_intr_sem, &xHigherPriorityTaskWoken);
     if (xHigherPriorityTaskWoken) {
@@ -213,6 +517,7 @@ static void max3421_isr(void) {
 #else
 
 static void max3421_isr(void) {
+    tuh_max3421_isr_cb(1);
     tuh_int_handler(1, true);
 }
 
@@ -220,6 +525,44 @@ static void max3421_isr(void) {
 
 extern "C" {
 
+// Invoked in ISR context on every MAX3421E INT falling edge, e.g for latency
+// tracing. Must be short and ISR-safe.
+TU_ATTR_WEAK void tuh_max3421_isr_cb(uint8_t rhport) {
+    (void)rhport;
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+bool tuh_max3421_spi_submit_api(uint8_t rhport, tuh_max3421_spi_xact_t *xact) {
+    if (!max3421_spi_queue) {
+        return false;
+    }
+    max3421_spi_req_t const req = {rhport, xact};
+    return xQueueSend(max3421_spi_queue, &req, 0) == pdTRUE;
+}
+
+bool tuh_max3421_time_us_api(uint8_t rhport, uint32_t *time_us) {
+    (void)rhport;
+    if (!max3421_wakeup_timer) {
+        return false;
+    }
+    *time_us = (uint32_t)esp_timer_get_time();
+    return true;
+}
+
+bool tuh_max3421_wakeup_api(uint8_t rhport, uint32_t delay_us) {
+    (void)rhport;
+    if (!max3421_wakeup_timer) {
+        return false;
+    }
+    // fails if not running, that is fine
+    esp_timer_stop(max3421_wakeup_timer);
+    if (delay_us) {
+        esp_timer_start_once(max3421_wakeup_timer, delay_us);
+    }
+    return true;
+}
+#endif
+
 void tuh_max3421_spi_cs_api(uint8_t rhport, bool active) {
     (void)rhport;
 
@@ -241,7 +584,11 @@ void tuh_max3421_spi_cs_api(uint8_t rhport, bool active) {
 
         spi->beginTransaction(SPISettings(max_clock, MSBFIRST, SPI_MODE0));
         digitalWrite(M5_USBH_Host::_instance->_cs, LOW);
+        max3421_spi_stats.xact++;
+        max3421_spi_stats.cs_start = max3421_spi_ticks();
     } else {
+        max3421_spi_stats.busy_ticks +=
+            (uint32_t)(max3421_spi_ticks() - max3421_spi_stats.cs_start);
         spi->endTransaction();
         digitalWrite(M5_USBH_Host::_instance->_cs, HIGH);
     }
@@ -279,6 +626,13 @@ bool tuh_max3421_spi_xfer_api(uint8_t rhport, uint8_t const *tx_buf,
     spi->transfer(tx_buf, rx_buf, xfer_bytes);
 #endif
 
+    if (tx_buf) {
+        max3421_spi_stats.tx_bytes += xfer_bytes;
+    }
+    if (rx_buf) {
+        max3421_spi_stats.rx_bytes += xfer_bytes;
+    }
+
     return true;
 }
 
@@ -39,6 +39,44 @@ void tuh_max3421_spi_cs_api(uint8_t rhport, bool active);
 bool tuh_max3421_spi_xfer_api(uint8_t rhport, uint8_t const *tx_buf,
                               uint8_t *rx_buf, size_t xfer_bytes);
 void tuh_max3421_int_api(uint8_t rhport, bool enabled);
+
+// Invoked in ISR context on every MAX3421E INT falling edge (weak, optional)
+void tuh_max3421_isr_cb(uint8_t rhport);
+
+// Number of SPI transactions and USB transactions since init (implemented by
+// the MAX3421E driver)
+void tuh_max3421_spi_stats(uint8_t rhport, uint32_t *spi_xact,
+                           uint32_t *usb_xact);
+
+// Number of SPI writes and skipped redundant writes of a shadow register
+// (HIEN, MODE, PERADDR, HCTL, PINCTL), false if reg is not shadowed
+bool tuh_max3421_reg_stats(uint8_t rhport, uint8_t reg, uint32_t *write_count,
+                           uint32_t *skip_count);
+
+// Number of NAKs received on an opened endpoint, false if not opened
+bool tuh_max3421_nak_stats(uint8_t rhport, uint8_t daddr, uint8_t ep_addr,
+                           uint32_t *nak_count);
+
+// Number of interrupt handler calls since init
+uint32_t tuh_max3421_int_stats(uint8_t rhport);
+
+// Reset all statistics of the MAX3421E driver
+void tuh_max3421_stats_reset(uint8_t rhport);
+
+// Submit an asynchronous SPI transaction, false if not supported or busy
+bool tuh_max3421_spi_submit_api(uint8_t rhport, tuh_max3421_spi_xact_t *xact);
+
+// Whether an asynchronous RCVFIFO read is in flight (interrupt pass is
+// resumed on its completion)
+bool tuh_max3421_spi_async_pending(uint8_t rhport);
+
+// Free running microsecond timer, false if not supported
+bool tuh_max3421_time_us_api(uint8_t rhport, uint32_t *time_us);
+
+// Invoke the interrupt handler after delay_us (0 cancels), false if not
+// supported. Frame number is then derived from the timer and FRAME_IRQ is
+// only enabled while the scheduler waits for the next frame
+bool tuh_max3421_wakeup_api(uint8_t rhport, uint32_t delay_us);
 }
 
 class M5_USBH_Host {
@@ -48,6 +86,8 @@ private:
   // for esp32 or using softwareSPI
   int8_t _sck, _mosi, _miso;
 
+  bool _async_spi;
+
 public:
   int8_t _cs;
   int8_t _intr;
@@ -68,6 +108,42 @@ public:
     return max3421_writeRegister(IOPINS2_ADDR, data, in_isr);
   }
 
+#ifdef ARDUINO_ARCH_ESP32
+  // Interrupt servicing statistics of the MAX3421E interrupt task
+  typedef struct {
+    uint32_t wakeups;    // number of times the task is woken up
+    uint32_t passes;     // number of interrupt handler calls
+    uint32_t max_passes; // max handler calls in one wakeup until INT deasserts
+    uint32_t busy_us;    // total time spent in the interrupt handler
+    uint32_t throttled;  // number of times the busy budget is exceeded
+  } max3421_intr_stats_t;
+
+  void max3421_getIntrStats(max3421_intr_stats_t *stats);
+
+  // Read RCVFIFO data of CFG_TUH_MAX3421_SPI_ASYNC_MIN bytes or more on a SPI
+  // task on the other core, interrupt servicing resumes when it is done so
+  // the USB stack can run meanwhile. Must be called before begin()
+  void max3421_setAsyncSpi(bool enabled) { _async_spi = enabled; }
+#endif
+
+  // SPI and bus utilization statistics since begin() or max3421_resetStats()
+  typedef struct {
+    uint32_t spi_xact;     // SPI transactions (CS asserted)
+    uint32_t spi_tx_bytes; // bytes written to MAX3421E (incl. command byte)
+    uint32_t spi_rx_bytes; // bytes read from MAX3421E (incl. HIRQ status)
+    uint32_t spi_busy_us;  // total time with CS asserted
+    uint32_t usb_xact;     // USB transactions (incl. NAK)
+    uint32_t interrupts;   // interrupt handler calls
+  } max3421_stats_t;
+
+  void max3421_getStats(max3421_stats_t *stats);
+
+  // Number of NAKs on an opened endpoint, false if not opened
+  bool max3421_getNakCount(uint8_t daddr, uint8_t ep_addr, uint32_t *count);
+
+  // Reset statistics of SPI, interrupts, NAKs and completed transfers
+  void max3421_resetStats(void);
+
 private:
   friend void tuh_max3421_spi_cs_api(uint8_t rhport, bool active);
   friend bool tuh_max3421_spi_xfer_api(uint8_t rhport, uint8_t const *tx_buf,
@@ -91,6 +167,23 @@ public:
   bool begin(uint8_t rhport);
   void task(uint32_t timeout_ms = UINT32_MAX, bool in_isr = false);
 
+  // Number of completed transfers per class driver (TUH_XFER_STATS_*)
+  void getXferStats(tuh_xfer_stats_t *stats);
+
+  // Enumerated devices and bring-up time (first attach to last mounted device)
+  void getEnumStats(tuh_enum_stats_t *stats);
+
+#if defined(ARDUINO_ARCH_ESP32) && CFG_TUH_DESC_CACHE
+  // Keep configuration and HID report descriptors in NVS: on re-plug of a
+  // known device (same device descriptor and serial number) they are not
+  // read again and the attach debounce is 100 ms instead of 450 ms.
+  // Flash is only written on the first plug of a device
+  void setDescriptorCache(bool enabled);
+
+  // Erase all cached descriptors
+  bool clearDescriptorCache(void);
+#endif
+
   //------------- internal usage -------------//
   static M5_USBH_Host *_instance;
 
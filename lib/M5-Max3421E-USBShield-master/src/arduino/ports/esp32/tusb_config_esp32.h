@@ -97,6 +97,12 @@ extern "C" {
 #define CFG_TUH_MAX3421_ENDPOINT_TOTAL (8 + 4 * (CFG_TUH_DEVICE_MAX - 1))
 #endif
 
+// MAX3421E INT output is active low level. The GPIO interrupt stays falling
+// edge, the interrupt task drains while the pin reads low
+#ifndef CFG_TUH_MAX3421_INT_LEVEL
+#define CFG_TUH_MAX3421_INT_LEVEL 1
+#endif
+
 // Size of buffer to hold descriptors and other data used for enumeration
 #define CFG_TUH_ENUMERATION_BUFSIZE 256
 
@@ -106,6 +112,19 @@ extern "C" {
 // max device support (excluding hub device): 1 hub typically has 4 ports
 #define CFG_TUH_DEVICE_MAX (3 * CFG_TUH_HUB + 1)
 
+// Devices behind the hub are enumerated concurrently, each with its own
+// CFG_TUH_ENUMERATION_BUFSIZE buffer
+#ifndef CFG_TUH_ENUMERATION_MAX
+#define CFG_TUH_ENUMERATION_MAX CFG_TUH_DEVICE_MAX
+#endif
+
+// Configuration/report descriptors of a known device are taken from NVS on
+// re-plug and its attach debounce is shortened, see
+// Adafruit_USBH_Host::setDescriptorCache()
+#ifndef CFG_TUH_DESC_CACHE
+#define CFG_TUH_DESC_CACHE 1
+#endif
+
 // Enable tuh_edpt_xfer() API
 // #define CFG_TUH_API_EDPT_XFER       1
 
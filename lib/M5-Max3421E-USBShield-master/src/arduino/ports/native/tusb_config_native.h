@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018, hathach for Adafruit
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TUSB_CONFIG_NATIVE_H_
+#define TUSB_CONFIG_NATIVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Native (Linux/macOS) build of the host stack, used with the software MAX3421E
+// model in test/test_max3421_sim. The application provides the same SPI/INT API
+// as on target (tuh_max3421_spi_xfer_api() etc.) and calls hcd_int_handler()
+// while the INT pin is asserted.
+
+//--------------------------------------------------------------------
+// COMMON CONFIGURATION
+//--------------------------------------------------------------------
+
+#define CFG_TUSB_MCU OPT_MCU_NONE
+#define CFG_TUSB_OS OPT_OS_NONE
+
+#ifndef CFG_TUSB_DEBUG
+#define CFG_TUSB_DEBUG 0
+#endif
+
+//--------------------------------------------------------------------
+// Host Configuration
+//--------------------------------------------------------------------
+
+// Enable host stack with MAX3421E, same as ESP32 port
+#define CFG_TUH_ENABLED 1
+#define CFG_TUH_MAX_SPEED OPT_MODE_FULL_SPEED
+#define CFG_TUH_MAX3421 1
+
+#ifndef CFG_TUH_MAX3421_ENDPOINT_TOTAL
+#define CFG_TUH_MAX3421_ENDPOINT_TOTAL (8 + 4 * (CFG_TUH_DEVICE_MAX - 1))
+#endif
+
+// MAX3421E INT output is active low level: handler is called until INT
+// deasserts
+#ifndef CFG_TUH_MAX3421_INT_LEVEL
+#define CFG_TUH_MAX3421_INT_LEVEL 1
+#endif
+
+// Keyboard reports (8 bytes) also take the asynchronous SPI path when the
+// model's queued backend is enabled
+#ifndef CFG_TUH_MAX3421_SPI_ASYNC_MIN
+#define CFG_TUH_MAX3421_SPI_ASYNC_MIN 8
+#endif
+
+// Size of buffer to hold descriptors and other data used for enumeration
+#define CFG_TUH_ENUMERATION_BUFSIZE 256
+
+// Hub is supported, same as ESP32 port: the model can attach keyboards behind a hub
+#define CFG_TUH_HUB 1
+#define CFG_TUH_DEVICE_MAX (3 * CFG_TUH_HUB + 1)
+
+// Descriptor cache callbacks are provided by the test
+#ifndef CFG_TUH_DESC_CACHE
+#define CFG_TUH_DESC_CACHE 1
+#endif
+
+// Number of HIDs
+#define CFG_TUH_HID 4
+
+// Bulk OUT endpoint of the model (no class driver) is driven by tuh_edpt_xfer()
+#define CFG_TUH_API_EDPT_XFER 1
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -617,7 +617,18 @@ static void process_set_config(tuh_xfer_t* xfer)
         config_driver_mount_complete(daddr, idx, NULL, 0);
       }else
       {
-        tuh_descriptor_get_hid_report(daddr, itf_num, p_hid->report_desc_type, 0, usbh_get_enum_buf(), p_hid->report_desc_len, process_set_config, CONFIG_COMPLETE);
+        // Same device was enumerated before: report descriptor is taken from cache
+        bool const cached = usbh_desc_cache_load(daddr, p_hid->report_desc_type, itf_num, usbh_get_enum_buf(), p_hid->report_desc_len) == p_hid->report_desc_len;
+        usbh_desc_cache_count(cached);
+
+        if ( cached )
+        {
+          TU_LOG_DRV("HID Report Descriptor from cache\r\n");
+          config_driver_mount_complete(daddr, idx, usbh_get_enum_buf(), p_hid->report_desc_len);
+        }else
+        {
+          tuh_descriptor_get_hid_report(daddr, itf_num, p_hid->report_desc_type, 0, usbh_get_enum_buf(), p_hid->report_desc_len, process_set_config, CONFIG_COMPLETE);
+        }
       }
       break;
 
@@ -626,6 +637,11 @@ static void process_set_config(tuh_xfer_t* xfer)
       uint8_t const* desc_report = usbh_get_enum_buf();
       uint16_t const desc_len    = tu_le16toh(xfer->setup->wLength);
 
+      if ( xfer->actual_len == desc_len )
+      {
+        usbh_desc_cache_store(daddr, p_hid->report_desc_type, itf_num, desc_report, desc_len);
+      }
+
       config_driver_mount_complete(daddr, idx, desc_report, desc_len);
     }
     break;
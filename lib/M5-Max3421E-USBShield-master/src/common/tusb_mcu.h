@@ -408,6 +408,37 @@
   #ifndef CFG_TUH_MAX3421_ENDPOINT_TOTAL
     #define CFG_TUH_MAX3421_ENDPOINT_TOTAL  (8 + 4*(CFG_TUH_DEVICE_MAX-1))
   #endif
+
+  // MAX3421E INT output mode (PINCTL.INTLEVEL): 0 = negative edge (pulse), 1 = active low level (asserted while any enabled IRQ is pending)
+  // The MCU pin interrupt trigger is up to the port, e.g. Arduino ESP32 stays falling edge and drains while INT is low
+  #ifndef CFG_TUH_MAX3421_INT_LEVEL
+    #define CFG_TUH_MAX3421_INT_LEVEL  0
+  #endif
+
+  // Default NAK retry policy (TUH_MAX3421_NAK_RETRY_*), can be changed by tuh_configure(TUH_CFGID_MAX3421)
+  // 0 = immediate, 1 = next frame, 2 = next frame with bounded count/timeout
+  #ifndef CFG_TUH_MAX3421_NAK_POLICY_CONTROL
+    #define CFG_TUH_MAX3421_NAK_POLICY_CONTROL  2
+  #endif
+
+  #ifndef CFG_TUH_MAX3421_NAK_POLICY_BULK
+    #define CFG_TUH_MAX3421_NAK_POLICY_BULK  1
+  #endif
+
+  // bounded policy: max NAKs per transfer (0 is no limit) and timeout in ms since transfer is queued (0 is none)
+  #ifndef CFG_TUH_MAX3421_NAK_LIMIT
+    #define CFG_TUH_MAX3421_NAK_LIMIT  0
+  #endif
+
+  #ifndef CFG_TUH_MAX3421_NAK_TIMEOUT_MS
+    #define CFG_TUH_MAX3421_NAK_TIMEOUT_MS  5000
+  #endif
+
+  // Asynchronous SPI backend (tuh_max3421_spi_submit_api): RCVFIFO reads of at least this many bytes are submitted
+  // and the interrupt pass is resumed on completion. Shorter reads are done synchronously
+  #ifndef CFG_TUH_MAX3421_SPI_ASYNC_MIN
+    #define CFG_TUH_MAX3421_SPI_ASYNC_MIN  32
+  #endif
 #endif
 
 
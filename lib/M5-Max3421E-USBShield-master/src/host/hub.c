@@ -329,7 +329,14 @@ static void config_port_power_complete (tuh_xfer_t* xfer)
 static void hub_port_get_status_complete (tuh_xfer_t* xfer);
 static void hub_get_status_complete (tuh_xfer_t* xfer);
 static void connection_clear_conn_change_complete (tuh_xfer_t* xfer);
-static void connection_port_reset_complete (tuh_xfer_t* xfer);
+
+// Clear a change bit. Control pipe can be busy with enumeration of other ports:
+// the change is still reported by status endpoint, try again with next status
+static void hub_port_clear_change(uint8_t daddr, uint8_t port_num, uint8_t feature, tuh_xfer_cb_t complete_cb) {
+  if ( !hub_port_clear_feature(daddr, port_num, feature, complete_cb, 0) ) {
+    hub_edpt_status_xfer(daddr);
+  }
+}
 
 // callback as response of interrupt endpoint polling
 bool hub_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes) {
@@ -393,12 +400,12 @@ static void hub_get_status_complete (tuh_xfer_t* xfer)
   if (p_hub->hub_status.change.local_power_source)
   {
     TU_LOG2("HUB Local Power Change, addr = %u\r\n", daddr);
-    hub_port_clear_feature(daddr, port_num, HUB_FEATURE_HUB_LOCAL_POWER_CHANGE, hub_clear_feature_complete_stub, 0);
+    hub_port_clear_change(daddr, port_num, HUB_FEATURE_HUB_LOCAL_POWER_CHANGE, hub_clear_feature_complete_stub);
   }
   else if (p_hub->hub_status.change.over_current)
   {
     TU_LOG1("HUB Over Current, addr = %u\r\n", daddr);
-    hub_port_clear_feature(daddr, port_num, HUB_FEATURE_HUB_OVER_CURRENT_CHANGE, hub_clear_feature_complete_stub, 0);
+    hub_port_clear_change(daddr, port_num, HUB_FEATURE_HUB_OVER_CURRENT_CHANGE, hub_clear_feature_complete_stub);
   }
 }
 
@@ -417,25 +424,25 @@ static void hub_port_get_status_complete (tuh_xfer_t* xfer)
     //TU_VERIFY(port_status.status_current.port_power && port_status.status_current.port_enable, );
 
     // Acknowledge Port Connection Change
-    hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_CONNECTION_CHANGE, connection_clear_conn_change_complete, 0);
+    hub_port_clear_change(daddr, port_num, HUB_FEATURE_PORT_CONNECTION_CHANGE, connection_clear_conn_change_complete);
   }else
   {
     // Clear other port status change interrupts. TODO Not currently handled - just cleared.
     if (p_hub->port_status.change.port_enable)
     {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_ENABLE_CHANGE, hub_clear_feature_complete_stub, 0);
+      hub_port_clear_change(daddr, port_num, HUB_FEATURE_PORT_ENABLE_CHANGE, hub_clear_feature_complete_stub);
     }
     else if (p_hub->port_status.change.suspend)
     {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_SUSPEND_CHANGE, hub_clear_feature_complete_stub, 0);
+      hub_port_clear_change(daddr, port_num, HUB_FEATURE_PORT_SUSPEND_CHANGE, hub_clear_feature_complete_stub);
     }
     else if (p_hub->port_status.change.over_current)
     {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_OVER_CURRENT_CHANGE, hub_clear_feature_complete_stub, 0);
+      hub_port_clear_change(daddr, port_num, HUB_FEATURE_PORT_OVER_CURRENT_CHANGE, hub_clear_feature_complete_stub);
     }
     else if (p_hub->port_status.change.reset)
     {
-      hub_port_clear_feature(daddr, port_num, HUB_FEATURE_PORT_RESET_CHANGE, hub_clear_feature_complete_stub, 0);
+      hub_port_clear_change(daddr, port_num, HUB_FEATURE_PORT_RESET_CHANGE, hub_clear_feature_complete_stub);
     }
     // Other changes are: L1 state
     // TODO clear change
@@ -457,46 +464,17 @@ static void connection_clear_conn_change_complete (tuh_xfer_t* xfer)
   hub_interface_t* p_hub = get_itf(daddr);
   uint8_t const port_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
 
-  if ( p_hub->port_status.status.connection )
-  {
-    // Reset port if attach event
-    hub_port_reset(daddr, port_num, connection_port_reset_complete, 0);
-  }else
-  {
-    // submit detach event
-    hcd_event_t event =
-    {
-      .rhport     = usbh_get_rhport(daddr),
-      .event_id   = HCD_EVENT_DEVICE_REMOVE,
-      .connection =
-       {
-         .hub_addr = daddr,
-         .hub_port = port_num
-       }
-    };
-
-    hcd_event_handler(&event, false);
-  }
-}
-
-static void connection_port_reset_complete (tuh_xfer_t* xfer)
-{
-  TU_ASSERT(xfer->result == XFER_RESULT_SUCCESS, );
-
-  uint8_t const daddr = xfer->daddr;
-  // hub_interface_t* p_hub = get_itf(daddr);
-  uint8_t const port_num = (uint8_t) tu_le16toh(xfer->setup->wIndex);
-
-  // submit attach event
+  // submit attach/detach event
+  // Port is reset by enumeration after debouncing, one port at a time since reset device responds to address 0
   hcd_event_t event =
   {
     .rhport     = usbh_get_rhport(daddr),
-    .event_id   = HCD_EVENT_DEVICE_ATTACH,
+    .event_id   = p_hub->port_status.status.connection ? HCD_EVENT_DEVICE_ATTACH : HCD_EVENT_DEVICE_REMOVE,
     .connection =
-    {
-      .hub_addr = daddr,
-      .hub_port = port_num
-    }
+     {
+       .hub_addr = daddr,
+       .hub_port = port_num
+     }
   };
 
   hcd_event_handler(&event, false);
@@ -212,6 +212,27 @@ static usbh_class_driver_t const usbh_class_drivers[] = {
 };
 
 enum { BUILTIN_DRIVER_COUNT = TU_ARRAY_SIZE(usbh_class_drivers) };
+
+// TUH_XFER_STATS_* of built-in drivers, same order as usbh_class_drivers[]
+static uint8_t const usbh_class_stats_id[] = {
+    #if CFG_TUH_CDC
+    TUH_XFER_STATS_CDC,
+    #endif
+    #if CFG_TUH_MSC
+    TUH_XFER_STATS_MSC,
+    #endif
+    #if CFG_TUH_HID
+    TUH_XFER_STATS_HID,
+    #endif
+    #if CFG_TUH_HUB
+    TUH_XFER_STATS_HUB,
+    #endif
+    #if CFG_TUH_VENDOR
+    TUH_XFER_STATS_VENDOR,
+    #endif
+};
+
+TU_VERIFY_STATIC(sizeof(usbh_class_stats_id) == BUILTIN_DRIVER_COUNT, "stats id must match usbh_class_drivers[]");
 enum { CONFIG_NUM = 1 }; // default to use configuration 1
 
 // Additional class drivers implemented by application
@@ -232,6 +253,11 @@ static inline usbh_class_driver_t const *get_driver(uint8_t drv_id) {
   return driver;
 }
 
+static inline uint8_t get_driver_stats_id(uint8_t drv_id) {
+  if ( drv_id < _app_driver_count ) return TUH_XFER_STATS_APP;
+  return usbh_class_stats_id[drv_id - _app_driver_count];
+}
+
 //--------------------------------------------------------------------+
 // INTERNAL OBJECT & FUNCTION DECLARATION
 //--------------------------------------------------------------------+
@@ -262,9 +288,6 @@ static usbh_device_t _usbh_devices[TOTAL_DEVICES];
 OSAL_QUEUE_DEF(usbh_int_set, _usbh_qdef, CFG_TUH_TASK_QUEUE_SZ, hcd_event_t);
 static osal_queue_t _usbh_q;
 
-CFG_TUH_MEM_SECTION CFG_TUH_MEM_ALIGN
-static uint8_t _usbh_ctrl_buf[CFG_TUH_ENUMERATION_BUFSIZE];
-
 // Control transfers: since most controllers do not support multiple control transfers
 // on multiple devices concurrently and control transfers are not used much except for
 // enumeration, we will only execute control transfers one at a time.
@@ -279,6 +302,74 @@ CFG_TUH_MEM_SECTION struct {
   volatile uint16_t actual_len;
 }_ctrl_xfer;
 
+// Enumeration context of an attached device
+typedef struct {
+  uint8_t rhport;
+  uint8_t hub_addr;
+  uint8_t hub_port;
+  uint8_t speed;
+
+  uint8_t daddr;        // assigned address, 0 before SET_ADDRESS
+  uint8_t state;        // step to run (or running)
+  uint8_t xfer_state;   // step which started the control transfer in progress (retried if failed)
+  uint8_t failed_count;
+
+  struct TU_ATTR_PACKED {
+    uint8_t active     : 1;
+    uint8_t delaying   : 1; // state is run when delay_ms is elapsed
+    uint8_t wait_addr0 : 1; // state is run when address 0 is free
+    uint8_t wait_ctrl  : 1; // state is run when control pipe is free
+    uint8_t xfer_busy  : 1;
+    uint8_t cached     : 1; // configuration descriptor is from cache
+    uint8_t debounce_short : 1; // attach debounce was shortened, the rest is waited for if device is not cached
+    uint8_t TU_RESERVED : 1;
+  };
+
+  uint32_t delay_start_ms;
+  uint32_t delay_ms;
+
+  tuh_desc_cache_key_t cache_key;
+
+  CFG_TUH_MEM_ALIGN uint8_t buf[CFG_TUH_ENUMERATION_BUFSIZE];
+} usbh_enum_t;
+
+#define ENUM_ATTACH_QUEUE_SZ  TOTAL_DEVICES
+#define ENUM_CTRL_QUEUE_SZ    TOTAL_DEVICES
+
+// Control transfer to another device submitted while class drivers of a device are being configured
+typedef struct {
+  tuh_xfer_t xfer;
+  tusb_control_request_t setup;
+} usbh_ctrl_queued_t;
+
+CFG_TUH_MEM_SECTION static struct {
+  usbh_enum_t ctx[CFG_TUH_ENUMERATION_MAX];
+
+  // newly attached devices waiting for a context
+  struct {
+    uint8_t rhport;
+    uint8_t hub_addr;
+    uint8_t hub_port;
+  } attach[ENUM_ATTACH_QUEUE_SZ];
+  uint8_t attach_count;
+
+  uint8_t addr0_owner; // context at address 0
+  uint8_t drv_owner;   // context configuring class drivers
+
+  // control transfers waiting for drv_owner to finish, started in order by enum_process()
+  usbh_ctrl_queued_t ctrl_queue[ENUM_CTRL_QUEUE_SZ];
+  uint8_t ctrl_queue_count;
+  uint8_t rr_next;     // next context to start a control transfer (round-robin)
+
+  // statistics
+  tuh_enum_stats_t stats;
+  bool attached;       // stats.bringup_ms is counted from first_attach_ms
+  uint32_t first_attach_ms;
+} _enum;
+
+// Completed transfers per class driver, only updated in usbh task
+static tuh_xfer_stats_t _usbh_xfer_stats;
+
 //------------- Helper Function -------------//
 
 TU_ATTR_ALWAYS_INLINE static inline usbh_device_t* get_device(uint8_t dev_addr) {
@@ -286,7 +377,12 @@ TU_ATTR_ALWAYS_INLINE static inline usbh_device_t* get_device(uint8_t dev_addr)
   return &_usbh_devices[dev_addr-1];
 }
 
-static bool enum_new_device(hcd_event_t* event);
+static void enum_init(void);
+static void enum_attach(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
+static void enum_remove(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
+static uint32_t enum_process(void);
+static bool enum_ctrl_allowed(uint8_t daddr);
+static bool enum_ctrl_queue(tuh_xfer_t const* xfer);
 static void process_removing_device(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port);
 static bool usbh_edpt_control_open(uint8_t dev_addr, uint8_t max_packet_size);
 static bool usbh_control_xfer_cb (uint8_t daddr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
@@ -400,6 +496,8 @@ bool tuh_init(uint8_t controller_id) {
   tu_memclr(&_dev0, sizeof(_dev0));
   tu_memclr(_usbh_devices, sizeof(_usbh_devices));
   tu_memclr(&_ctrl_xfer, sizeof(_ctrl_xfer));
+  tu_memclr(&_usbh_xfer_stats, sizeof(_usbh_xfer_stats));
+  enum_init();
 
   for(uint8_t i=0; i<TOTAL_DEVICES; i++) {
     clear_device(&_usbh_devices[i]);
@@ -456,29 +554,28 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr) {
   // Loop until there is no more events in the queue
   while (1)
   {
+    // continue enumeration steps waiting for a delay or the control pipe, wake up for the next delay
+    uint32_t const enum_wait_ms = enum_process();
+
     hcd_event_t event;
-    if ( !osal_queue_receive(_usbh_q, &event, timeout_ms) ) return;
+    if ( !osal_queue_receive(_usbh_q, &event, tu_min32(timeout_ms, enum_wait_ms)) ) {
+      (void) enum_process();
+      return;
+    }
 
     switch (event.event_id)
     {
       case HCD_EVENT_DEVICE_ATTACH:
-        // due to the shared _usbh_ctrl_buf, we must complete enumerating one device before enumerating another one.
-        // TODO better to have an separated queue for newly attached devices
-        if ( _dev0.enumerating ) {
-          TU_LOG_USBH("[%u:] USBH Defer Attach until current enumeration complete\r\n", event.rhport);
-
-          bool is_empty = osal_queue_empty(_usbh_q);
-          queue_event(&event, in_isr);
+        // newly attached devices are queued and enumerated concurrently (up to CFG_TUH_ENUMERATION_MAX)
+        TU_LOG_USBH("[%u:%u:%u] USBH DEVICE ATTACH\r\n", event.rhport, event.connection.hub_addr, event.connection.hub_port);
+        enum_attach(event.rhport, event.connection.hub_addr, event.connection.hub_port);
 
-          if (is_empty) {
-            // Exit if this is the only event in the queue, otherwise we may loop forever
-            return;
-          }
-        }else {
-          TU_LOG_USBH("[%u:] USBH DEVICE ATTACH\r\n", event.rhport);
-          _dev0.enumerating = 1;
-          enum_new_device(&event);
+        #if CFG_TUH_HUB
+        if ( event.connection.hub_addr != 0 ) {
+          // hub is not blocked by enumeration of this port, waiting for next data on status pipe
+          (void) hub_edpt_status_xfer( event.connection.hub_addr );
         }
+        #endif
       break;
 
       case HCD_EVENT_DEVICE_REMOVE:
@@ -535,6 +632,7 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr) {
                   .user_data   = dev->ep_callback[epnum][ep_dir].user_data
               };
 
+              _usbh_xfer_stats.count[TUH_XFER_STATS_APP]++;
               complete_cb(&xfer);
             }else
             #endif
@@ -544,6 +642,7 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr) {
               if ( driver )
               {
                 TU_LOG_USBH("%s xfer callback\r\n", driver->name);
+                _usbh_xfer_stats.count[get_driver_stats_id(drv_id)]++;
                 driver->xfer_cb(event.dev_addr, ep_addr, (xfer_result_t) event.xfer_complete.result,
                                 event.xfer_complete.len);
               }
@@ -567,7 +666,10 @@ void tuh_task_ext(uint32_t timeout_ms, bool in_isr) {
 
 #if CFG_TUSB_OS != OPT_OS_NONE && CFG_TUSB_OS != OPT_OS_PICO
     // return if there is no more events, for application to run other background
-    if (osal_queue_empty(_usbh_q)) return;
+    if (osal_queue_empty(_usbh_q)) {
+      (void) enum_process();
+      return;
+    }
 #endif
   }
 }
@@ -595,6 +697,13 @@ bool tuh_control_xfer (tuh_xfer_t* xfer) {
     if (dev && dev->connected == 0) return false;
   }
 
+  // class drivers of a device being configured must complete their sequence first: transfers to other devices are
+  // queued until then. A blocking transfer cannot wait here (it may be called from the class driver sequence)
+  if (!enum_ctrl_allowed(daddr)) {
+    TU_VERIFY(xfer->complete_cb);
+    return enum_ctrl_queue(xfer);
+  }
+
   // pre-check to help reducing mutex lock
   TU_VERIFY(_ctrl_xfer.stage == CONTROL_STAGE_IDLE);
   (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
@@ -678,6 +787,7 @@ static void _xfer_complete(uint8_t daddr, xfer_result_t result) {
   };
 
   _set_control_xfer_stage(CONTROL_STAGE_IDLE);
+  _usbh_xfer_stats.count[TUH_XFER_STATS_CONTROL]++;
 
   if (xfer_temp.complete_cb) {
     xfer_temp.complete_cb(&xfer_temp);
@@ -687,6 +797,9 @@ static void _xfer_complete(uint8_t daddr, xfer_result_t result) {
 static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes) {
   (void) ep_addr;
 
+  // completion of an aborted transfer (device unplugged)
+  TU_VERIFY(_ctrl_xfer.stage != CONTROL_STAGE_IDLE && dev_addr == _ctrl_xfer.daddr);
+
   const uint8_t rhport = usbh_get_rhport(dev_addr);
   tusb_control_request_t const * request = &_ctrl_xfer.request;
 
@@ -736,6 +849,23 @@ static bool usbh_control_xfer_cb (uint8_t dev_addr, uint8_t ep_addr, xfer_result
 //
 //--------------------------------------------------------------------+
 
+void tuh_xfer_stats_get(tuh_xfer_stats_t* stats) {
+  *stats = _usbh_xfer_stats;
+}
+
+void tuh_xfer_stats_reset(void) {
+  tu_memclr(&_usbh_xfer_stats, sizeof(_usbh_xfer_stats));
+}
+
+void tuh_enum_stats_get(tuh_enum_stats_t* stats) {
+  *stats = _enum.stats;
+}
+
+void tuh_enum_stats_reset(void) {
+  tu_memclr(&_enum.stats, sizeof(_enum.stats));
+  _enum.attached = false;
+}
+
 bool tuh_edpt_xfer(tuh_xfer_t* xfer) {
   uint8_t const daddr = xfer->daddr;
   uint8_t const ep_addr = xfer->ep_addr;
@@ -790,7 +920,9 @@ uint8_t usbh_get_rhport(uint8_t dev_addr) {
 }
 
 uint8_t *usbh_get_enum_buf(void) {
-  return _usbh_ctrl_buf;
+  // buffer of the device whose class drivers are being configured
+  uint8_t const idx = (_enum.drv_owner != TUSB_INDEX_INVALID_8) ? _enum.drv_owner : 0;
+  return _enum.ctx[idx].buf;
 }
 
 void usbh_int_set(bool enabled) {
@@ -1237,7 +1369,10 @@ static inline bool is_hub_addr(uint8_t daddr)
 static void process_removing_device(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port)
 {
   //------------- find the all devices (star-network) under port that is unplugged -------------//
-  // TODO mark as disconnected in ISR, also handle dev0
+  // TODO mark as disconnected in ISR
+
+  // stop enumerating devices under the port
+  enum_remove(rhport, hub_addr, hub_port);
 
 #if 0
   // index as hub addr, value is hub port (0xFF for invalid)
@@ -1296,293 +1431,661 @@ static void process_removing_device(uint8_t rhport, uint8_t hub_addr, uint8_t hu
 // Enumeration Process
 // is a lengthy process with a series of control transfer to configure
 // newly attached device.
-// NOTE: due to the shared _usbh_ctrl_buf, we must complete enumerating
-// one device before enumerating another one.
+// Devices are enumerated concurrently, each with its own context and buffer
+// (CFG_TUH_ENUMERATION_MAX). Newly attached devices wait in the attach queue
+// until a context is free. Steps waiting for a delay, address 0 or the control
+// pipe are resumed by enum_process() in tuh_task():
+// - only one device can be at address 0: port reset until SET_ADDRESS is
+//   done by one context at a time (owner of _dev0)
+// - control transfers are still one at a time, contexts take turns
+//   (round-robin) so that their transfers interleave
+// - class drivers are configured one device at a time since they use
+//   usbh_get_enum_buf() and issue their own control transfers
 //--------------------------------------------------------------------+
 
 enum {
   ENUM_RESET_DELAY = 50, // USB specs: 10 to 50ms
   ENUM_CONTACT_DEBOUNCING_DELAY = 450, // when plug/unplug a device, physical connection can be bouncing and may
                                        // generate a series of attach/detach event. This delay wait for stable connection
+  ENUM_CONTACT_DEBOUNCING_SHORT_DELAY = 100, // USB specs: TATTDB minimum. Used when the descriptor cache is enabled,
+                                             // the rest of the full delay is waited for if device is not in the cache
+  ENUM_HUB_RESET_POLL_DELAY = 10, // hub port reset takes 10 to 20ms
+};
+
+// Retry a few times with transfers in enumeration since device can be unstable when starting up
+enum {
+  ENUM_ATTEMPT_COUNT_MAX = 3,
+  ENUM_ATTEMPT_DELAY_MS = 100
 };
 
 enum {
   ENUM_IDLE,
-  ENUM_RESET_1,         // 1st reset when attached
-  //ENUM_HUB_GET_STATUS_1,
-  ENUM_HUB_CLEAR_RESET_1,
+  ENUM_ROOT_RESET,        // roothub: reset port, address 0 is owned from here
+  ENUM_ROOT_CONNECTED,    // roothub: check connection after debouncing
+  ENUM_HUB_RESET,         // hub: reset port after debouncing, address 0 is owned from here
+  ENUM_HUB_GET_STATUS,
+  ENUM_HUB_CLEAR_RESET,
   ENUM_ADDR0_DEVICE_DESC,
-  ENUM_RESET_2,         // 2nd reset before set address (not used)
-  ENUM_HUB_GET_STATUS_2,
-  ENUM_HUB_CLEAR_RESET_2,
   ENUM_SET_ADDR,
-
+  ENUM_ADDRESSED,         // address 0 is released
   ENUM_GET_DEVICE_DESC,
+  ENUM_DEVICE_DESC_DONE,
+  ENUM_GET_SERIAL,        // serial number string for the descriptor cache key
+  ENUM_SERIAL_DONE,
   ENUM_GET_9BYTE_CONFIG_DESC,
+  ENUM_CACHE_LOOKUP,      // configuration descriptor is taken from cache if its first 9 bytes match
   ENUM_GET_FULL_CONFIG_DESC,
+  ENUM_PARSE_CONFIG,
   ENUM_SET_CONFIG,
   ENUM_CONFIG_DRIVER
 };
 
-static bool enum_request_set_addr(void);
+// user_data of enumeration transfers: context index and state on completion
+#define ENUM_USER_DATA(_ctx, _state)  ((((uintptr_t) ((_ctx) - _enum.ctx)) << 8) | (_state))
+
 static bool _parse_configuration_descriptor (uint8_t dev_addr, tusb_desc_configuration_t const* desc_cfg);
-static void enum_full_complete(void);
+static void enum_step(usbh_enum_t* ctx);
+static void enum_full_complete(usbh_enum_t* ctx, bool success);
 
-// process device enumeration
-static void process_enumeration(tuh_xfer_t* xfer) {
-  // Retry a few times with transfers in enumeration since device can be unstable when starting up
-  enum {
-    ATTEMPT_COUNT_MAX = 3,
-    ATTEMPT_DELAY_MS = 100
-  };
-  static uint8_t failed_count = 0;
-
-  if (XFER_RESULT_SUCCESS != xfer->result) {
-    // retry if not reaching max attempt
-    bool retry = _dev0.enumerating && (failed_count < ATTEMPT_COUNT_MAX);
-    if ( retry ) {
-      failed_count++;
-      osal_task_delay(ATTEMPT_DELAY_MS); // delay a bit
-      TU_LOG1("Enumeration attempt %u\r\n", failed_count);
-      retry = tuh_control_xfer(xfer);
-    }
+// Enumeration delays are counted in frames (1ms)
+TU_ATTR_ALWAYS_INLINE static inline uint32_t enum_time_ms(void) {
+  return hcd_frame_number(_usbh_controller);
+}
 
-    if (!retry) {
-      enum_full_complete();
-    }
+TU_ATTR_ALWAYS_INLINE static inline uint8_t enum_index(usbh_enum_t const* ctx) {
+  return (uint8_t) (ctx - _enum.ctx);
+}
 
-    return;
+static void enum_init(void) {
+  tu_memclr(&_enum, sizeof(_enum));
+  _enum.addr0_owner = TUSB_INDEX_INVALID_8;
+  _enum.drv_owner   = TUSB_INDEX_INVALID_8;
+}
+
+static usbh_enum_t* enum_find_daddr(uint8_t daddr) {
+  for (uint8_t i = 0; i < CFG_TUH_ENUMERATION_MAX; i++) {
+    usbh_enum_t* ctx = &_enum.ctx[i];
+    if (ctx->active && ctx->daddr == daddr) return ctx;
   }
-  failed_count = 0;
+  return NULL;
+}
 
-  uint8_t const daddr = xfer->daddr;
-  uintptr_t const state = xfer->user_data;
+uint16_t usbh_desc_cache_load(uint8_t dev_addr, uint8_t desc_type, uint8_t index, uint8_t* buf, uint16_t bufsize) {
+#if CFG_TUH_DESC_CACHE
+  usbh_enum_t const* ctx = enum_find_daddr(dev_addr);
+  if (ctx && tuh_descriptor_cache_load_cb) {
+    uint16_t const len = tuh_descriptor_cache_load_cb(&ctx->cache_key, desc_type, index, buf, bufsize);
+    return (len <= bufsize) ? len : 0;
+  }
+#else
+  (void) dev_addr; (void) desc_type; (void) index; (void) buf; (void) bufsize;
+#endif
+  return 0;
+}
 
-  switch(state)
-  {
-#if CFG_TUH_HUB
-    //case ENUM_HUB_GET_STATUS_1: break;
+void usbh_desc_cache_store(uint8_t dev_addr, uint8_t desc_type, uint8_t index, uint8_t const* desc, uint16_t len) {
+#if CFG_TUH_DESC_CACHE
+  usbh_enum_t const* ctx = enum_find_daddr(dev_addr);
+  if (ctx && tuh_descriptor_cache_store_cb) {
+    tuh_descriptor_cache_store_cb(&ctx->cache_key, desc_type, index, desc, len);
+  }
+#else
+  (void) dev_addr; (void) desc_type; (void) index; (void) desc; (void) len;
+#endif
+}
 
-    case ENUM_HUB_CLEAR_RESET_1:
-    {
-      hub_port_status_response_t port_status;
-      memcpy(&port_status, _usbh_ctrl_buf, sizeof(hub_port_status_response_t));
+void usbh_desc_cache_count(bool hit) {
+#if CFG_TUH_DESC_CACHE
+  if (!tuh_descriptor_cache_load_cb) return;
+  if (hit) {
+    _enum.stats.cache_hit++;
+  } else {
+    _enum.stats.cache_miss++;
+  }
+#else
+  (void) hit;
+#endif
+}
 
-      if ( !port_status.status.connection )
-      {
-        // device unplugged while delaying, nothing else to do
-        enum_full_complete();
-        return;
-      }
+static bool enum_desc_cache_enabled(void) {
+#if CFG_TUH_DESC_CACHE
+  return tuh_descriptor_cache_load_cb != NULL;
+#else
+  return false;
+#endif
+}
 
-      _dev0.speed = (port_status.status.high_speed) ? TUSB_SPEED_HIGH :
-                    (port_status.status.low_speed ) ? TUSB_SPEED_LOW  : TUSB_SPEED_FULL;
+// Attach debounce: short if a device found in the descriptor cache may skip the rest of it
+static uint32_t enum_debounce_ms(usbh_enum_t* ctx) {
+  ctx->debounce_short = enum_desc_cache_enabled();
+  return ctx->debounce_short ? ENUM_CONTACT_DEBOUNCING_SHORT_DELAY : ENUM_CONTACT_DEBOUNCING_DELAY;
+}
 
-      // Acknowledge Port Reset Change
-      if (port_status.change.reset)
-      {
-        hub_port_clear_reset_change(_dev0.hub_addr, _dev0.hub_port, process_enumeration, ENUM_ADDR0_DEVICE_DESC);
-      }
+static bool enum_port_active(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port) {
+  for (uint8_t i = 0; i < CFG_TUH_ENUMERATION_MAX; i++) {
+    usbh_enum_t const* ctx = &_enum.ctx[i];
+    if (ctx->active && ctx->rhport == rhport && ctx->hub_addr == hub_addr && ctx->hub_port == hub_port) return true;
+  }
+  return false;
+}
+
+// Continue with state after ms
+static void enum_delay(usbh_enum_t* ctx, uint8_t state, uint32_t ms) {
+  ctx->state          = state;
+  ctx->delaying       = 1;
+  ctx->delay_start_ms = enum_time_ms();
+  ctx->delay_ms       = ms;
+}
+
+// Take address 0, false (and wait) if another device is there
+static bool enum_addr0_acquire(usbh_enum_t* ctx) {
+  uint8_t const idx = enum_index(ctx);
+  if (_enum.addr0_owner != idx) {
+    if (_enum.addr0_owner != TUSB_INDEX_INVALID_8) {
+      ctx->wait_addr0 = 1;
+      return false;
     }
-    break;
 
-    case ENUM_HUB_GET_STATUS_2:
-      osal_task_delay(ENUM_RESET_DELAY);
-      TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, process_enumeration, ENUM_HUB_CLEAR_RESET_2), );
-    break;
+    _enum.addr0_owner = idx;
+    _dev0.rhport      = ctx->rhport;
+    _dev0.hub_addr    = ctx->hub_addr;
+    _dev0.hub_port    = ctx->hub_port;
+    _dev0.speed       = ctx->speed;
+    _dev0.enumerating = 1;
+  }
+  ctx->wait_addr0 = 0;
+  return true;
+}
 
-    case ENUM_HUB_CLEAR_RESET_2:
-    {
-      hub_port_status_response_t port_status;
-      memcpy(&port_status, _usbh_ctrl_buf, sizeof(hub_port_status_response_t));
+static void enum_addr0_release(usbh_enum_t* ctx) {
+  if (_enum.addr0_owner == enum_index(ctx)) {
+    hcd_device_close(ctx->rhport, 0);
+    _dev0.enumerating = 0;
+    _enum.addr0_owner = TUSB_INDEX_INVALID_8;
+  }
+}
 
-      // Acknowledge Port Reset Change if Reset Successful
-      if (port_status.change.reset)
-      {
-        TU_ASSERT( hub_port_clear_reset_change(_dev0.hub_addr, _dev0.hub_port, process_enumeration, ENUM_SET_ADDR), );
+// Whether ctx can start a control transfer now, otherwise its step is run again when the control pipe is free.
+// Contexts already waiting go first so that transfers of devices interleave.
+static bool enum_ctrl_acquire(usbh_enum_t* ctx) {
+  bool ready = (_ctrl_xfer.stage == CONTROL_STAGE_IDLE) && (_enum.drv_owner == TUSB_INDEX_INVALID_8);
+
+  if (ready && !ctx->wait_ctrl) {
+    for (uint8_t i = 0; i < CFG_TUH_ENUMERATION_MAX; i++) {
+      usbh_enum_t const* other = &_enum.ctx[i];
+      if (other != ctx && other->active && other->wait_ctrl) {
+        ready = false;
+        break;
       }
     }
-    break;
-#endif
+  }
 
-    case ENUM_ADDR0_DEVICE_DESC:
-    {
-      // TODO probably doesn't need to open/close each enumeration
-      uint8_t const addr0 = 0;
-      TU_ASSERT( usbh_edpt_control_open(addr0, 8), );
+  ctx->wait_ctrl = ready ? 0 : 1;
+  return ready;
+}
+
+// Whether a control transfer to daddr can be started while class drivers of a device are being configured
+static bool enum_ctrl_allowed(uint8_t daddr) {
+  return (_enum.drv_owner == TUSB_INDEX_INVALID_8) || (_enum.ctx[_enum.drv_owner].daddr == daddr);
+}
+
+// Keep a control transfer to another device until class drivers of drv_owner are configured. The setup packet is
+// copied, the data buffer must stay valid until the transfer is complete (as for any asynchronous transfer)
+static bool enum_ctrl_queue(tuh_xfer_t const* xfer) {
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  bool const queued = (_enum.ctrl_queue_count < ENUM_CTRL_QUEUE_SZ);
+  if (queued) {
+    usbh_ctrl_queued_t* entry = &_enum.ctrl_queue[_enum.ctrl_queue_count++];
+    entry->xfer  = *xfer;
+    entry->setup = *xfer->setup;
+    entry->xfer.setup = &entry->setup;
+  }
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  TU_LOG_USBH("[%u] Control transfer %s while configuring\r\n", xfer->daddr, queued ? "queued" : "dropped");
+  return queued;
+}
+
+// Start the oldest queued control transfer when the control pipe is free and no class driver is being configured
+static void enum_ctrl_dequeue(void) {
+  if (_enum.ctrl_queue_count == 0 || _enum.drv_owner != TUSB_INDEX_INVALID_8 ||
+      _ctrl_xfer.stage != CONTROL_STAGE_IDLE) {
+    return;
+  }
+
+  (void) osal_mutex_lock(_usbh_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  usbh_ctrl_queued_t entry = _enum.ctrl_queue[0];
+  _enum.ctrl_queue_count--;
+  memmove(&_enum.ctrl_queue[0], &_enum.ctrl_queue[1], _enum.ctrl_queue_count * sizeof(_enum.ctrl_queue[0]));
+  (void) osal_mutex_unlock(_usbh_mutex);
+
+  entry.xfer.setup = &entry.setup;
+  if (!tuh_control_xfer(&entry.xfer)) {
+    // device is gone
+    entry.xfer.result     = XFER_RESULT_FAILED;
+    entry.xfer.actual_len = 0;
+    entry.xfer.complete_cb(&entry.xfer);
+  }
+}
 
-      // Get first 8 bytes of device descriptor for Control Endpoint size
-      TU_LOG_USBH("Get 8 byte of Device Descriptor\r\n");
-      TU_ASSERT(tuh_descriptor_get_device(addr0, _usbh_ctrl_buf, 8, process_enumeration, ENUM_SET_ADDR), );
+// Start a control transfer of the current step, completion continues with next_state
+#define ENUM_XFER(_ctx, _next_state, _submit) \
+  do { \
+    if ( !enum_ctrl_acquire(_ctx) ) return; \
+    (_ctx)->xfer_state = (_ctx)->state; \
+    (_ctx)->xfer_busy  = 1; \
+    uintptr_t const _user_data = ENUM_USER_DATA(_ctx, _next_state); \
+    (void) _user_data; \
+    if ( !(_submit) ) { \
+      (_ctx)->xfer_busy = 0; \
+      enum_full_complete(_ctx, false); \
+    } \
+    return; \
+  } while(0)
+
+// Start enumerating queued devices on free contexts
+static void enum_attach_start(void) {
+  uint8_t i = 0;
+  while (i < _enum.attach_count) {
+    uint8_t const rhport   = _enum.attach[i].rhport;
+    uint8_t const hub_addr = _enum.attach[i].hub_addr;
+    uint8_t const hub_port = _enum.attach[i].hub_port;
+
+    // same port is still enumerating (connection bounced), wait until it completes
+    if (enum_port_active(rhport, hub_addr, hub_port)) {
+      i++;
+      continue;
     }
-    break;
 
-#if 0
-    case ENUM_RESET_2:
-      // TODO not used by now, but may be needed for some devices !?
-      // Reset device again before Set Address
-      TU_LOG_USBH("Port reset2 \r\n");
-      if (_dev0.hub_addr == 0)
-      {
-        // connected directly to roothub
-        hcd_port_reset( _dev0.rhport );
-        osal_task_delay(RESET_DELAY); // TODO may not work for no-OS on MCU that require reset_end() since
-                                      // sof of controller may not running while resetting
-        hcd_port_reset_end(_dev0.rhport);
-        // TODO: fall through to SET ADDRESS, refactor later
-      }
-      #if CFG_TUH_HUB
-      else
-      {
-        // after RESET_DELAY the hub_port_reset() already complete
-        TU_ASSERT( hub_port_reset(_dev0.hub_addr, _dev0.hub_port, process_enumeration, ENUM_HUB_GET_STATUS_2), );
+    usbh_enum_t* ctx = NULL;
+    for (uint8_t c = 0; c < CFG_TUH_ENUMERATION_MAX; c++) {
+      if (!_enum.ctx[c].active) {
+        ctx = &_enum.ctx[c];
         break;
       }
-      #endif
-      TU_ATTR_FALLTHROUGH;
-#endif
+    }
+    if (ctx == NULL) return;
 
-    case ENUM_SET_ADDR:
-      enum_request_set_addr();
-    break;
+    _enum.attach_count--;
+    memmove(&_enum.attach[i], &_enum.attach[i + 1], (_enum.attach_count - i) * sizeof(_enum.attach[0]));
 
-    case ENUM_GET_DEVICE_DESC:
-    {
-      uint8_t const new_addr = (uint8_t) tu_le16toh(xfer->setup->wValue);
+    tu_memclr(ctx, offsetof(usbh_enum_t, buf));
+    ctx->active   = 1;
+    ctx->rhport   = rhport;
+    ctx->hub_addr = hub_addr;
+    ctx->hub_port = hub_port;
 
-      usbh_device_t* new_dev = get_device(new_addr);
-      TU_ASSERT(new_dev, );
-      new_dev->addressed = 1;
-
-      // Close device 0
-      hcd_device_close(_dev0.rhport, 0);
+    uint8_t active_count = 0;
+    for (uint8_t c = 0; c < CFG_TUH_ENUMERATION_MAX; c++) {
+      active_count += _enum.ctx[c].active;
+    }
+    if (active_count > _enum.stats.concurrent_max) _enum.stats.concurrent_max = active_count;
 
-      // open control pipe for new address
-      TU_ASSERT( usbh_edpt_control_open(new_addr, new_dev->ep0_size), );
+    TU_LOG_USBH("[%u:%u:%u] Enumeration started (%u in progress)\r\n", rhport, hub_addr, hub_port, active_count);
 
-      // Get full device descriptor
-      TU_LOG_USBH("Get Device Descriptor\r\n");
-      TU_ASSERT(tuh_descriptor_get_device(new_addr, _usbh_ctrl_buf, sizeof(tusb_desc_device_t), process_enumeration, ENUM_GET_9BYTE_CONFIG_DESC), );
+    if (hub_addr == 0) {
+      ctx->state = ENUM_ROOT_RESET;
+      enum_step(ctx);
+    } else {
+      // wait until device connection is stable, in parallel with other devices
+      enum_delay(ctx, ENUM_HUB_RESET, enum_debounce_ms(ctx));
     }
-    break;
+  }
+}
 
-    case ENUM_GET_9BYTE_CONFIG_DESC:
-    {
-      tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
-      usbh_device_t* dev = get_device(daddr);
-      TU_ASSERT(dev, );
-
-      dev->vid            = desc_device->idVendor;
-      dev->pid            = desc_device->idProduct;
-      dev->i_manufacturer = desc_device->iManufacturer;
-      dev->i_product      = desc_device->iProduct;
-      dev->i_serial       = desc_device->iSerialNumber;
-
-    //  if (tuh_attach_cb) tuh_attach_cb((tusb_desc_device_t*) _usbh_ctrl_buf);
-
-      // Get 9-byte for total length
-      uint8_t const config_idx = CONFIG_NUM - 1;
-      TU_LOG_USBH("Get Configuration[0] Descriptor (9 bytes)\r\n");
-      TU_ASSERT( tuh_descriptor_get_configuration(daddr, config_idx, _usbh_ctrl_buf, 9, process_enumeration, ENUM_GET_FULL_CONFIG_DESC), );
+// Queue a newly attached device
+static void enum_attach(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port) {
+  for (uint8_t i = 0; i < _enum.attach_count; i++) {
+    if (_enum.attach[i].rhport == rhport && _enum.attach[i].hub_addr == hub_addr && _enum.attach[i].hub_port == hub_port) {
+      return; // already queued
     }
-    break;
+  }
+  TU_ASSERT(_enum.attach_count < ENUM_ATTACH_QUEUE_SZ, );
 
-    case ENUM_GET_FULL_CONFIG_DESC:
-    {
-      uint8_t const * desc_config = _usbh_ctrl_buf;
+  _enum.attach[_enum.attach_count].rhport   = rhport;
+  _enum.attach[_enum.attach_count].hub_addr = hub_addr;
+  _enum.attach[_enum.attach_count].hub_port = hub_port;
+  _enum.attach_count++;
 
-      // Use offsetof to avoid pointer to the odd/misaligned address
-      uint16_t const total_len = tu_le16toh( tu_unaligned_read16(desc_config + offsetof(tusb_desc_configuration_t, wTotalLength)) );
+  if (!_enum.attached) {
+    _enum.attached        = true;
+    _enum.first_attach_ms = enum_time_ms();
+  }
 
-      // TODO not enough buffer to hold configuration descriptor
-      TU_ASSERT(total_len <= CFG_TUH_ENUMERATION_BUFSIZE, );
+  enum_attach_start();
+}
 
-      // Get full configuration descriptor
-      uint8_t const config_idx = CONFIG_NUM - 1;
-      TU_LOG_USBH("Get Configuration[0] Descriptor\r\n");
-      TU_ASSERT( tuh_descriptor_get_configuration(daddr, config_idx, _usbh_ctrl_buf, total_len, process_enumeration, ENUM_SET_CONFIG), );
+// Stop enumerating devices under unplugged port (hub_addr = 0: roothub, hub_port = 0: all ports of the hub)
+static void enum_remove(uint8_t rhport, uint8_t hub_addr, uint8_t hub_port) {
+  uint8_t i = 0;
+  while (i < _enum.attach_count) {
+    if (_enum.attach[i].rhport == rhport && (hub_addr == 0 || _enum.attach[i].hub_addr == hub_addr) &&
+        (hub_port == 0 || _enum.attach[i].hub_port == hub_port)) {
+      _enum.attach_count--;
+      memmove(&_enum.attach[i], &_enum.attach[i + 1], (_enum.attach_count - i) * sizeof(_enum.attach[0]));
+    } else {
+      i++;
     }
-    break;
+  }
 
-    case ENUM_SET_CONFIG:
-      // Parse configuration & set up drivers
-      // Driver open aren't allowed to make any usb transfer yet
-      TU_ASSERT( _parse_configuration_descriptor(daddr, (tusb_desc_configuration_t*) _usbh_ctrl_buf), );
+  for (uint8_t c = 0; c < CFG_TUH_ENUMERATION_MAX; c++) {
+    usbh_enum_t* ctx = &_enum.ctx[c];
+    if (ctx->active && ctx->rhport == rhport && (hub_addr == 0 || ctx->hub_addr == hub_addr) &&
+        (hub_port == 0 || ctx->hub_port == hub_port)) {
+      TU_LOG_USBH("[%u:%u:%u] Enumeration aborted\r\n", ctx->rhport, ctx->hub_addr, ctx->hub_port);
+      // abort on-going control xfer if any
+      if (ctx->xfer_busy) _set_control_xfer_stage(CONTROL_STAGE_IDLE);
+      enum_full_complete(ctx, false);
+    }
+  }
+}
 
-      TU_ASSERT( tuh_configuration_set(daddr, CONFIG_NUM, process_enumeration, ENUM_CONFIG_DRIVER), );
-    break;
+// Run steps which can continue: delay elapsed, address 0 or control pipe is free.
+// Return time until the next delay is elapsed (UINT32_MAX if none)
+static uint32_t enum_process(void) {
+  enum_ctrl_dequeue();
+  enum_attach_start();
+
+  uint32_t now = enum_time_ms();
+  for (uint8_t n = 0; n < CFG_TUH_ENUMERATION_MAX; n++) {
+    uint8_t const idx = (uint8_t) ((_enum.rr_next + n) % CFG_TUH_ENUMERATION_MAX);
+    usbh_enum_t* ctx = &_enum.ctx[idx];
+    if (!ctx->active) continue;
+
+    if (ctx->delaying) {
+      if (now - ctx->delay_start_ms < ctx->delay_ms) continue;
+      ctx->delaying = 0;
+      enum_step(ctx);
+      now = enum_time_ms(); // roothub reset is blocking
+    } else if (ctx->wait_addr0) {
+      if (_enum.addr0_owner == TUSB_INDEX_INVALID_8) enum_step(ctx);
+    } else if (ctx->wait_ctrl) {
+      if (_ctrl_xfer.stage == CONTROL_STAGE_IDLE && _enum.drv_owner == TUSB_INDEX_INVALID_8) {
+        _enum.rr_next = (uint8_t) ((idx + 1) % CFG_TUH_ENUMERATION_MAX);
+        enum_step(ctx);
+      }
+    }
+  }
 
-    case ENUM_CONFIG_DRIVER:
-    {
-      TU_LOG_USBH("Device configured\r\n");
-      usbh_device_t* dev = get_device(daddr);
-      TU_ASSERT(dev, );
+  uint32_t wait_ms = UINT32_MAX;
+  for (uint8_t i = 0; i < CFG_TUH_ENUMERATION_MAX; i++) {
+    usbh_enum_t const* ctx = &_enum.ctx[i];
+    if (ctx->active && ctx->delaying) {
+      uint32_t const elapsed = now - ctx->delay_start_ms;
+      wait_ms = tu_min32(wait_ms, (elapsed < ctx->delay_ms) ? (ctx->delay_ms - elapsed) : 0);
+    }
+  }
 
-      dev->configured = 1;
+  return wait_ms;
+}
 
-      // Start the Set Configuration process for interfaces (itf = TUSB_INDEX_INVALID_8)
-      // Since driver can perform control transfer within its set_config, this is done asynchronously.
-      // The process continue with next interface when class driver complete its sequence with usbh_driver_set_config_complete()
-      // TODO use separated API instead of using TUSB_INDEX_INVALID_8
-      usbh_driver_set_config_complete(daddr, TUSB_INDEX_INVALID_8);
+// control transfer of enumeration is complete
+static void process_enumeration(tuh_xfer_t* xfer) {
+  uint8_t const idx = (uint8_t) (xfer->user_data >> 8);
+  TU_ASSERT(idx < CFG_TUH_ENUMERATION_MAX, );
+  usbh_enum_t* ctx = &_enum.ctx[idx];
+
+  // aborted (device unplugged)
+  if (!ctx->active || !ctx->xfer_busy) return;
+  ctx->xfer_busy = 0;
+
+  if (XFER_RESULT_SUCCESS != xfer->result && ctx->xfer_state == ENUM_GET_SERIAL) {
+    // serial number is only part of the cache key: continue without it
+    ctx->buf[0] = 0;
+  } else if (XFER_RESULT_SUCCESS != xfer->result) {
+    // retry if not reaching max attempt, device at address 0 may have been unplugged
+    bool const unplugged = (_enum.addr0_owner == idx) && !_dev0.enumerating;
+    if (!unplugged && ctx->failed_count < ENUM_ATTEMPT_COUNT_MAX) {
+      ctx->failed_count++;
+      TU_LOG1("Enumeration attempt %u\r\n", ctx->failed_count);
+      enum_delay(ctx, ctx->xfer_state, ENUM_ATTEMPT_DELAY_MS);
+    } else {
+      enum_full_complete(ctx, false);
     }
-    break;
-
-    default:
-      // stop enumeration if unknown state
-      enum_full_complete();
-    break;
+    return;
   }
+  ctx->failed_count = 0;
+
+  ctx->state = (uint8_t) (xfer->user_data & 0xff);
+  enum_step(ctx);
 }
 
-static bool enum_new_device(hcd_event_t* event)
-{
-  _dev0.rhport   = event->rhport;
-  _dev0.hub_addr = event->connection.hub_addr;
-  _dev0.hub_port = event->connection.hub_port;
+static bool enum_request_set_addr(usbh_enum_t* ctx, uintptr_t user_data);
 
-  if (_dev0.hub_addr == 0)
-  {
-    // connected/disconnected directly with roothub
-    hcd_port_reset(_dev0.rhport);
-    osal_task_delay(ENUM_RESET_DELAY); // TODO may not work for no-OS on MCU that require reset_end() since
-                                        // sof of controller may not running while resetting
-    hcd_port_reset_end( _dev0.rhport);
-
-    // wait until device connection is stable TODO non blocking
-    osal_task_delay(ENUM_CONTACT_DEBOUNCING_DELAY);
-
-    // device unplugged while delaying
-    if ( !hcd_port_connect_status(_dev0.rhport) ) {
-      enum_full_complete();
-      return true;
-    }
+// Run steps of ctx until it waits for a transfer, a delay, address 0 or the control pipe
+static void enum_step(usbh_enum_t* ctx) {
+  while (1) {
+    switch (ctx->state) {
+      case ENUM_ROOT_RESET:
+        if ( !enum_addr0_acquire(ctx) ) return;
 
-    _dev0.speed = hcd_port_speed_get(_dev0.rhport );
-    TU_LOG_USBH("%s Speed\r\n", tu_str_speed[_dev0.speed]);
+        // connected/disconnected directly with roothub
+        hcd_port_reset(ctx->rhport);
+        osal_task_delay(ENUM_RESET_DELAY); // TODO may not work for no-OS on MCU that require reset_end() since
+                                           // sof of controller may not running while resetting
+        hcd_port_reset_end(ctx->rhport);
 
-    // fake transfer to kick-off the enumeration process
-    tuh_xfer_t xfer;
-    xfer.daddr     = 0;
-    xfer.result    = XFER_RESULT_SUCCESS;
-    xfer.user_data = ENUM_ADDR0_DEVICE_DESC;
+        // wait until device connection is stable
+        enum_delay(ctx, ENUM_ROOT_CONNECTED, enum_debounce_ms(ctx));
+        return;
+
+      case ENUM_ROOT_CONNECTED:
+        // device unplugged while delaying
+        if ( !hcd_port_connect_status(ctx->rhport) ) {
+          enum_full_complete(ctx, false);
+          return;
+        }
+
+        ctx->speed = _dev0.speed = hcd_port_speed_get(ctx->rhport);
+        TU_LOG_USBH("%s Speed\r\n", tu_str_speed[ctx->speed]);
+        ctx->state = ENUM_ADDR0_DEVICE_DESC;
+      break;
 
-    process_enumeration(&xfer);
-  }
 #if CFG_TUH_HUB
-  else
-  {
-    // connected/disconnected via external hub
-    // wait until device connection is stable TODO non blocking
-    osal_task_delay(ENUM_CONTACT_DEBOUNCING_DELAY);
+      case ENUM_HUB_RESET:
+        // connected via external hub: reset port once no other device is at address 0
+        if ( !enum_addr0_acquire(ctx) ) return;
+        ENUM_XFER(ctx, ENUM_HUB_GET_STATUS,
+                  hub_port_reset(ctx->hub_addr, ctx->hub_port, process_enumeration, _user_data));
+
+      case ENUM_HUB_GET_STATUS:
+        ENUM_XFER(ctx, ENUM_HUB_CLEAR_RESET,
+                  hub_port_get_status(ctx->hub_addr, ctx->hub_port, ctx->buf, process_enumeration, _user_data));
+
+      case ENUM_HUB_CLEAR_RESET: {
+        hub_port_status_response_t port_status;
+        memcpy(&port_status, ctx->buf, sizeof(hub_port_status_response_t));
+
+        if ( !port_status.status.connection ) {
+          // device unplugged while delaying, nothing else to do
+          enum_full_complete(ctx, false);
+          return;
+        }
 
-    // ENUM_HUB_GET_STATUS
-    //TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, enum_hub_get_status0_complete, 0) );
-    TU_ASSERT( hub_port_get_status(_dev0.hub_addr, _dev0.hub_port, _usbh_ctrl_buf, process_enumeration, ENUM_HUB_CLEAR_RESET_1) );
-  }
-#endif // hub
+        if ( port_status.status.reset ) {
+          // reset is still in progress
+          enum_delay(ctx, ENUM_HUB_GET_STATUS, ENUM_HUB_RESET_POLL_DELAY);
+          return;
+        }
 
-  return true;
+        ctx->speed = _dev0.speed = (port_status.status.high_speed) ? TUSB_SPEED_HIGH :
+                                   (port_status.status.low_speed ) ? TUSB_SPEED_LOW  : TUSB_SPEED_FULL;
+
+        // Acknowledge Port Reset Change (hub driver may already have done it when polling the status endpoint)
+        if ( port_status.change.reset ) {
+          ENUM_XFER(ctx, ENUM_ADDR0_DEVICE_DESC,
+                    hub_port_clear_reset_change(ctx->hub_addr, ctx->hub_port, process_enumeration, _user_data));
+        }
+        ctx->state = ENUM_ADDR0_DEVICE_DESC;
+      }
+      break;
+#endif
+
+      case ENUM_ADDR0_DEVICE_DESC:
+        // TODO probably doesn't need to open/close each enumeration
+        TU_ASSERT( usbh_edpt_control_open(0, 8), );
+
+        // Get first 8 bytes of device descriptor for Control Endpoint size
+        TU_LOG_USBH("Get 8 byte of Device Descriptor\r\n");
+        ENUM_XFER(ctx, ENUM_SET_ADDR,
+                  tuh_descriptor_get_device(0, ctx->buf, 8, process_enumeration, _user_data));
+
+      case ENUM_SET_ADDR:
+        ENUM_XFER(ctx, ENUM_ADDRESSED, enum_request_set_addr(ctx, _user_data));
+
+      case ENUM_ADDRESSED: {
+        usbh_device_t* new_dev = get_device(ctx->daddr);
+        TU_ASSERT(new_dev, );
+        new_dev->addressed = 1;
+
+        // Close device 0, next device can be reset
+        enum_addr0_release(ctx);
+
+        // open control pipe for new address
+        TU_ASSERT( usbh_edpt_control_open(ctx->daddr, new_dev->ep0_size), );
+        ctx->state = ENUM_GET_DEVICE_DESC;
+      }
+      break;
+
+      case ENUM_GET_DEVICE_DESC:
+        // Get full device descriptor
+        TU_LOG_USBH("Get Device Descriptor\r\n");
+        ENUM_XFER(ctx, ENUM_DEVICE_DESC_DONE,
+                  tuh_descriptor_get_device(ctx->daddr, ctx->buf, sizeof(tusb_desc_device_t), process_enumeration, _user_data));
+
+      case ENUM_DEVICE_DESC_DONE: {
+        memcpy(&ctx->cache_key.desc_device, ctx->buf, sizeof(tusb_desc_device_t));
+        tusb_desc_device_t const * desc_device = &ctx->cache_key.desc_device;
+        usbh_device_t* dev = get_device(ctx->daddr);
+        TU_ASSERT(dev, );
+
+        dev->vid            = desc_device->idVendor;
+        dev->pid            = desc_device->idProduct;
+        dev->i_manufacturer = desc_device->iManufacturer;
+        dev->i_product      = desc_device->iProduct;
+        dev->i_serial       = desc_device->iSerialNumber;
+
+      //  if (tuh_attach_cb) tuh_attach_cb((tusb_desc_device_t*) ctx->buf);
+
+        ctx->state = ENUM_GET_SERIAL;
+      }
+      break;
+
+      case ENUM_GET_SERIAL:
+        // two units of the same model differ only in their serial number
+        if ( !enum_desc_cache_enabled() || !ctx->cache_key.desc_device.iSerialNumber ) {
+          ctx->state = ENUM_GET_9BYTE_CONFIG_DESC;
+          break;
+        }
+        TU_LOG_USBH("Get Serial Number String\r\n");
+        ENUM_XFER(ctx, ENUM_SERIAL_DONE,
+                  tuh_descriptor_get_serial_string(ctx->daddr, 0x0409, ctx->buf, 2 + sizeof(ctx->cache_key.serial),
+                                                   process_enumeration, _user_data));
+
+      case ENUM_SERIAL_DONE: {
+        // buf[0] is 0 if the string could not be read
+        uint8_t const desc_len = tu_min8(ctx->buf[0], (uint8_t) (2 + sizeof(ctx->cache_key.serial)));
+        if ( desc_len > 2 && ctx->buf[1] == TUSB_DESC_STRING ) {
+          memcpy(ctx->cache_key.serial, ctx->buf + 2, (desc_len - 2) & ~1u);
+        }
+        ctx->state = ENUM_GET_9BYTE_CONFIG_DESC;
+      }
+      break;
+
+      case ENUM_GET_9BYTE_CONFIG_DESC:
+        // Get 9-byte for total length, also the validity check of a cached configuration descriptor
+        TU_LOG_USBH("Get Configuration[0] Descriptor (9 bytes)\r\n");
+        ENUM_XFER(ctx, ENUM_CACHE_LOOKUP,
+                  tuh_descriptor_get_configuration(ctx->daddr, CONFIG_NUM - 1, ctx->buf, 9, process_enumeration, _user_data));
+
+      case ENUM_CACHE_LOOKUP: {
+        // Configuration descriptor stored for the same device descriptor and serial number
+        uint8_t desc_9byte[9];
+        memcpy(desc_9byte, ctx->buf, sizeof(desc_9byte));
+        uint16_t const total_len = tu_le16toh(tu_unaligned_read16(desc_9byte + offsetof(tusb_desc_configuration_t, wTotalLength)));
+
+        uint16_t const cached_len = usbh_desc_cache_load(ctx->daddr, TUSB_DESC_CONFIGURATION, CONFIG_NUM - 1,
+                                                         ctx->buf, CFG_TUH_ENUMERATION_BUFSIZE);
+        ctx->cached = (cached_len == total_len) && (cached_len >= sizeof(desc_9byte)) &&
+                      (0 == memcmp(ctx->buf, desc_9byte, sizeof(desc_9byte)));
+        usbh_desc_cache_count(ctx->cached);
+        if (ctx->cached) {
+          TU_LOG_USBH("Configuration[0] Descriptor from cache\r\n");
+          ctx->state = ENUM_PARSE_CONFIG;
+          break;
+        }
+
+        memcpy(ctx->buf, desc_9byte, sizeof(desc_9byte));
+        if (ctx->debounce_short) {
+          // unknown device: complete the attach debounce before going on
+          enum_delay(ctx, ENUM_GET_FULL_CONFIG_DESC, ENUM_CONTACT_DEBOUNCING_DELAY - ENUM_CONTACT_DEBOUNCING_SHORT_DELAY);
+          return;
+        }
+        ctx->state = ENUM_GET_FULL_CONFIG_DESC;
+      }
+      break;
+
+      case ENUM_GET_FULL_CONFIG_DESC: {
+        // Use offsetof to avoid pointer to the odd/misaligned address
+        uint16_t const total_len = tu_le16toh( tu_unaligned_read16(ctx->buf + offsetof(tusb_desc_configuration_t, wTotalLength)) );
+
+        // TODO not enough buffer to hold configuration descriptor
+        if (total_len > CFG_TUH_ENUMERATION_BUFSIZE) {
+          TU_LOG1("Configuration descriptor (%u bytes) exceeds CFG_TUH_ENUMERATION_BUFSIZE\r\n", total_len);
+          enum_full_complete(ctx, false);
+          return;
+        }
+
+        // Get full configuration descriptor
+        TU_LOG_USBH("Get Configuration[0] Descriptor\r\n");
+        ENUM_XFER(ctx, ENUM_PARSE_CONFIG,
+                  tuh_descriptor_get_configuration(ctx->daddr, CONFIG_NUM - 1, ctx->buf, total_len, process_enumeration, _user_data));
+      }
+
+      case ENUM_PARSE_CONFIG:
+        // Parse configuration & set up drivers
+        // Driver open aren't allowed to make any usb transfer yet
+        if ( !_parse_configuration_descriptor(ctx->daddr, (tusb_desc_configuration_t*) ctx->buf) ) {
+          enum_full_complete(ctx, false);
+          return;
+        }
+
+        if ( !ctx->cached ) {
+          uint16_t const total_len = tu_le16toh( tu_unaligned_read16(ctx->buf + offsetof(tusb_desc_configuration_t, wTotalLength)) );
+          usbh_desc_cache_store(ctx->daddr, TUSB_DESC_CONFIGURATION, CONFIG_NUM - 1, ctx->buf, total_len);
+        }
+        ctx->state = ENUM_SET_CONFIG;
+      break;
+
+      case ENUM_SET_CONFIG:
+        ENUM_XFER(ctx, ENUM_CONFIG_DRIVER,
+                  tuh_configuration_set(ctx->daddr, CONFIG_NUM, process_enumeration, _user_data));
+
+      case ENUM_CONFIG_DRIVER: {
+        // class drivers issue control transfers and use usbh_get_enum_buf(): one device at a time
+        if ( !enum_ctrl_acquire(ctx) ) return;
+        _enum.drv_owner = enum_index(ctx);
+
+        TU_LOG_USBH("Device configured\r\n");
+        usbh_device_t* dev = get_device(ctx->daddr);
+        TU_ASSERT(dev, );
+
+        dev->configured = 1;
+
+        // Start the Set Configuration process for interfaces (itf = TUSB_INDEX_INVALID_8)
+        // Since driver can perform control transfer within its set_config, this is done asynchronously.
+        // The process continue with next interface when class driver complete its sequence with usbh_driver_set_config_complete()
+        // TODO use separated API instead of using TUSB_INDEX_INVALID_8
+        usbh_driver_set_config_complete(ctx->daddr, TUSB_INDEX_INVALID_8);
+      }
+      return;
+
+      default:
+        // stop enumeration if unknown state
+        enum_full_complete(ctx, false);
+      return;
+    }
+  }
 }
 
 static uint8_t get_new_address(bool is_hub) {
@@ -1604,22 +2107,25 @@ static uint8_t get_new_address(bool is_hub) {
   return 0; // invalid address
 }
 
-static bool enum_request_set_addr(void)
+static bool enum_request_set_addr(usbh_enum_t* ctx, uintptr_t user_data)
 {
-  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) _usbh_ctrl_buf;
+  tusb_desc_device_t const * desc_device = (tusb_desc_device_t const*) ctx->buf;
 
-  // Get new address
-  uint8_t const new_addr = get_new_address(desc_device->bDeviceClass == TUSB_CLASS_HUB);
-  TU_ASSERT(new_addr != 0);
+  // Get new address (kept when retried)
+  if (ctx->daddr == 0) {
+    ctx->daddr = get_new_address(desc_device->bDeviceClass == TUSB_CLASS_HUB);
+    TU_ASSERT(ctx->daddr != 0);
+  }
+  uint8_t const new_addr = ctx->daddr;
 
   TU_LOG_USBH("Set Address = %d\r\n", new_addr);
 
   usbh_device_t* new_dev = get_device(new_addr);
 
-  new_dev->rhport    = _dev0.rhport;
-  new_dev->hub_addr  = _dev0.hub_addr;
-  new_dev->hub_port  = _dev0.hub_port;
-  new_dev->speed     = _dev0.speed;
+  new_dev->rhport    = ctx->rhport;
+  new_dev->hub_addr  = ctx->hub_addr;
+  new_dev->hub_port  = ctx->hub_port;
+  new_dev->speed     = ctx->speed;
   new_dev->connected = 1;
   new_dev->ep0_size  = desc_device->bMaxPacketSize0;
 
@@ -1644,7 +2150,7 @@ static bool enum_request_set_addr(void)
     .setup       = &request,
     .buffer      = NULL,
     .complete_cb = process_enumeration,
-    .user_data   = ENUM_GET_DEVICE_DESC
+    .user_data   = user_data
   };
 
   TU_ASSERT( tuh_control_xfer(&xfer) );
@@ -1767,7 +2273,8 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num) {
 
   // all interface are configured
   if (itf_num == CFG_TUH_INTERFACE_MAX) {
-    enum_full_complete();
+    usbh_enum_t* ctx = enum_find_daddr(dev_addr);
+    if (ctx) enum_full_complete(ctx, true);
 
     if (is_hub_addr(dev_addr)) {
       TU_LOG_USBH("HUB address = %u is mounted\r\n", dev_addr);
@@ -1778,15 +2285,25 @@ void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num) {
   }
 }
 
-static void enum_full_complete(void) {
+static void enum_full_complete(usbh_enum_t* ctx, bool success) {
+  TU_LOG_USBH("[%u:%u:%u] Enumeration %s\r\n", ctx->rhport, ctx->hub_addr, ctx->hub_port, success ? "complete" : "failed");
+
   // mark enumeration as complete
-  _dev0.enumerating = 0;
+  enum_addr0_release(ctx);
+  if (_enum.drv_owner == enum_index(ctx)) _enum.drv_owner = TUSB_INDEX_INVALID_8;
 
-#if CFG_TUH_HUB
-  // get next hub status
-  if (_dev0.hub_addr) hub_edpt_status_xfer(_dev0.hub_addr);
-#endif
+  if (success) {
+    _enum.stats.devices++;
+    _enum.stats.bringup_ms = enum_time_ms() - _enum.first_attach_ms;
+  } else {
+    _enum.stats.failed++;
+  }
 
+  ctx->active     = 0;
+  ctx->delaying   = 0;
+  ctx->wait_addr0 = 0;
+  ctx->wait_ctrl  = 0;
+  ctx->xfer_busy  = 0;
 }
 
 #endif
@@ -75,9 +75,71 @@ typedef struct {
 
 // ConfigID for tuh_config()
 enum {
-  TUH_CFGID_RPI_PIO_USB_CONFIGURATION = OPT_MCU_RP2040 << 8 // cfg_param: pio_usb_configuration_t
+  TUH_CFGID_RPI_PIO_USB_CONFIGURATION = OPT_MCU_RP2040 << 8, // cfg_param: pio_usb_configuration_t
+  TUH_CFGID_MAX3421 = 200 << 8                               // cfg_param: tuh_configure_max3421_t
 };
 
+// NAK retry policy for MAX3421E
+enum {
+  TUH_MAX3421_NAK_RETRY_IMMEDIATE = 0, // retry at once
+  TUH_MAX3421_NAK_RETRY_NEXT_FRAME,    // retry in next frame, other endpoints can use the bus meanwhile
+  TUH_MAX3421_NAK_RETRY_BOUNDED,       // retry in next frame, transfer fails (timeout) after nak_limit NAKs or nak_timeout_ms
+};
+
+typedef struct {
+  uint8_t nak_policy_control; // TUH_MAX3421_NAK_RETRY_*
+  uint8_t nak_policy_bulk;    // also interrupt OUT. Interrupt IN is always retried when bInterval is due
+  uint16_t nak_limit;         // 0 is no limit
+  uint16_t nak_timeout_ms;    // 0 is no timeout
+} tuh_configure_max3421_t;
+
+// Asynchronous SPI transaction for MAX3421E (tuh_max3421_spi_submit_api): one chip-select window of a command byte
+// followed by data
+typedef struct tuh_max3421_spi_xact_s tuh_max3421_spi_xact_t;
+typedef void (*tuh_max3421_spi_complete_cb_t)(uint8_t rhport, tuh_max3421_spi_xact_t* xact, bool success);
+
+struct tuh_max3421_spi_xact_s {
+  uint8_t cmd;           // command byte
+  uint8_t status;        // HIRQ clocked in while sending cmd (full duplex)
+  uint16_t len;          // data bytes following cmd
+  uint8_t const* tx_buf; // data to write, NULL to read
+  uint8_t* rx_buf;       // buffer for read data, NULL to write
+  tuh_max3421_spi_complete_cb_t complete_cb; // invoked by backend in thread mode (not ISR) when done
+};
+
+// Completed transfers per class driver, index of tuh_xfer_stats_t.count[]
+enum {
+  TUH_XFER_STATS_CONTROL = 0, // control transfers incl. enumeration (all stages count as one)
+  TUH_XFER_STATS_CDC,
+  TUH_XFER_STATS_MSC,
+  TUH_XFER_STATS_HID,
+  TUH_XFER_STATS_HUB,
+  TUH_XFER_STATS_VENDOR,
+  TUH_XFER_STATS_APP,         // application drivers and tuh_edpt_xfer() with complete callback
+  TUH_XFER_STATS_NUM
+};
+
+typedef struct {
+  uint32_t count[TUH_XFER_STATS_NUM];
+} tuh_xfer_stats_t;
+
+// Enumeration statistics
+typedef struct {
+  uint16_t devices;        // devices enumerated successfully
+  uint16_t failed;         // enumerations failed or aborted (device unplugged)
+  uint8_t  concurrent_max; // maximum number of devices enumerated at the same time
+  uint32_t bringup_ms;     // from first attach to the last completed enumeration
+  uint16_t cache_hit;      // descriptors taken from tuh_descriptor_cache_load_cb() instead of the bus
+  uint16_t cache_miss;     // descriptors not found in the cache (or not valid), read from the bus instead
+} tuh_enum_stats_t;
+
+// Key of descriptor cache entries: device descriptor and serial number string (UTF-16, zero padded, all zero if
+// the device has none), so that two units of the same model have their own entries. Compare with memcmp()
+typedef struct {
+  tusb_desc_device_t desc_device;
+  uint16_t serial[CFG_TUH_DESC_CACHE_SERIAL_MAX];
+} tuh_desc_cache_key_t;
+
 //--------------------------------------------------------------------+
 // APPLICATION CALLBACK
 //--------------------------------------------------------------------+
@@ -93,6 +155,19 @@ TU_ATTR_WEAK void tuh_mount_cb (uint8_t daddr);
 // Invoked when a device is unmounted (detached)
 TU_ATTR_WEAK void tuh_umount_cb(uint8_t daddr);
 
+// Invoked during enumeration to look up a descriptor stored by tuh_descriptor_cache_store_cb() for the
+// same device. key holds the device descriptor and serial number just read from the device, the entry is
+// only valid if it was stored with an identical key.
+// desc_type is TUSB_DESC_CONFIGURATION (index = configuration index) or HID_DESC_TYPE_REPORT (index = interface).
+// The configuration descriptor is only used if its first 9 bytes match the ones read from the device.
+// Return length copied to buf, 0 if not cached. Requires CFG_TUH_DESC_CACHE
+TU_ATTR_WEAK uint16_t tuh_descriptor_cache_load_cb(tuh_desc_cache_key_t const* key, uint8_t desc_type,
+                                                   uint8_t index, uint8_t* buf, uint16_t bufsize);
+
+// Invoked when a descriptor was read from the device and can be cached for the next enumeration
+TU_ATTR_WEAK void tuh_descriptor_cache_store_cb(tuh_desc_cache_key_t const* key, uint8_t desc_type,
+                                                uint8_t index, uint8_t const* desc, uint16_t len);
+
 // Invoked when there is a new usb event, which need to be processed by tuh_task()/tuh_task_ext()
 void tuh_event_hook_cb(uint8_t rhport, uint32_t eventid, bool in_isr);
 
@@ -176,8 +251,9 @@ bool tuh_ready(uint8_t daddr) {
 //--------------------------------------------------------------------+
 
 // Submit a control transfer
-//  - async: complete callback invoked when finished.
-//  - sync : blocking if complete callback is NULL.
+//  - async: complete callback invoked when finished. While class drivers of another device are being configured, it
+//           is queued and started after them
+//  - sync : blocking if complete callback is NULL. Fails while class drivers of another device are being configured
 bool tuh_control_xfer(tuh_xfer_t* xfer);
 
 // Submit a bulk/interrupt transfer
@@ -205,6 +281,18 @@ bool tuh_configuration_set(uint8_t daddr, uint8_t config_num,
 bool tuh_interface_set(uint8_t daddr, uint8_t itf_num, uint8_t itf_alt,
                        tuh_xfer_cb_t complete_cb, uintptr_t user_data);
 
+// Get number of completed transfers (any result) per class driver since init or last reset
+void tuh_xfer_stats_get(tuh_xfer_stats_t* stats);
+
+// Reset transfer statistics
+void tuh_xfer_stats_reset(void);
+
+// Get enumeration statistics since init or last reset
+void tuh_enum_stats_get(tuh_enum_stats_t* stats);
+
+// Reset enumeration statistics, bring-up time is counted from the next attach
+void tuh_enum_stats_reset(void);
+
 //--------------------------------------------------------------------+
 // Descriptors Asynchronous (non-blocking)
 //--------------------------------------------------------------------+
@@ -79,6 +79,11 @@ uint8_t usbh_get_rhport(uint8_t dev_addr);
 
 uint8_t* usbh_get_enum_buf(void);
 
+// Descriptor cache of the device being enumerated (tuh_descriptor_cache_load_cb/store_cb), 0 if not cached
+uint16_t usbh_desc_cache_load(uint8_t dev_addr, uint8_t desc_type, uint8_t index, uint8_t* buf, uint16_t bufsize);
+void usbh_desc_cache_store(uint8_t dev_addr, uint8_t desc_type, uint8_t index, uint8_t const* desc, uint16_t len);
+void usbh_desc_cache_count(bool hit); // statistics of a lookup, hit if the cached descriptor is used
+
 void usbh_int_set(bool enabled);
 
 void usbh_defer_func(osal_task_func_t func, void *param, bool in_isr);
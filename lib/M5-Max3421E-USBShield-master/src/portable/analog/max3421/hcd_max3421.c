@@ -35,6 +35,7 @@
 
 #include <stdatomic.h>
 #include "host/hcd.h"
+#include "host/usbh.h"
 
 //--------------------------------------------------------------------+
 //
@@ -167,10 +168,30 @@ enum {
   HRSL_BABBLE,
 };
 
+enum {
+  SCHED_NONE = 0xff
+};
+
+// device addresses that can have endpoints (devices and hubs), starting from 1
+#define MAX3421_DADDR_MAX (CFG_TUH_DEVICE_MAX + CFG_TUH_HUB)
+
+// hcd_frame_number() reads of the lazy frame before it waits for a concurrent update
+#define FRAME_READ_RETRY 4
+
 enum {
   DEFAULT_HIEN = HIRQ_CONDET_IRQ | HIRQ_FRAME_IRQ | HIRQ_HXFRDN_IRQ | HIRQ_RCVDAV_IRQ
 };
 
+// Shadow registers: write-mostly registers whose last written value is kept, redundant writes are skipped
+enum {
+  SHADOW_HIEN = 0,
+  SHADOW_MODE,
+  SHADOW_PERADDR,
+  SHADOW_HCTL,
+  SHADOW_PINCTL,
+  SHADOW_NUM
+};
+
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
@@ -185,6 +206,8 @@ typedef struct {
     uint8_t data_toggle   : 1;
     uint8_t xfer_pending  : 1;
     uint8_t xfer_complete : 1;
+    uint8_t in_sched      : 1; // in the due-time ordered list, waiting for next interval
+    uint8_t snd_single    : 1; // OUT was NAKed in this transfer, SNDFIFO is no longer double buffered
   };
 
   struct TU_ATTR_PACKED {
@@ -194,25 +217,94 @@ typedef struct {
 
   uint16_t total_len;
   uint16_t xferred_len;
+
+  // interrupt IN scheduling
+  uint8_t interval;    // polling interval in frames (bInterval), 0 is not scheduled by interval
+  uint8_t sched_link;  // next endpoint index in the due-time ordered list
+  uint16_t poll_frame; // frame number of last poll (or NAK deferral)
+
   uint8_t* buf;
+
+  // NAK retry
+  uint16_t nak_count;  // NAKs in current transfer
+  uint16_t xfer_frame; // frame number when current transfer is queued
+  uint32_t nak_total;  // statistics
 } max3421_ep_t;
 
-TU_VERIFY_STATIC(sizeof(max3421_ep_t) == 12, "size is not correct");
+// buf is 8-byte aligned on 64-bit native build
+TU_VERIFY_STATIC(sizeof(max3421_ep_t) == (sizeof(void*) == 4 ? 24 : 32), "size is not correct");
+TU_VERIFY_STATIC(CFG_TUH_MAX3421_ENDPOINT_TOTAL <= 255, "endpoint index must fit in uint8_t");
+
+// State of an interrupt pass, kept while a RCVFIFO read is in flight on the asynchronous SPI backend
+typedef struct {
+  max3421_ep_t* ep; // endpoint of RCVDAV
+  uint8_t hirq;     // pending IRQs
+  uint8_t ack;      // IRQs to ack with the next HIRQ write
+  uint8_t hrsl;
+  uint8_t xact_len; // bytes of current RCVFIFO read
+  bool hxfrdn_acked;
+  bool hrsl_valid;
+  bool rcvdav;      // RCVDAV of ep is being serviced
+} int_pass_t;
 
 typedef struct {
   // cached register
-  uint8_t sndbc;
   uint8_t hirq;
   uint8_t hien;
   uint8_t mode;
   uint8_t peraddr;
   uint8_t hxfr;
+  uint8_t hctl;   // current data toggle of the chip (RCVTOG/SNDTOG bits), 0 is unknown
+  uint8_t pinctl;
+  uint8_t shadow_valid; // bitmap of SHADOW_*
 
   atomic_flag busy; // busy transferring
   volatile uint16_t frame_count;
 
+  // interrupt IN endpoints waiting for their interval, ordered by due frame. Only modified by owner of busy
+  uint8_t sched_head;
+  volatile bool sched_kick; // transfer is queued while busy, check pending endpoints on next frame
+
+  // lazy frame: frame_count is advanced by the timer backend between SOFs, see frame_advance()
+  bool lazy_frame;
+  bool frame_tick;     // frame advanced when the session began, scheduler runs in the next interrupt pass
+  bool wake_armed;
+  uint16_t wake_frame; // frame of the requested wakeup
+  uint32_t frame_us;   // start time of frame_count
+  volatile uint16_t frame_seq; // incremented before and after frame_count and frame_us are updated together
+
+  // OUT endpoint deferred after NAK, its packet is still loaded in SNDFIFO. Other OUT transfers wait until it is sent
+  uint8_t sndfifo_parked;
+
+  // SNDFIFO is double buffered: packets committed by SNDBC and not accepted yet, oldest first. The next packet of an
+  // OUT transfer is loaded while the current one is on the wire
+  uint8_t snd_count;
+  uint8_t snd_len[2];
+  bool snd_rewind; // OUT was NAKed, SNDFIFO must be rewound (SNDBC = 0) before it is loaded again
+
+  // statistics: SPI transactions (chip-select windows), USB transactions (HXFRDN) and interrupt handler calls
+  struct {
+    uint32_t spi_xact;
+    uint32_t usb_xact;
+    uint32_t int_count;
+    uint32_t reg_written[SHADOW_NUM]; // SPI writes of shadow registers
+    uint32_t reg_skipped[SHADOW_NUM]; // redundant writes skipped
+  } stats;
+
   max3421_ep_t ep[CFG_TUH_MAX3421_ENDPOINT_TOTAL]; // [0] is reserved for addr0
 
+  // index into ep[] by [daddr-1][ep_num][dir], 0 is not opened. Control endpoint is registered in both directions
+  uint8_t ep_index[MAX3421_DADDR_MAX][16][2];
+
+  // SPI bus session, see max3421_session_begin(). Only modified by the owner
+  void* volatile session_owner;
+  uint8_t session_depth;
+
+  // RCVFIFO read in flight on the asynchronous SPI backend: INT is kept disabled and the pass is resumed on completion
+  volatile bool spi_async_pending;
+  tuh_max3421_spi_xact_t spi_xact;
+  int_pass_t pass;
+
   OSAL_MUTEX_DEF(spi_mutexdef);
 #if OSAL_MUTEX_REQUIRED
   osal_mutex_t spi_mutex;
@@ -221,6 +313,14 @@ typedef struct {
 
 static max3421_data_t _hcd_data;
 
+// kept across hcd_init() since tuh_configure() is called before tuh_init()
+static tuh_configure_max3421_t _tuh_cfg = {
+  .nak_policy_control = CFG_TUH_MAX3421_NAK_POLICY_CONTROL,
+  .nak_policy_bulk    = CFG_TUH_MAX3421_NAK_POLICY_BULK,
+  .nak_limit          = CFG_TUH_MAX3421_NAK_LIMIT,
+  .nak_timeout_ms     = CFG_TUH_MAX3421_NAK_TIMEOUT_MS,
+};
+
 //--------------------------------------------------------------------+
 // API: SPI transfer with MAX3421E
 // - spi_cs_api(), spi_xfer_api(), int_api(): must be implemented by application
@@ -237,12 +337,45 @@ extern bool tuh_max3421_spi_xfer_api(uint8_t rhport, uint8_t const* tx_buf, uint
 // API to enable/disable MAX3421 INTR pin interrupt
 extern void tuh_max3421_int_api(uint8_t rhport, bool enabled);
 
+// API to submit an asynchronous SPI transaction (optional, weak). Return false if not supported or queue is full,
+// driver then does the transfer synchronously. complete_cb must be invoked in thread mode when done
+bool tuh_max3421_spi_submit_api(uint8_t rhport, tuh_max3421_spi_xact_t* xact);
+
+// API to check if an asynchronous RCVFIFO read is in flight: interrupt handler returns at once until it completes
+// and resumes the interrupt pass. Implemented by TinyUSB
+bool tuh_max3421_spi_async_pending(uint8_t rhport);
+
 // API to read MAX3421's register. Implemented by TinyUSB
 uint8_t tuh_max3421_reg_read(uint8_t rhport, uint8_t reg, bool in_isr);
 
 // API to write MAX3421's register. Implemented by TinyUSB
 bool tuh_max3421_reg_write(uint8_t rhport, uint8_t reg, uint8_t data, bool in_isr);
 
+// API to get number of SPI transactions and USB transactions (packets incl. NAK) since init. Implemented by TinyUSB
+void tuh_max3421_spi_stats(uint8_t rhport, uint32_t* spi_xact, uint32_t* usb_xact);
+
+// API to get number of writes and skipped (redundant) writes of a shadow register: HIEN, MODE, PERADDR, HCTL, PINCTL.
+// Return false if reg is not a shadow register. Implemented by TinyUSB
+bool tuh_max3421_reg_stats(uint8_t rhport, uint8_t reg, uint32_t* write_count, uint32_t* skip_count);
+
+// API to get number of NAKs received on an opened endpoint. Return false if not opened. Implemented by TinyUSB
+bool tuh_max3421_nak_stats(uint8_t rhport, uint8_t daddr, uint8_t ep_addr, uint32_t* nak_count);
+
+// API to get number of interrupt handler calls since init. Implemented by TinyUSB
+uint32_t tuh_max3421_int_stats(uint8_t rhport);
+
+// API to reset all statistics above (SPI, USB, shadow register, NAK and interrupt). Implemented by TinyUSB
+void tuh_max3421_stats_reset(uint8_t rhport);
+
+// API to get a free running microsecond timer (optional, weak). Return false if not supported
+bool tuh_max3421_time_us_api(uint8_t rhport, uint32_t* time_us);
+
+// API to invoke hcd_int_handler() in thread mode after delay_us, replacing the previous request. 0 cancels the request
+// (optional, weak). Return false if not supported.
+// With both timer APIs, frame number is derived from the time between SOFs and FRAME_IRQ is only enabled while the
+// scheduler waits for the next frame, longer waits (e.g interrupt IN interval) are timed by this wakeup
+bool tuh_max3421_wakeup_api(uint8_t rhport, uint32_t delay_us);
+
 //--------------------------------------------------------------------+
 // SPI Commands and Helper
 //--------------------------------------------------------------------+
@@ -250,26 +383,144 @@ bool tuh_max3421_reg_write(uint8_t rhport, uint8_t reg, uint8_t data, bool in_is
 #define reg_read  tuh_max3421_reg_read
 #define reg_write tuh_max3421_reg_write
 
-static void max3421_spi_lock(uint8_t rhport, bool in_isr) {
-  // disable interrupt and mutex lock (for pre-emptive RTOS) if not in_isr
-  if (!in_isr) {
-    (void) osal_mutex_lock(_hcd_data.spi_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
-    tuh_max3421_int_api(rhport, false);
+static bool frame_advance(uint8_t rhport, bool sof);
+static void frame_wait_update(uint8_t rhport, bool in_isr);
+
+// Identify the context owning the SPI bus session so that its nested accesses skip locking.
+// Without a way to identify it, every access is locked separately.
+#if CFG_TUSB_OS == OPT_OS_FREERTOS
+  #define MAX3421_SESSION_ENABLED 1
+  #define session_self()          ((void*) xTaskGetCurrentTaskHandle())
+#elif CFG_TUSB_OS == OPT_OS_NONE && !OSAL_MUTEX_REQUIRED
+  // single thread context, ISR never takes a session (in_isr)
+  #define MAX3421_SESSION_ENABLED 1
+  #define session_self()          ((void*) &_hcd_data)
+#else
+  #define MAX3421_SESSION_ENABLED 0
+#endif
+
+// Hold the SPI bus (mutex and MAX3421 INT disabled) for a sequence of register/FIFO accesses, e.g a whole interrupt
+// pass or transfer setup, instead of locking on every access. Sessions nest: only the outermost one locks.
+// Nothing to do in_isr since interrupt is already masked.
+// Caller holds the session
+TU_ATTR_ALWAYS_INLINE static inline bool session_held(void) {
+#if MAX3421_SESSION_ENABLED
+  return _hcd_data.session_owner == session_self();
+#else
+  return false;
+#endif
+}
+
+static void max3421_session_begin(uint8_t rhport, bool in_isr) {
+  if (in_isr) return;
+
+#if MAX3421_SESSION_ENABLED
+  if (session_held()) {
+    // re-entered by the owner
+    _hcd_data.session_depth++;
+    return;
+  }
+#endif
+
+  (void) osal_mutex_lock(_hcd_data.spi_mutex, OSAL_TIMEOUT_WAIT_FOREVER);
+  tuh_max3421_int_api(rhport, false);
+
+#if MAX3421_SESSION_ENABLED
+  _hcd_data.session_owner = session_self();
+  _hcd_data.session_depth = 1;
+
+  // frame_count is up to date for the scheduler within the session
+  if (_hcd_data.lazy_frame && frame_advance(rhport, false)) {
+    _hcd_data.frame_tick = true;
+  }
+#endif
+}
+
+static void max3421_session_end(uint8_t rhport, bool in_isr) {
+  if (in_isr) return;
+
+#if MAX3421_SESSION_ENABLED
+  if (_hcd_data.session_depth > 1) {
+    _hcd_data.session_depth--;
+    return;
+  }
+
+  // FRAME_IRQ and wakeup for what the scheduler waits for, while the bus is still held
+  frame_wait_update(rhport, false);
+
+  _hcd_data.session_depth = 0;
+  _hcd_data.session_owner = NULL;
+#endif
+
+  if (!_hcd_data.spi_async_pending) {
+    tuh_max3421_int_api(rhport, true);
   }
+  (void) osal_mutex_unlock(_hcd_data.spi_mutex);
+}
+
+static void max3421_spi_lock(uint8_t rhport, bool in_isr) {
+  // disable interrupt and mutex lock (for pre-emptive RTOS) if not in_isr and not in a session already
+  max3421_session_begin(rhport, in_isr);
 
   // assert CS
   tuh_max3421_spi_cs_api(rhport, true);
+  _hcd_data.stats.spi_xact++;
 }
 
 static void max3421_spi_unlock(uint8_t rhport, bool in_isr) {
   // de-assert CS
   tuh_max3421_spi_cs_api(rhport, false);
 
-  // mutex unlock and re-enable interrupt
-  if (!in_isr) {
-    tuh_max3421_int_api(rhport, true);
-    (void) osal_mutex_unlock(_hcd_data.spi_mutex);
+  // mutex unlock and re-enable interrupt if session is not held
+  max3421_session_end(rhport, in_isr);
+}
+
+static int8_t shadow_index(uint8_t reg) {
+  switch (reg) {
+    case HIEN_ADDR:    return SHADOW_HIEN;
+    case MODE_ADDR:    return SHADOW_MODE;
+    case PERADDR_ADDR: return SHADOW_PERADDR;
+    case HCTL_ADDR:    return SHADOW_HCTL;
+    case PINCTL_ADDR:  return SHADOW_PINCTL;
+    default:           return -1;
+  }
+}
+
+// Update shadow register with written value, also for writes by application
+static void shadow_update(uint8_t reg, uint8_t data) {
+  int8_t const idx = shadow_index(reg);
+  if (idx < 0) return;
+
+  switch (reg) {
+    case HIEN_ADDR:    _hcd_data.hien = data; break;
+    case MODE_ADDR:    _hcd_data.mode = data; break;
+    case PERADDR_ADDR: _hcd_data.peraddr = data; break;
+    case PINCTL_ADDR:  _hcd_data.pinctl = data; break;
+
+    case HCTL_ADDR:
+      // only data toggle is cached, other bits (bus reset etc.) are strobes
+      if (data & (HCTL_RCVTOG0 | HCTL_RCVTOG1)) {
+        _hcd_data.hctl = (uint8_t) ((_hcd_data.hctl & ~(HCTL_RCVTOG0 | HCTL_RCVTOG1)) | (data & (HCTL_RCVTOG0 | HCTL_RCVTOG1)));
+      }
+      if (data & (HCTL_SNDTOG0 | HCTL_SNDTOG1)) {
+        _hcd_data.hctl = (uint8_t) ((_hcd_data.hctl & ~(HCTL_SNDTOG0 | HCTL_SNDTOG1)) | (data & (HCTL_SNDTOG0 | HCTL_SNDTOG1)));
+      }
+      break;
+
+    default: break;
+  }
+
+  _hcd_data.shadow_valid |= (uint8_t) TU_BIT(idx);
+  _hcd_data.stats.reg_written[idx]++;
+}
+
+// Check if writing data to shadow register is redundant
+static inline bool shadow_skip(uint8_t idx, uint8_t cached, uint8_t data) {
+  if ((_hcd_data.shadow_valid & TU_BIT(idx)) && cached == data) {
+    _hcd_data.stats.reg_skipped[idx]++;
+    return true;
   }
+  return false;
 }
 
 uint8_t tuh_max3421_reg_read(uint8_t rhport, uint8_t reg, bool in_isr) {
@@ -278,9 +529,13 @@ uint8_t tuh_max3421_reg_read(uint8_t rhport, uint8_t reg, bool in_isr) {
 
   max3421_spi_lock(rhport, in_isr);
   bool ret = tuh_max3421_spi_xfer_api(rhport, tx_buf, rx_buf, 2);
+  // HIRQ register since we are in full-duplex mode. Update while locked so that an older status
+  // cannot overwrite a newer one, and only when the transfer succeeded
+  if (ret) {
+    _hcd_data.hirq = rx_buf[0];
+  }
   max3421_spi_unlock(rhport, in_isr);
 
-  _hcd_data.hirq = rx_buf[0];
   return ret ? rx_buf[1] : 0;
 }
 
@@ -290,22 +545,74 @@ bool tuh_max3421_reg_write(uint8_t rhport, uint8_t reg, uint8_t data, bool in_is
 
   max3421_spi_lock(rhport, in_isr);
   bool ret = tuh_max3421_spi_xfer_api(rhport, tx_buf, rx_buf, 2);
+  if (ret) {
+    // HIRQ register since we are in full-duplex mode (value before this write)
+    _hcd_data.hirq = rx_buf[0];
+    if (reg == HIRQ_ADDR) {
+      // HIRQ write 1 is clear
+      _hcd_data.hirq &= (uint8_t) ~data;
+    }
+    shadow_update(reg, data);
+  }
   max3421_spi_unlock(rhport, in_isr);
 
-  // HIRQ register since we are in full-duplex mode
-  _hcd_data.hirq = rx_buf[0];
-
   return ret;
 }
 
+bool tuh_max3421_reg_stats(uint8_t rhport, uint8_t reg, uint32_t* write_count, uint32_t* skip_count) {
+  (void) rhport;
+  int8_t const idx = shadow_index(reg);
+  if (idx < 0) return false;
+
+  if (write_count) *write_count = _hcd_data.stats.reg_written[idx];
+  if (skip_count) *skip_count = _hcd_data.stats.reg_skipped[idx];
+  return true;
+}
+
+void tuh_max3421_spi_stats(uint8_t rhport, uint32_t* spi_xact, uint32_t* usb_xact) {
+  (void) rhport;
+  if (spi_xact) *spi_xact = _hcd_data.stats.spi_xact;
+  if (usb_xact) *usb_xact = _hcd_data.stats.usb_xact;
+}
+
+uint32_t tuh_max3421_int_stats(uint8_t rhport) {
+  (void) rhport;
+  return _hcd_data.stats.int_count;
+}
+
+void tuh_max3421_stats_reset(uint8_t rhport) {
+  (void) rhport;
+  // counters may be incremented concurrently by interrupt handler, a count in flight can be lost
+  tu_memclr(&_hcd_data.stats, sizeof(_hcd_data.stats));
+  for (size_t i = 0; i < CFG_TUH_MAX3421_ENDPOINT_TOTAL; i++) {
+    _hcd_data.ep[i].nak_total = 0;
+  }
+}
+
+// Read HIRQ only: every command returns HIRQ as the first byte in full-duplex mode,
+// clocking just the command byte is enough
+static uint8_t hirq_read(uint8_t rhport, bool in_isr) {
+  uint8_t const reg = HIRQ_ADDR;
+  uint8_t hirq = 0;
+
+  max3421_spi_lock(rhport, in_isr);
+  if (tuh_max3421_spi_xfer_api(rhport, &reg, &hirq, 1)) {
+    _hcd_data.hirq = hirq;
+  }
+  max3421_spi_unlock(rhport, in_isr);
+
+  return hirq;
+}
+
 static void fifo_write(uint8_t rhport, uint8_t reg, uint8_t const * buffer, uint16_t len, bool in_isr) {
   uint8_t hirq;
   reg |= CMDBYTE_WRITE;
 
   max3421_spi_lock(rhport, in_isr);
 
-  tuh_max3421_spi_xfer_api(rhport, &reg, &hirq, 1);
-  _hcd_data.hirq = hirq;
+  if (tuh_max3421_spi_xfer_api(rhport, &reg, &hirq, 1)) {
+    _hcd_data.hirq = hirq;
+  }
   tuh_max3421_spi_xfer_api(rhport, buffer, NULL, len);
 
   max3421_spi_unlock(rhport, in_isr);
@@ -318,8 +625,9 @@ static void fifo_read(uint8_t rhport, uint8_t * buffer, uint16_t len, bool in_is
 
   max3421_spi_lock(rhport, in_isr);
 
-  tuh_max3421_spi_xfer_api(rhport, &reg, &hirq, 1);
-  _hcd_data.hirq = hirq;
+  if (tuh_max3421_spi_xfer_api(rhport, &reg, &hirq, 1)) {
+    _hcd_data.hirq = hirq;
+  }
   tuh_max3421_spi_xfer_api(rhport, NULL, buffer, len);
 
   max3421_spi_unlock(rhport, in_isr);
@@ -327,35 +635,59 @@ static void fifo_read(uint8_t rhport, uint8_t * buffer, uint16_t len, bool in_is
 
 //------------- register write helper -------------//
 static inline void hirq_write(uint8_t rhport, uint8_t data, bool in_isr) {
+  // HIRQ write 1 is clear, cached hirq is updated by reg_write()
   reg_write(rhport, HIRQ_ADDR, data, in_isr);
-  // HIRQ write 1 is clear
-  _hcd_data.hirq &= (uint8_t) ~data;
 }
 
+//------------- shadow register write helper -------------//
+// shadow registers are updated by reg_write()
+
 static inline void hien_write(uint8_t rhport, uint8_t data, bool in_isr) {
-  _hcd_data.hien = data;
+  if (shadow_skip(SHADOW_HIEN, _hcd_data.hien, data)) return;
   reg_write(rhport, HIEN_ADDR, data, in_isr);
 }
 
 static inline void mode_write(uint8_t rhport, uint8_t data, bool in_isr) {
-  _hcd_data.mode = data;
+  if (shadow_skip(SHADOW_MODE, _hcd_data.mode, data)) return;
   reg_write(rhport, MODE_ADDR, data, in_isr);
 }
 
 static inline void peraddr_write(uint8_t rhport, uint8_t data, bool in_isr) {
-  if ( _hcd_data.peraddr == data ) return; // no need to change address
-
-  _hcd_data.peraddr = data;
+  if (shadow_skip(SHADOW_PERADDR, _hcd_data.peraddr, data)) return;
   reg_write(rhport, PERADDR_ADDR, data, in_isr);
 }
 
+static inline void pinctl_write(uint8_t rhport, uint8_t data, bool in_isr) {
+  if (shadow_skip(SHADOW_PINCTL, _hcd_data.pinctl, data)) return;
+  reg_write(rhport, PINCTL_ADDR, data, in_isr);
+}
+
+// HCTL strobe (bus reset, frame reset etc.), always written
+static inline void hctl_write(uint8_t rhport, uint8_t data, bool in_isr) {
+  reg_write(rhport, HCTL_ADDR, data, in_isr);
+}
+
+// Set data toggle (one of RCVTOG0/1, SNDTOG0/1). The chip flips the toggle itself on each successful transaction,
+// so the shadow follows the toggle read back from HRSL (hctl_toggle_update) rather than only the last written value
+static inline void hctl_toggle_write(uint8_t rhport, uint8_t tog, bool in_isr) {
+  uint8_t const mask = (tog & (HCTL_RCVTOG0 | HCTL_RCVTOG1)) ? (HCTL_RCVTOG0 | HCTL_RCVTOG1) : (HCTL_SNDTOG0 | HCTL_SNDTOG1);
+  if (shadow_skip(SHADOW_HCTL, _hcd_data.hctl & mask, tog)) return;
+  reg_write(rhport, HCTL_ADDR, tog, in_isr);
+}
+
+static inline void hctl_toggle_update(uint8_t hrsl) {
+  _hcd_data.hctl = (uint8_t) (((hrsl & HRSL_RCVTOGRD) ? HCTL_RCVTOG1 : HCTL_RCVTOG0) |
+                              ((hrsl & HRSL_SNDTOGRD) ? HCTL_SNDTOG1 : HCTL_SNDTOG0));
+}
+
 static inline void hxfr_write(uint8_t rhport, uint8_t data, bool in_isr) {
   _hcd_data.hxfr = data;
   reg_write(rhport, HXFR_ADDR, data, in_isr);
 }
 
+// commit loaded SNDFIFO buffer
 static inline void sndbc_write(uint8_t rhport, uint8_t data, bool in_isr) {
-  _hcd_data.sndbc = data;
+  _hcd_data.snd_len[_hcd_data.snd_count++] = data;
   reg_write(rhport, SNDBC_ADDR, data, in_isr);
 }
 
@@ -363,11 +695,11 @@ static inline void sndbc_write(uint8_t rhport, uint8_t data, bool in_isr) {
 // Endpoint helper
 //--------------------------------------------------------------------+
 
-static max3421_ep_t* find_ep_not_addr0(uint8_t daddr, uint8_t ep_num, uint8_t ep_dir) {
+// daddr = 0 and ep_num = 0 means a free endpoint. Only used when opening, lookup uses ep_index
+static max3421_ep_t* allocate_ep(void) {
   for(size_t i=1; i<CFG_TUH_MAX3421_ENDPOINT_TOTAL; i++) {
     max3421_ep_t* ep = &_hcd_data.ep[i];
-    // for control endpoint, skip direction check
-    if (daddr == ep->daddr && ep_num == ep->ep_num && (ep_dir == ep->ep_dir || ep_num == 0)) {
+    if (ep->daddr == 0 && ep->ep_num == 0) {
       return ep;
     }
   }
@@ -375,51 +707,170 @@ static max3421_ep_t* find_ep_not_addr0(uint8_t daddr, uint8_t ep_num, uint8_t ep
   return NULL;
 }
 
-// daddr = 0 and ep_num = 0 means find a free (allocate) endpoint
-TU_ATTR_ALWAYS_INLINE static inline max3421_ep_t * allocate_ep(void) {
-  return find_ep_not_addr0(0, 0, 0);
+// constant time lookup, called for every RCVDAV and HXFRDN interrupt
+TU_ATTR_ALWAYS_INLINE static inline max3421_ep_t * find_opened_ep(uint8_t daddr, uint8_t ep_num, uint8_t ep_dir) {
+  if (daddr == 0) {
+    return (ep_num == 0) ? &_hcd_data.ep[0] : NULL;
+  }
+  if (daddr > MAX3421_DADDR_MAX || ep_num >= 16) {
+    return NULL;
+  }
+
+  uint8_t const idx = _hcd_data.ep_index[daddr-1][ep_num][ep_dir ? 1 : 0];
+  return idx ? &_hcd_data.ep[idx] : NULL;
+}
+
+//------------- interrupt IN schedule list -------------//
+
+// frames to wait after poll: bInterval for interrupt IN, next frame for deferred NAK
+TU_ATTR_ALWAYS_INLINE static inline uint8_t sched_period(max3421_ep_t const* ep) {
+  return ep->interval ? ep->interval : 1;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint16_t sched_due_frame(max3421_ep_t const* ep) {
+  return (uint16_t) (ep->poll_frame + sched_period(ep));
 }
 
-TU_ATTR_ALWAYS_INLINE static inline max3421_ep_t * find_opened_ep(uint8_t daddr, uint8_t ep_num, uint8_t ep_dir) {
-  if (daddr == 0 && ep_num == 0) {
-    return &_hcd_data.ep[0];
-  }else{
-    return find_ep_not_addr0(daddr, ep_num, ep_dir);
+TU_ATTR_ALWAYS_INLINE static inline bool sched_is_due(max3421_ep_t const* ep, uint16_t frame) {
+  return (uint16_t) (frame - ep->poll_frame) >= sched_period(ep);
+}
+
+// insert endpoint into the list ordered by due frame
+static void sched_insert(max3421_ep_t* ep) {
+  if (ep->in_sched) return;
+
+  uint16_t const due = sched_due_frame(ep);
+  uint8_t* link = &_hcd_data.sched_head;
+  while (*link != SCHED_NONE) {
+    max3421_ep_t* cur = &_hcd_data.ep[*link];
+    // entries are due within 255 frames, signed difference handles wrap around
+    if ((int16_t) (due - sched_due_frame(cur)) < 0) break;
+    link = &cur->sched_link;
   }
+
+  ep->sched_link = *link;
+  *link = (uint8_t) (ep - _hcd_data.ep);
+  ep->in_sched = 1;
 }
 
-// free all endpoints belong to device address
-static void free_ep(uint8_t daddr) {
-  for (size_t i=1; i<CFG_TUH_MAX3421_ENDPOINT_TOTAL; i++) {
-    max3421_ep_t* ep = &_hcd_data.ep[i];
-    if (ep->daddr == daddr) {
-      tu_memclr(ep, sizeof(max3421_ep_t));
+static void sched_remove(max3421_ep_t* ep) {
+  if (!ep->in_sched) return;
+
+  uint8_t const idx = (uint8_t) (ep - _hcd_data.ep);
+  uint8_t* link = &_hcd_data.sched_head;
+  while (*link != SCHED_NONE) {
+    if (*link == idx) {
+      *link = ep->sched_link;
+      break;
     }
+    link = &_hcd_data.ep[*link].sched_link;
   }
+
+  ep->in_sched = 0;
 }
 
-static max3421_ep_t * find_next_pending_ep(max3421_ep_t * cur_ep) {
-  size_t const idx = (size_t) (cur_ep - _hcd_data.ep);
+//------------- lazy frame -------------//
+// Frame number is counted by FRAME_IRQ (SOF). With the timer backend (tuh_max3421_time_us_api() and
+// tuh_max3421_wakeup_api()) it is derived from the time instead and re-synced to SOF whenever FRAME_IRQ is enabled,
+// so that the chip is not serviced every millisecond while idle.
 
-  // starting from next endpoint
-  for (size_t i = idx + 1; i < CFG_TUH_MAX3421_ENDPOINT_TOTAL; i++) {
-    max3421_ep_t* ep = &_hcd_data.ep[i];
-    if (ep->xfer_pending && ep->packet_size) {
-//      TU_LOG3("next pending i = %u\r\n", i);
-      return ep;
+TU_ATTR_WEAK bool tuh_max3421_time_us_api(uint8_t rhport, uint32_t* time_us) {
+  (void) rhport;
+  (void) time_us;
+  return false;
+}
+
+TU_ATTR_WEAK bool tuh_max3421_wakeup_api(uint8_t rhport, uint32_t delay_us) {
+  (void) rhport;
+  (void) delay_us;
+  return false;
+}
+
+// Advance frame_count by the elapsed time. sof: FRAME_IRQ is pending, re-sync start of frame to it.
+// Return true if frame is changed
+static bool frame_advance(uint8_t rhport, bool sof) {
+  uint32_t now;
+  if (!tuh_max3421_time_us_api(rhport, &now)) return false;
+
+  uint32_t const elapsed = now - _hcd_data.frame_us;
+  uint32_t frames;
+  uint32_t frame_us;
+  if (sof) {
+    // SOF is sent at the start of a frame, nearest one to the timer
+    frames = (elapsed + 500) / 1000;
+    frame_us = now;
+  } else {
+    frames = elapsed / 1000;
+    frame_us = _hcd_data.frame_us + frames * 1000;
+  }
+
+  // odd frame_seq while the pair is inconsistent, see hcd_frame_number()
+  __atomic_fetch_add(&_hcd_data.frame_seq, 1, __ATOMIC_ACQ_REL);
+  _hcd_data.frame_us = frame_us;
+  _hcd_data.frame_count = (uint16_t) (_hcd_data.frame_count + frames);
+  __atomic_fetch_add(&_hcd_data.frame_seq, 1, __ATOMIC_RELEASE);
+
+  return frames != 0;
+}
+
+// Enable FRAME_IRQ only if the scheduler needs the next frame, request a wakeup for a later due frame
+static void frame_wait_update(uint8_t rhport, bool in_isr) {
+  if (!_hcd_data.lazy_frame) return;
+
+  // frames until the scheduler must run, 0 is nothing to wait for
+  uint16_t wait = 0;
+  if (_hcd_data.sched_kick) {
+    wait = 1;
+  } else if (_hcd_data.sched_head != SCHED_NONE) {
+    int16_t const due = (int16_t) (sched_due_frame(&_hcd_data.ep[_hcd_data.sched_head]) - _hcd_data.frame_count);
+    wait = (due > 1) ? (uint16_t) due : 1;
+  }
+
+  uint8_t const hien = (wait == 1) ? (uint8_t) (_hcd_data.hien | HIRQ_FRAME_IRQ) :
+                                     (uint8_t) (_hcd_data.hien & ~HIRQ_FRAME_IRQ);
+  if (hien != _hcd_data.hien) {
+    if (hien & HIRQ_FRAME_IRQ) {
+      // FRAME_IRQ is still set by SOFs counted by the timer
+      hirq_write(rhport, HIRQ_FRAME_IRQ, in_isr);
     }
+    hien_write(rhport, hien, in_isr);
+  }
+
+  bool const wake = (wait > 1);
+  uint16_t const wake_frame = (uint16_t) (_hcd_data.frame_count + wait);
+  if (wake == _hcd_data.wake_armed && (!wake || wake_frame == _hcd_data.wake_frame)) return;
+
+  uint32_t delay_us = 0;
+  if (wake) {
+    uint32_t now = _hcd_data.frame_us;
+    (void) tuh_max3421_time_us_api(rhport, &now);
+    uint32_t const elapsed = now - _hcd_data.frame_us;
+    delay_us = (uint32_t) wait * 1000;
+    delay_us = (delay_us > elapsed) ? (delay_us - elapsed) : 1;
+  }
+
+  _hcd_data.wake_armed = wake;
+  _hcd_data.wake_frame = wake_frame;
+  (void) tuh_max3421_wakeup_api(rhport, delay_us);
+}
+
+// free all endpoints belong to device address
+static void free_ep(uint8_t daddr) {
+  if (daddr >= 1 && daddr <= MAX3421_DADDR_MAX) {
+    tu_memclr(_hcd_data.ep_index[daddr-1], sizeof(_hcd_data.ep_index[0]));
   }
 
-  // wrap around including current endpoint
-  for (size_t i = 0; i <= idx; i++) {
+  for (size_t i=1; i<CFG_TUH_MAX3421_ENDPOINT_TOTAL; i++) {
     max3421_ep_t* ep = &_hcd_data.ep[i];
-    if (ep->xfer_pending && ep->packet_size) {
-//      TU_LOG3("next pending i = %u\r\n", i);
-      return ep;
+    if (ep->daddr == daddr) {
+      sched_remove(ep);
+      if (_hcd_data.sndfifo_parked == i) {
+        _hcd_data.sndfifo_parked = SCHED_NONE;
+        _hcd_data.snd_count = 0;
+      }
+      tu_memclr(ep, sizeof(max3421_ep_t));
     }
   }
-
-  return NULL;
 }
 
 //--------------------------------------------------------------------+
@@ -429,10 +880,13 @@ static max3421_ep_t * find_next_pending_ep(max3421_ep_t * cur_ep) {
 // optional hcd configuration, called by tuh_configure()
 bool hcd_configure(uint8_t rhport, uint32_t cfg_id, const void* cfg_param) {
   (void) rhport;
-  (void) cfg_id;
-  (void) cfg_param;
+  TU_VERIFY(cfg_id == TUH_CFGID_MAX3421 && cfg_param);
 
-  return false;
+  tuh_configure_max3421_t const* cfg = (tuh_configure_max3421_t const*) cfg_param;
+  TU_VERIFY(cfg->nak_policy_control <= TUH_MAX3421_NAK_RETRY_BOUNDED && cfg->nak_policy_bulk <= TUH_MAX3421_NAK_RETRY_BOUNDED);
+  _tuh_cfg = *cfg;
+
+  return true;
 }
 
 // Initialize controller to host mode
@@ -446,13 +900,20 @@ bool hcd_init(uint8_t rhport) {
 
   tu_memclr(&_hcd_data, sizeof(_hcd_data));
   _hcd_data.peraddr = 0xff; // invalid
+  _hcd_data.sched_head = SCHED_NONE;
+  _hcd_data.sndfifo_parked = SCHED_NONE;
+
+#if MAX3421_SESSION_ENABLED
+  // lazy frame is updated when sessions begin and end
+  _hcd_data.lazy_frame = tuh_max3421_time_us_api(rhport, &_hcd_data.frame_us) && tuh_max3421_wakeup_api(rhport, 0);
+#endif
 
 #if OSAL_MUTEX_REQUIRED
   _hcd_data.spi_mutex = osal_mutex_create(&_hcd_data.spi_mutexdef);
 #endif
 
-  // full duplex, interrupt negative edge
-  reg_write(rhport, PINCTL_ADDR, PINCTL_FDUPSPI, false);
+  // full duplex, interrupt negative edge or active low level
+  pinctl_write(rhport, PINCTL_FDUPSPI | (CFG_TUH_MAX3421_INT_LEVEL ? PINCTL_INTLEVEL : 0), false);
 
   // V1 is 0x01, V2 is 0x12, V3 is 0x13
   uint8_t const revision = reg_read(rhport, REVISION_ADDR, false);
@@ -462,6 +923,10 @@ bool hcd_init(uint8_t rhport) {
   // reset
   reg_write(rhport, USBCTL_ADDR, USBCTL_CHIPRES, false);
   reg_write(rhport, USBCTL_ADDR, 0, false);
+
+  // chip reset clears all registers except PINCTL
+  _hcd_data.shadow_valid &= (uint8_t) TU_BIT(SHADOW_PINCTL);
+  _hcd_data.hctl = 0;
   while( !(reg_read(rhport, USBIRQ_ADDR, false) & USBIRQ_OSCOK_IRQ) ) {
     // wait for oscillator to stabilize
   }
@@ -470,7 +935,7 @@ bool hcd_init(uint8_t rhport) {
   mode_write(rhport, MODE_DPPULLDN | MODE_DMPULLDN | MODE_HOST, false);
 
   // frame reset & bus reset, this will trigger CONDET IRQ if device is already connected
-  reg_write(rhport, HCTL_ADDR, HCTL_BUSRST | HCTL_FRMRST, false);
+  hctl_write(rhport, HCTL_BUSRST | HCTL_FRMRST, false);
 
   // clear all previously pending IRQ
   hirq_write(rhport, 0xff, false);
@@ -489,19 +954,48 @@ bool hcd_init(uint8_t rhport) {
 // Enable USB interrupt
 // Not actually enable GPIO interrupt, just set variable to prevent handler to process
 void hcd_int_enable (uint8_t rhport) {
+  // e.g by event queue within a session: INT is enabled when the session ends (or asynchronous read completes)
+  if (session_held() || _hcd_data.spi_async_pending) return;
   tuh_max3421_int_api(rhport, true);
 }
 
 // Disable USB interrupt
 // Not actually disable GPIO interrupt, just set variable to prevent handler to process
 void hcd_int_disable(uint8_t rhport) {
+  if (session_held()) return;
   tuh_max3421_int_api(rhport, false);
 }
 
 // Get frame number (1ms)
 uint32_t hcd_frame_number(uint8_t rhport) {
-  (void) rhport;
-  return (uint32_t ) _hcd_data.frame_count;
+  if (!_hcd_data.lazy_frame) {
+    // counted by FRAME_IRQ
+    return (uint32_t) _hcd_data.frame_count;
+  }
+
+  // frame_count and frame_us are a pair updated by frame_advance(), retry if it ran while they were read
+  for (uint8_t i = 0; i < FRAME_READ_RETRY; i++) {
+    uint16_t const seq = __atomic_load_n(&_hcd_data.frame_seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) continue;
+
+    uint16_t const frame = _hcd_data.frame_count;
+    uint32_t const start = _hcd_data.frame_us;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&_hcd_data.frame_seq, __ATOMIC_RELAXED) != seq) continue;
+
+    uint32_t now;
+    if (!tuh_max3421_time_us_api(rhport, &now)) return (uint32_t) frame;
+
+    // not advanced by FRAME_IRQ, add frames since last update
+    return (uint32_t) (uint16_t) (frame + (now - start) / 1000);
+  }
+
+  // the update is preempted in the middle: wait for its holder, the session advances frame_count to the timer
+  max3421_session_begin(rhport, false);
+  uint16_t const frame = _hcd_data.frame_count;
+  max3421_session_end(rhport, false);
+
+  return (uint32_t) frame;
 }
 
 //--------------------------------------------------------------------+
@@ -517,12 +1011,12 @@ bool hcd_port_connect_status(uint8_t rhport) {
 // Reset USB bus on the port. Return immediately, bus reset sequence may not be complete.
 // Some port would require hcd_port_reset_end() to be invoked after 10ms to complete the reset sequence.
 void hcd_port_reset(uint8_t rhport) {
-  reg_write(rhport, HCTL_ADDR, HCTL_BUSRST, false);
+  hctl_write(rhport, HCTL_BUSRST, false);
 }
 
 // Complete bus reset sequence, may be required by some controllers
 void hcd_port_reset_end(uint8_t rhport) {
-  reg_write(rhport, HCTL_ADDR, 0, false);
+  hctl_write(rhport, 0, false);
 }
 
 // Get port link speed
@@ -553,41 +1047,91 @@ bool hcd_edpt_open(uint8_t rhport, uint8_t daddr, tusb_desc_endpoint_t const * e
   if (daddr == 0 && ep_num == 0) {
     ep = &_hcd_data.ep[0];
   }else {
+    TU_ASSERT(daddr != 0 && daddr <= MAX3421_DADDR_MAX && ep_num < 16);
     ep = allocate_ep();
     TU_ASSERT(ep);
     ep->daddr = daddr;
     ep->ep_num = (uint8_t) (ep_num & 0x0f);
     ep->ep_dir = (ep_dir == TUSB_DIR_IN) ? 1 : 0;
+
+    // control endpoint can be used in both directions
+    uint8_t const idx = (uint8_t) (ep - _hcd_data.ep);
+    if (ep_num == 0) {
+      _hcd_data.ep_index[daddr-1][0][0] = idx;
+      _hcd_data.ep_index[daddr-1][0][1] = idx;
+    } else {
+      _hcd_data.ep_index[daddr-1][ep_num][ep->ep_dir] = idx;
+    }
   }
 
   if ( TUSB_XFER_ISOCHRONOUS == ep_desc->bmAttributes.xfer ) {
     ep->is_iso = 1;
   }
 
+  // interrupt IN is polled every bInterval frames (full/low speed), first poll is due immediately
+  if ( TUSB_XFER_INTERRUPT == ep_desc->bmAttributes.xfer && ep->ep_dir ) {
+    ep->interval = ep_desc->bInterval ? ep_desc->bInterval : 1;
+    ep->poll_frame = (uint16_t) (_hcd_data.frame_count - ep->interval);
+  }
+
   ep->packet_size = (uint16_t) (tu_edpt_packet_size(ep_desc) & 0x7ff);
 
   return true;
 }
 
+// Load the packet following those already in SNDFIFO and commit it
+static void sndfifo_load(uint8_t rhport, max3421_ep_t *ep, bool in_isr) {
+  if (_hcd_data.snd_rewind) {
+    // Host OUT NAK erratum: after a NAK the buffer is not re-sent by retrying HXFR. Writing SNDBC = 0 rewinds it,
+    // then the NAKed packet is written again in full and committed. A packet preloaded in the other buffer is lost
+    // (snd_count was cleared in handle_nak) and is loaded again after the NAKed one is accepted
+    _hcd_data.snd_rewind = false;
+    reg_write(rhport, SNDBC_ADDR, 0, in_isr);
+  }
+
+  uint16_t offset = ep->xferred_len;
+  for (uint8_t i = 0; i < _hcd_data.snd_count; i++) {
+    offset += _hcd_data.snd_len[i];
+  }
+
+  uint8_t const xact_len = (uint8_t) tu_min16(ep->total_len - offset, ep->packet_size);
+  if (xact_len) {
+    fifo_write(rhport, SNDFIFO_ADDR, ep->buf + (offset - ep->xferred_len), xact_len, in_isr);
+  }
+  sndbc_write(rhport, xact_len, in_isr);
+}
+
 void xact_out(uint8_t rhport, max3421_ep_t *ep, bool switch_ep, bool in_isr) {
   // Page 12: Programming BULK-OUT Transfers
-  // TODO double buffered
   if (switch_ep) {
     peraddr_write(rhport, ep->daddr, in_isr);
 
-    uint8_t const hctl = (ep->data_toggle ? HCTL_SNDTOG1 : HCTL_SNDTOG0);
-    reg_write(rhport, HCTL_ADDR, hctl, in_isr);
+    hctl_toggle_write(rhport, ep->data_toggle ? HCTL_SNDTOG1 : HCTL_SNDTOG0, in_isr);
   }
 
-  uint8_t const xact_len = (uint8_t) tu_min16(ep->total_len - ep->xferred_len, ep->packet_size);
-  TU_ASSERT(_hcd_data.hirq & HIRQ_SNDBAV_IRQ,);
-  if (xact_len) {
-    fifo_write(rhport, SNDFIFO_ADDR, ep->buf, xact_len, in_isr);
+  if (_hcd_data.sndfifo_parked == (uint8_t) (ep - _hcd_data.ep)) {
+    // resume after NAK: the NAKed packet is rewound and loaded again below
+    _hcd_data.sndfifo_parked = SCHED_NONE;
+  }
+
+  if (_hcd_data.snd_count == 0) {
+    TU_ASSERT(_hcd_data.snd_rewind || (_hcd_data.hirq & HIRQ_SNDBAV_IRQ),);
+    sndfifo_load(rhport, ep, in_isr);
+  } else {
+    // next packet is already loaded while previous one was on the wire
   }
-  sndbc_write(rhport, xact_len, in_isr);
 
   uint8_t const hxfr = (uint8_t ) (ep->ep_num | HXFR_OUT_NIN | (ep->is_iso ? HXFR_ISO : 0));
   hxfr_write(rhport, hxfr, in_isr);
+
+  // Double buffered: load next packet into the other buffer while this one is on the wire, unless it is the last one.
+  // After a NAK the rest of the transfer is single buffered, a device that NAKs tends to NAK again and each NAK with
+  // a preloaded packet costs its reload
+  uint8_t const cur_len = _hcd_data.snd_len[0];
+  if (_hcd_data.snd_count == 1 && !ep->snd_single && cur_len == ep->packet_size &&
+      ep->xferred_len + cur_len < ep->total_len) {
+    sndfifo_load(rhport, ep, in_isr);
+  }
 }
 
 void xact_in(uint8_t rhport, max3421_ep_t *ep, bool switch_ep, bool in_isr) {
@@ -595,8 +1139,7 @@ void xact_in(uint8_t rhport, max3421_ep_t *ep, bool switch_ep, bool in_isr) {
   if (switch_ep) {
     peraddr_write(rhport, ep->daddr, in_isr);
 
-    uint8_t const hctl = (ep->data_toggle ? HCTL_RCVTOG1 : HCTL_RCVTOG0);
-    reg_write(rhport, HCTL_ADDR, hctl, in_isr);
+    hctl_toggle_write(rhport, ep->data_toggle ? HCTL_RCVTOG1 : HCTL_RCVTOG0, in_isr);
   }
 
   uint8_t const hxfr = (uint8_t) (ep->ep_num | (ep->is_iso ? HXFR_ISO : 0));
@@ -629,6 +1172,107 @@ TU_ATTR_ALWAYS_INLINE static inline void xact_inout(uint8_t rhport, max3421_ep_t
   }
 }
 
+//--------------------------------------------------------------------+
+// Scheduler
+// Frame driven: interrupt IN endpoints are polled only when their interval is due, they wait in a list ordered by
+// due frame (sched_insert). Control and bulk endpoints use the remaining time in round robin.
+// Only the owner of busy flag schedules, busy is released when there is nothing to start.
+//--------------------------------------------------------------------+
+
+// OUT data transaction (not SETUP nor status) uses SNDFIFO
+TU_ATTR_ALWAYS_INLINE static inline bool ep_use_sndfifo(max3421_ep_t const* ep) {
+  if (ep->ep_dir || ep->is_setup) return false;
+  return !(ep->ep_num == 0 && (ep->buf == NULL || ep->total_len == 0));
+}
+
+// SNDFIFO is loaded with a deferred packet of another endpoint
+TU_ATTR_ALWAYS_INLINE static inline bool sndfifo_blocked(max3421_ep_t const* ep) {
+  return _hcd_data.sndfifo_parked != SCHED_NONE && _hcd_data.sndfifo_parked != (uint8_t) (ep - _hcd_data.ep) &&
+         ep_use_sndfifo(ep);
+}
+
+// Pick next endpoint to start: due interrupt IN first, then other pending endpoints starting after cur_ep
+static max3421_ep_t* sched_pick(max3421_ep_t* cur_ep) {
+  uint16_t const frame = _hcd_data.frame_count;
+
+  while (_hcd_data.sched_head != SCHED_NONE) {
+    max3421_ep_t* ep = &_hcd_data.ep[_hcd_data.sched_head];
+    if (!sched_is_due(ep, frame)) break;
+
+    _hcd_data.sched_head = ep->sched_link;
+    ep->in_sched = 0;
+    if (ep->xfer_pending && ep->packet_size && !sndfifo_blocked(ep)) {
+      return ep;
+    }
+    // not re-queued yet or blocked: will be picked by round robin below later
+  }
+
+  size_t const idx = cur_ep ? (size_t) (cur_ep - _hcd_data.ep) : (CFG_TUH_MAX3421_ENDPOINT_TOTAL - 1);
+  for (size_t n = 1; n <= CFG_TUH_MAX3421_ENDPOINT_TOTAL; n++) {
+    max3421_ep_t* ep = &_hcd_data.ep[(idx + n) % CFG_TUH_MAX3421_ENDPOINT_TOTAL];
+    if (!ep->xfer_pending || !ep->packet_size || ep->in_sched || sndfifo_blocked(ep)) continue;
+
+    if (ep->interval && !sched_is_due(ep, frame)) {
+      // queued before its interval is due
+      sched_insert(ep);
+      continue;
+    }
+    return ep;
+  }
+
+  return NULL;
+}
+
+// Start next transaction. retry: cur_ep is NAKed and can be retried without switching endpoint
+static void sched_next(uint8_t rhport, max3421_ep_t* cur_ep, bool retry, bool in_isr) {
+  max3421_ep_t* ep = sched_pick(cur_ep);
+  if (!ep) {
+    // nothing to do until next interval is due
+    atomic_flag_clear(&_hcd_data.busy);
+    return;
+  }
+
+  if (ep->interval) {
+    ep->poll_frame = _hcd_data.frame_count;
+  }
+
+  if (retry && ep == cur_ep) {
+    // same endpoint, no need to switch address and toggle. OUT data must be rewound and loaded again
+    if (ep_use_sndfifo(ep)) {
+      xact_out(rhport, ep, false, in_isr);
+    } else {
+      hxfr_write(rhport, _hcd_data.hxfr, in_isr);
+    }
+  } else {
+    xact_inout(rhport, ep, true, in_isr);
+  }
+}
+
+// Start frame: kick scheduler if an interrupt IN endpoint is due or transfer is queued while busy
+static void sched_frame(uint8_t rhport, bool in_isr) {
+  bool const due = (_hcd_data.sched_head != SCHED_NONE) &&
+                   sched_is_due(&_hcd_data.ep[_hcd_data.sched_head], _hcd_data.frame_count);
+  if (!due && !_hcd_data.sched_kick) return;
+
+  // transfer in progress: scheduled when it is done
+  if (atomic_flag_test_and_set(&_hcd_data.busy)) return;
+
+  _hcd_data.sched_kick = false;
+  sched_next(rhport, NULL, false, in_isr);
+}
+
+// Carry out a queued transfer if not busy, otherwise it is picked up when the owner of busy is done or on next frame.
+// Its SPI accesses are in one session, which also updates FRAME_IRQ for sched_kick (lazy frame)
+static void sched_submit(uint8_t rhport) {
+  max3421_session_begin(rhport, false);
+  if ( !atomic_flag_test_and_set(&_hcd_data.busy) ) {
+    sched_next(rhport, NULL, false, false);
+  } else {
+    _hcd_data.sched_kick = true;
+  }
+  max3421_session_end(rhport, false);
+}
+
 // Submit a transfer, when complete hcd_event_xfer_complete() must be invoked
 bool hcd_edpt_xfer(uint8_t rhport, uint8_t daddr, uint8_t ep_addr, uint8_t * buffer, uint16_t buflen) {
   uint8_t const ep_num = tu_edpt_number(ep_addr);
@@ -644,6 +1288,9 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t daddr, uint8_t ep_addr, uint8_t * buf
   ep->total_len = buflen;
   ep->xferred_len = 0;
   ep->xfer_complete = 0;
+  ep->snd_single = 0;
+  ep->nak_count = 0;
+  ep->xfer_frame = _hcd_data.frame_count;
   ep->xfer_pending = 1;
 
   if ( ep_num == 0 ) {
@@ -651,12 +1298,7 @@ bool hcd_edpt_xfer(uint8_t rhport, uint8_t daddr, uint8_t ep_addr, uint8_t * buf
     ep->data_toggle = 1;
   }
 
-  // carry out transfer if not busy
-  if ( !atomic_flag_test_and_set(&_hcd_data.busy) ) {
-    xact_inout(rhport, ep, true, false);
-  } else {
-    return true;
-  }
+  sched_submit(rhport);
 
   return true;
 }
@@ -684,12 +1326,11 @@ bool hcd_setup_send(uint8_t rhport, uint8_t daddr, uint8_t const setup_packet[8]
   ep->total_len = 8;
   ep->xferred_len = 0;
   ep->xfer_complete = 0;
+  ep->nak_count = 0;
+  ep->xfer_frame = _hcd_data.frame_count;
   ep->xfer_pending = 1;
 
-  // carry out transfer if not busy
-  if ( !atomic_flag_test_and_set(&_hcd_data.busy) ) {
-    xact_inout(rhport, ep, true, false);
-  }
+  sched_submit(rhport);
 
   return true;
 }
@@ -725,9 +1366,9 @@ static void handle_connect_irq(uint8_t rhport, bool in_isr) {
       mode_write(rhport, new_mode, in_isr);
 
       // port reset anyway, this will help to stable bus signal for next connection
-      reg_write(rhport, HCTL_ADDR, HCTL_BUSRST, in_isr);
+      hctl_write(rhport, HCTL_BUSRST, in_isr);
       hcd_event_device_remove(rhport, in_isr);
-      reg_write(rhport, HCTL_ADDR, 0, in_isr);
+      hctl_write(rhport, 0, in_isr);
       break;
 
     default: {
@@ -757,33 +1398,106 @@ static void handle_connect_irq(uint8_t rhport, bool in_isr) {
   }
 }
 
-static void xfer_complete_isr(uint8_t rhport, max3421_ep_t *ep, xfer_result_t result, uint8_t hrsl, bool in_isr) {
-  uint8_t const ep_addr = tu_edpt_addr(ep->ep_num, ep->ep_dir);
-
-  // save data toggle
+TU_ATTR_ALWAYS_INLINE static inline void save_data_toggle(max3421_ep_t *ep, uint8_t hrsl) {
   if (ep->ep_dir) {
     ep->data_toggle = (hrsl & HRSL_RCVTOGRD) ? 1u : 0u;
   }else {
     ep->data_toggle = (hrsl & HRSL_SNDTOGRD) ? 1u : 0u;
   }
+}
+
+static void xfer_complete_isr(uint8_t rhport, max3421_ep_t *ep, xfer_result_t result, uint8_t hrsl, bool in_isr) {
+  uint8_t const ep_addr = tu_edpt_addr(ep->ep_num, ep->ep_dir);
+
+  save_data_toggle(ep, hrsl);
+
+  if (ep_use_sndfifo(ep)) {
+    // Note: MAX3421E has no way to unload SNDFIFO, packets not accepted (failed transfer) are left there
+    _hcd_data.snd_count = 0;
+  }
 
   ep->xfer_pending = 0;
   hcd_event_xfer_complete(ep->daddr, ep_addr, ep->xferred_len, result, in_isr);
 
-  // Find next pending endpoint
-  max3421_ep_t *next_ep = find_next_pending_ep(ep);
-  if (next_ep) {
-    xact_inout(rhport, next_ep, true, in_isr);
-  }else {
-    // no more pending
-    atomic_flag_clear(&_hcd_data.busy);
+  // start next pending endpoint
+  sched_next(rhport, ep, false, in_isr);
+}
+
+static void handle_nak(uint8_t rhport, max3421_ep_t *ep, uint8_t hrsl, bool in_isr) {
+  if (ep->nak_count < UINT16_MAX) {
+    ep->nak_count++;
   }
+  ep->nak_total++;
+
+  // NAK does not change data toggle, but save it in case we switch to other endpoint
+  save_data_toggle(ep, hrsl);
+
+  if (ep->interval) {
+    // interrupt IN, poll again when interval is due. Meanwhile the bus is free for others
+    sched_insert(ep);
+    sched_next(rhport, ep, false, in_isr);
+    return;
+  }
+
+  uint8_t const policy = (ep->ep_num == 0) ? _tuh_cfg.nak_policy_control : _tuh_cfg.nak_policy_bulk;
+
+  if (policy == TUH_MAX3421_NAK_RETRY_BOUNDED) {
+    uint16_t const elapsed = (uint16_t) (_hcd_data.frame_count - ep->xfer_frame);
+    if ((_tuh_cfg.nak_limit && ep->nak_count >= _tuh_cfg.nak_limit) ||
+        (_tuh_cfg.nak_timeout_ms && elapsed >= _tuh_cfg.nak_timeout_ms)) {
+      // Note: for OUT, MAX3421E has no way to unload the NAKed packet from SNDFIFO
+      TU_LOG2("NAK timeout: addr %u ep %u, %u NAKs\r\n", ep->daddr, ep->ep_num, ep->nak_count);
+      xfer_complete_isr(rhport, ep, XFER_RESULT_TIMEOUT, hrsl, in_isr);
+      return;
+    }
+  }
+
+  if (ep_use_sndfifo(ep)) {
+    // NAKed packet (and the preloaded one, if any) must be loaded again after rewinding SNDFIFO, see sndfifo_load().
+    // The NAKed buffer is not reusable until then, other OUT must wait if we switch to other endpoint
+    _hcd_data.snd_count = 0;
+    _hcd_data.snd_rewind = true;
+    ep->snd_single = 1;
+    _hcd_data.sndfifo_parked = (uint8_t) (ep - _hcd_data.ep);
+  }
+
+  if (policy == TUH_MAX3421_NAK_RETRY_IMMEDIATE) {
+    if (ep->ep_num == 0) {
+      // control, retry at once
+      if (ep_use_sndfifo(ep)) {
+        xact_out(rhport, ep, false, in_isr);
+      } else {
+        hxfr_write(rhport, _hcd_data.hxfr, in_isr);
+      }
+    } else {
+      // switch to next pending or retry at once if this endpoint is only one pending
+      sched_next(rhport, ep, true, in_isr);
+    }
+    return;
+  }
+
+  // retry in next frame, meanwhile the bus is free for others
+  ep->poll_frame = _hcd_data.frame_count;
+  sched_insert(ep);
+  sched_next(rhport, ep, false, in_isr);
 }
 
-static void handle_xfer_done(uint8_t rhport, bool in_isr) {
-  uint8_t const hrsl = reg_read(rhport, HRSL_ADDR, in_isr);
+bool tuh_max3421_nak_stats(uint8_t rhport, uint8_t daddr, uint8_t ep_addr, uint32_t* nak_count) {
+  (void) rhport;
+  max3421_ep_t const* ep = find_opened_ep(daddr, tu_edpt_number(ep_addr), tu_edpt_dir(ep_addr));
+  TU_VERIFY(ep && ep->packet_size);
+
+  if (nak_count) *nak_count = ep->nak_total;
+  return true;
+}
+
+// hrsl is read by caller (after HXFRDN is acked)
+static void handle_xfer_done(uint8_t rhport, uint8_t hrsl, bool in_isr) {
   uint8_t const hresult = hrsl & HRSL_RESULT_MASK;
 
+  // data toggle of the chip after this transaction
+  hctl_toggle_update(hrsl);
+
   uint8_t const ep_num = _hcd_data.hxfr & HXFR_EPNUM_MASK;
   uint8_t const hxfr_type = _hcd_data.hxfr & 0xf0;
   uint8_t const ep_dir = ((hxfr_type & HXFR_SETUP) || (hxfr_type & HXFR_OUT_NIN)) ? 0 : 1;
@@ -802,23 +1516,7 @@ static void handle_xfer_done(uint8_t rhport, bool in_isr) {
       break;
 
     case HRSL_NAK:
-      if (ep_num == 0) {
-        // NAK on control, retry immediately
-        hxfr_write(rhport, _hcd_data.hxfr, in_isr);
-      }else {
-        // NAK on non-control, find next pending to switch
-        max3421_ep_t *next_ep = find_next_pending_ep(ep);
-
-        if (ep == next_ep) {
-          // this endpoint is only one pending, retry immediately
-          hxfr_write(rhport, _hcd_data.hxfr, in_isr);
-        }else if (next_ep) {
-          // switch to next pending TODO could have issue with double buffered if not clear previously out data
-          xact_inout(rhport, next_ep, true, in_isr);
-        }else {
-          TU_ASSERT(false,);
-        }
-      }
+      handle_nak(rhport, ep, hrsl, in_isr);
       return;
 
     case HRSL_BAD_REQ:
@@ -858,7 +1556,11 @@ static void handle_xfer_done(uint8_t rhport, bool in_isr) {
     } else if (hxfr_type & HXFR_HS) {
       xact_len = 0;
     } else {
-      xact_len = _hcd_data.sndbc;
+      // oldest buffer is accepted and freed, preloaded packet (if any) becomes the oldest
+      TU_ASSERT(_hcd_data.snd_count,);
+      xact_len = _hcd_data.snd_len[0];
+      _hcd_data.snd_len[0] = _hcd_data.snd_len[1];
+      _hcd_data.snd_count--;
     }
 
     ep->xferred_len += xact_len;
@@ -892,66 +1594,206 @@ void print_hirq(uint8_t hirq) {
   #define print_hirq(hirq)
 #endif
 
-// ESP32 out-of-sync
-#if defined(ARDUINO_ARCH_ESP32) && ESP_ARDUINO_VERSION < 0x02000E && !defined(PLATFORMIO)
-void hcd_int_handler_esp32(uint8_t rhport, bool in_isr) {
-#else
-// Interrupt handler
-void hcd_int_handler(uint8_t rhport, bool in_isr) {
-#endif
-  uint8_t hirq = reg_read(rhport, HIRQ_ADDR, in_isr) & _hcd_data.hien;
-  if (!hirq) return;
-//  print_hirq(hirq);
+//--------------------------------------------------------------------+
+// Asynchronous SPI
+// A RCVFIFO read of at least CFG_TUH_MAX3421_SPI_ASYNC_MIN bytes is submitted to the backend if it supports it.
+// The interrupt pass returns meanwhile (thread can do other work) and is resumed by rcvfifo_complete()
+//--------------------------------------------------------------------+
+
+TU_ATTR_WEAK bool tuh_max3421_spi_submit_api(uint8_t rhport, tuh_max3421_spi_xact_t* xact) {
+  (void) rhport;
+  (void) xact;
+  return false;
+}
+
+bool tuh_max3421_spi_async_pending(uint8_t rhport) {
+  (void) rhport;
+  return _hcd_data.spi_async_pending;
+}
+
+static void int_pass_continue(uint8_t rhport, bool in_isr);
+
+// RCVFIFO is read: ack RCVDAV together with other pending IRQs (HXFRDN, FRAME etc.) and read HRSL
+static void rcvdav_ack(uint8_t rhport, int_pass_t* pass, bool in_isr) {
+  pass->ep->buf += pass->xact_len;
+  pass->ep->xferred_len += pass->xact_len;
+
+  hirq_write(rhport, pass->ack | HIRQ_RCVDAV_IRQ, in_isr);
+  pass->hxfrdn_acked = pass->hxfrdn_acked || (pass->ack & HIRQ_HXFRDN_IRQ);
+  pass->ack = 0;
+
+  // HRSL read also returns HIRQ after the ack
+  pass->hrsl = reg_read(rhport, HRSL_ADDR, in_isr);
+  pass->hrsl_valid = pass->hxfrdn_acked;
+  pass->hirq = (uint8_t) ((_hcd_data.hirq & _hcd_data.hien) | (pass->hxfrdn_acked ? HIRQ_HXFRDN_IRQ : 0));
+}
+
+static void rcvfifo_complete(uint8_t rhport, tuh_max3421_spi_xact_t* xact, bool success) {
+  max3421_session_begin(rhport, false);
+  _hcd_data.spi_async_pending = false;
 
-  if (hirq & HIRQ_FRAME_IRQ) {
-    _hcd_data.frame_count++;
+  int_pass_t* pass = &_hcd_data.pass;
+  if (success) {
+    _hcd_data.hirq = xact->status;
+  } else {
+    fifo_read(rhport, pass->ep->buf, pass->xact_len, false);
   }
+  rcvdav_ack(rhport, pass, false);
+  int_pass_continue(rhport, false);
 
-  if (hirq & HIRQ_CONDET_IRQ) {
-    handle_connect_irq(rhport, in_isr);
+  max3421_session_end(rhport, false);
+}
+
+// Return true if RCVFIFO read is submitted to the asynchronous backend
+static bool rcvfifo_read_async(uint8_t rhport, int_pass_t* pass, bool in_isr) {
+  // completion locks the bus from backend's thread, not possible when the pass runs in ISR
+  if (in_isr || pass->xact_len < CFG_TUH_MAX3421_SPI_ASYNC_MIN) return false;
+
+  tuh_max3421_spi_xact_t* xact = &_hcd_data.spi_xact;
+  xact->cmd = RCVVFIFO_ADDR;
+  xact->status = 0;
+  xact->len = pass->xact_len;
+  xact->tx_buf = NULL;
+  xact->rx_buf = pass->ep->buf;
+  xact->complete_cb = rcvfifo_complete;
+
+  // set before submit: completion can run at once on another core
+  _hcd_data.spi_async_pending = true;
+  if (!tuh_max3421_spi_submit_api(rhport, xact)) {
+    _hcd_data.spi_async_pending = false;
+    return false;
   }
 
+  _hcd_data.stats.spi_xact++;
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Interrupt Pass
+//--------------------------------------------------------------------+
+
+// Service RCVDAV and HXFRDN until none is pending, then ack the rest. Returns early if a RCVFIFO read is submitted
+// asynchronously
+static void int_pass_continue(uint8_t rhport, bool in_isr) {
+  int_pass_t* const pass = &_hcd_data.pass;
+
   // queue more transfer in handle_xfer_done() can cause hirq to be set again while external IRQ may not catch and/or
   // not call this handler again. So we need to loop until all IRQ are cleared
-  while ( hirq & (HIRQ_RCVDAV_IRQ | HIRQ_HXFRDN_IRQ) ) {
-    if ( hirq & HIRQ_RCVDAV_IRQ ) {
-      uint8_t const ep_num = _hcd_data.hxfr & HXFR_EPNUM_MASK;
-      max3421_ep_t *ep = find_opened_ep(_hcd_data.peraddr, ep_num, 1);
-      uint8_t xact_len = 0;
+  while ( pass->hirq & (HIRQ_RCVDAV_IRQ | HIRQ_HXFRDN_IRQ) ) {
+    if ( !pass->rcvdav ) {
+      // IRQs to ack in this pass except SNDBAV_IRQ (never clear by us). RCVDAV_IRQ is acked after reading fifo
+      pass->ack = pass->hirq & (uint8_t) ~(HIRQ_SNDBAV_IRQ | HIRQ_RCVDAV_IRQ);
+      pass->hxfrdn_acked = false;
+      pass->hrsl_valid = false;
+      pass->hrsl = 0;
+      pass->xact_len = 0;
+
+      if ( pass->hirq & HIRQ_RCVDAV_IRQ ) {
+        uint8_t const ep_num = _hcd_data.hxfr & HXFR_EPNUM_MASK;
+        pass->ep = find_opened_ep(_hcd_data.peraddr, ep_num, 1);
+        pass->rcvdav = true;
+      }
+    }
+
+    if ( pass->rcvdav ) {
+      max3421_ep_t* ep = pass->ep;
 
       // RCVDAV_IRQ can trigger 2 times (dual buffered)
-      while ( hirq & HIRQ_RCVDAV_IRQ ) {
+      while ( pass->hirq & HIRQ_RCVDAV_IRQ ) {
         uint8_t rcvbc = reg_read(rhport, RCVBC_ADDR, in_isr);
-        xact_len = (uint8_t) tu_min16(rcvbc, ep->total_len - ep->xferred_len);
-        if ( xact_len ) {
-          fifo_read(rhport, ep->buf, xact_len, in_isr);
-          ep->buf += xact_len;
-          ep->xferred_len += xact_len;
+        pass->xact_len = (uint8_t) tu_min16(rcvbc, ep->total_len - ep->xferred_len);
+        if ( pass->xact_len ) {
+          if ( rcvfifo_read_async(rhport, pass, in_isr) ) return;
+          fifo_read(rhport, ep->buf, pass->xact_len, in_isr);
         }
-
-        // ack RCVDVAV IRQ
-        hirq_write(rhport, HIRQ_RCVDAV_IRQ, in_isr);
-        hirq = reg_read(rhport, HIRQ_ADDR, in_isr);
+        rcvdav_ack(rhport, pass, in_isr);
       }
+      pass->rcvdav = false;
 
-      if ( xact_len < ep->packet_size || ep->xferred_len >= ep->total_len ) {
+      if ( pass->xact_len < ep->packet_size || ep->xferred_len >= ep->total_len ) {
         ep->xfer_complete = 1;
       }
     }
 
-    if ( hirq & HIRQ_HXFRDN_IRQ ) {
-      hirq_write(rhport, HIRQ_HXFRDN_IRQ, in_isr);
-      handle_xfer_done(rhport, in_isr);
+    if ( pass->hirq & HIRQ_HXFRDN_IRQ ) {
+      if ( !pass->hrsl_valid ) {
+        hirq_write(rhport, pass->ack | HIRQ_HXFRDN_IRQ, in_isr);
+        pass->ack = 0;
+        pass->hrsl = reg_read(rhport, HRSL_ADDR, in_isr);
+      }
+      _hcd_data.stats.usb_xact++;
+      handle_xfer_done(rhport, pass->hrsl, in_isr);
     }
 
-    hirq = reg_read(rhport, HIRQ_ADDR, in_isr);
+    // HIRQ returned by the last transaction
+    pass->hirq = _hcd_data.hirq & _hcd_data.hien;
   }
 
   // clear all interrupt except SNDBAV_IRQ (never clear by us). Note RCVDAV_IRQ, HXFRDN_IRQ already clear while processing
-  hirq &= (uint8_t) ~HIRQ_SNDBAV_IRQ;
+  uint8_t const hirq = pass->hirq & (uint8_t) ~HIRQ_SNDBAV_IRQ;
   if ( hirq ) {
     hirq_write(rhport, hirq, in_isr);
   }
 }
 
+// Service pending IRQs, called within a session
+static void int_service(uint8_t rhport, bool in_isr) {
+  uint8_t hirq = hirq_read(rhport, in_isr) & _hcd_data.hien;
+//  print_hirq(hirq);
+
+  // new frame: counted by FRAME_IRQ, or by the timer (lazy frame, also when woken up without IRQ)
+  bool frame_tick;
+  if (_hcd_data.lazy_frame) {
+    frame_tick = frame_advance(rhport, hirq & HIRQ_FRAME_IRQ) || _hcd_data.frame_tick;
+    _hcd_data.frame_tick = false;
+  } else {
+    frame_tick = (hirq & HIRQ_FRAME_IRQ) != 0;
+    if (frame_tick) {
+      _hcd_data.frame_count++;
+    }
+  }
+
+  if (!hirq && !frame_tick) return;
+
+  if (hirq & HIRQ_CONDET_IRQ) {
+    handle_connect_irq(rhport, in_isr);
+  }
+
+  if (frame_tick) {
+    sched_frame(rhport, in_isr);
+  }
+
+  // SPI transactions are batched to as few chip-select windows as possible:
+  // - all pending IRQs are acked with a single HIRQ write per pass
+  // - HIRQ is not read separately but taken from the status byte of the following HRSL read,
+  //   or of the last transaction in the pass
+  // - HRSL is read once and passed to handle_xfer_done()
+  _hcd_data.pass.hirq = hirq;
+  _hcd_data.pass.rcvdav = false;
+  int_pass_continue(rhport, in_isr);
+}
+
+// ESP32 out-of-sync
+#if defined(ARDUINO_ARCH_ESP32) && ESP_ARDUINO_VERSION < 0x02000E && !defined(PLATFORMIO)
+void hcd_int_handler_esp32(uint8_t rhport, bool in_isr) {
+#else
+// Interrupt handler
+void hcd_int_handler(uint8_t rhport, bool in_isr) {
+#endif
+  // pass is resumed when the asynchronous RCVFIFO read completes
+  if (_hcd_data.spi_async_pending) return;
+
+  _hcd_data.stats.int_count++;
+
+  // SPI bus is locked once for the whole pass
+  max3421_session_begin(rhport, in_isr);
+  int_service(rhport, in_isr);
+  max3421_session_end(rhport, in_isr);
+
+  if (in_isr) {
+    // no session in isr
+    frame_wait_update(rhport, true);
+  }
+}
+
 #endif
@@ -51,6 +51,10 @@
 
   // Note: For platformio prioritize this file over the one in BSP in all cases
 
+#elif defined(TUSB_NATIVE)
+  // PC build with software MAX3421E (pio test -e native)
+  #include "arduino/ports/native/tusb_config_native.h"
+
 #else
   #error TinyUSB Arduino Library does not support your core yet
 #endif
@@ -444,6 +444,23 @@
   #define CFG_TUH_HUB    0
 #endif
 
+// Number of devices enumerated concurrently, each has its own CFG_TUH_ENUMERATION_BUFSIZE buffer.
+// Only devices behind a hub can be attached at the same time
+#ifndef CFG_TUH_ENUMERATION_MAX
+  #define CFG_TUH_ENUMERATION_MAX (CFG_TUH_HUB ? CFG_TUH_DEVICE_MAX : 1)
+#endif
+
+// Take configuration and HID report descriptors of a re-plugged device from the application
+// (tuh_descriptor_cache_load_cb) instead of reading them again, and shorten its attach debounce
+#ifndef CFG_TUH_DESC_CACHE
+  #define CFG_TUH_DESC_CACHE 0
+#endif
+
+// Characters of the serial number string kept in the descriptor cache key, longer ones are truncated
+#ifndef CFG_TUH_DESC_CACHE_SERIAL_MAX
+  #define CFG_TUH_DESC_CACHE_SERIAL_MAX 32
+#endif
+
 #ifndef CFG_TUH_CDC
   #define CFG_TUH_CDC    0
 #endif
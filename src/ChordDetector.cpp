@@ -0,0 +1,98 @@
+#include "ChordDetector.h"
+
+// HIDキーボードレポートの構成
+// [0]: 修飾キー（bit0-3: 左Ctrl/Shift/Alt/GUI, bit4-7: 右Ctrl/Shift/Alt/GUI）
+// [1]: 予約
+// [2]-[7]: 押されているキーコード（最大6個）
+#define REPORT_LEN 8
+#define KEYCODE_ERROR_ROLLOVER 0x01
+
+ChordDetector::ChordDetector() {
+    chordCount = 0;
+    activeMask = 0;
+    heldMask = 0;
+    memset(firstChordByKey, -1, sizeof(firstChordByKey));
+    memset(pressTime, 0, sizeof(pressTime));
+    memset(lastReport, 0, sizeof(lastReport));
+}
+
+int ChordDetector::addChord(uint8_t modifiers, uint8_t keycode, ChordHandler handler, uint32_t hold_ms) {
+    if (chordCount >= CHORD_MAX || handler == NULL) {
+        return -1;
+    }
+
+    int idx = chordCount++;
+    Chord &chord = chords[idx];
+    chord.modifiers = modifiers;
+    chord.keycode = keycode;
+    chord.handler = handler;
+    chord.hold_ms = hold_ms;
+
+    // 同じキーコードのリストの先頭に追加
+    chord.next = firstChordByKey[keycode];
+    firstChordByKey[keycode] = (int8_t)idx;
+
+    return idx;
+}
+
+void ChordDetector::update(const uint8_t *report, uint32_t now_ms) {
+    if (memcmp(report, lastReport, REPORT_LEN) != 0) {
+        memcpy(lastReport, report, REPORT_LEN);
+
+        // ロールオーバーエラー（同時押し過多）の場合は状態を維持する
+        if (report[2] == KEYCODE_ERROR_ROLLOVER) {
+            return;
+        }
+
+        // 左右の修飾キーをまとめる
+        uint8_t const mods = (report[0] | (report[0] >> 4)) & 0x0F;
+
+        // 押されているキーに登録されたホットキーのみを調べる
+        uint32_t newMask = 0;
+        for (uint8_t i = 2; i < REPORT_LEN; i++) {
+            uint8_t const keycode = report[i];
+            if (keycode == 0x00) {
+                continue;
+            }
+            for (int8_t idx = firstChordByKey[keycode]; idx >= 0; idx = chords[idx].next) {
+                if (chords[idx].modifiers == mods) {
+                    newMask |= (1UL << idx);
+                }
+            }
+        }
+
+        uint32_t released = activeMask & ~newMask;
+        uint32_t pressed = newMask & ~activeMask;
+        activeMask = newMask;
+
+        while (released) {
+            int idx = __builtin_ctz(released);
+            released &= released - 1;
+            heldMask &= ~(1UL << idx);
+            chords[idx].handler(CHORD_RELEASE);
+        }
+
+        while (pressed) {
+            int idx = __builtin_ctz(pressed);
+            pressed &= pressed - 1;
+            pressTime[idx] = now_ms;
+            // 長押しイベントのないホットキーは通知済みとして扱う
+            if (chords[idx].hold_ms == 0) {
+                heldMask |= (1UL << idx);
+            }
+            chords[idx].handler(CHORD_PRESS);
+        }
+    }
+
+    // 長押し判定（押されていて未通知のホットキーのみ）
+    uint32_t waiting = activeMask & ~heldMask;
+    while (waiting) {
+        int idx = __builtin_ctz(waiting);
+        waiting &= waiting - 1;
+        Chord &chord = chords[idx];
+        if ((now_ms - pressTime[idx]) >= chord.hold_ms) {
+            heldMask |= (1UL << idx);
+            chord.handler(CHORD_HOLD);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef CHORD_DETECTOR_H
+#define CHORD_DETECTOR_H
+
+#include <Arduino.h>
+
+// 修飾キー（左右のキーは区別しない）
+enum ChordModifier : uint8_t {
+    CHORD_MOD_NONE  = 0x00,
+    CHORD_MOD_CTRL  = 0x01,
+    CHORD_MOD_SHIFT = 0x02,
+    CHORD_MOD_ALT   = 0x04,
+    CHORD_MOD_GUI   = 0x08
+};
+
+// ホットキーのイベント
+enum ChordEvent {
+    CHORD_PRESS,    // 押された
+    CHORD_RELEASE,  // 離された
+    CHORD_HOLD      // 押し続けられた（登録時のhold_ms経過後に1回）
+};
+
+typedef void (*ChordHandler)(ChordEvent event);
+
+// 登録できるホットキーの最大数（アクティブ状態をビットマスクで管理するため32以下）
+#define CHORD_MAX 32
+
+// HIDキーボードレポートからホットキー（修飾キー+キー）を検出するクラス
+// 各ホットキーについて、押下・解放・長押しのイベントをエッジごとに1回だけ通知する
+class ChordDetector {
+public:
+    ChordDetector();
+
+    // ホットキーを登録
+    // modifiers: ChordModifierの組み合わせ（完全一致で判定）
+    // hold_ms: 長押しイベントまでの時間（0の場合は長押しイベントなし）
+    // 戻り値: 登録番号（登録できない場合は-1）
+    int addChord(uint8_t modifiers, uint8_t keycode, ChordHandler handler, uint32_t hold_ms = 0);
+
+    // HIDレポート（8バイト）を入力し、変化があったホットキーのハンドラを呼び出す
+    void update(const uint8_t *report, uint32_t now_ms);
+
+    // いずれかのホットキーが押されているか
+    bool isAnyActive() const { return activeMask != 0; }
+
+private:
+    struct Chord {
+        uint8_t modifiers;
+        uint8_t keycode;
+        int8_t next;            // 同じキーコードを持つ次のホットキー（-1で終端）
+        ChordHandler handler;
+        uint32_t hold_ms;
+    };
+
+    Chord chords[CHORD_MAX];
+    uint8_t chordCount;
+
+    // キーコードから最初のホットキーへの索引（-1で登録なし）
+    // レポートごとの処理量を登録数に依存させないためのもの
+    int8_t firstChordByKey[256];
+
+    uint32_t activeMask;  // 現在押されているホットキー
+    uint32_t heldMask;    // 長押しイベント通知済みのホットキー
+    uint32_t pressTime[CHORD_MAX];
+
+    uint8_t lastReport[8];
+};
+
+#endif // CHORD_DETECTOR_H
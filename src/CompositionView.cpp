@@ -0,0 +1,71 @@
+#include "CompositionView.h"
+
+CompositionView::CompositionView() {
+    cellNum = 0;
+    tailCol = 0;
+}
+
+void CompositionView::clearMainArea() {
+    M5.Lcd.setClipRect(0, 0, M5.Lcd.width(), COMPOSITION_VIEW_Y);
+    M5.Lcd.fillRect(0, 0, M5.Lcd.width(), COMPOSITION_VIEW_Y, TFT_BLACK);
+}
+
+void CompositionView::append(const KanaUnit &unit) {
+    uint8_t const cols = unit.glyphs();
+    if (tailCol + cols > COMPOSITION_COLS) {
+        // 行に収まらない場合は行を消去して先頭から表示する
+        clearCols(0, tailCol);
+        cellNum = 0;
+        tailCol = 0;
+    }
+    drawUnit(unit, tailCol);
+    cellCol[cellNum++] = tailCol;
+    tailCol += cols;
+}
+
+void CompositionView::removeLast(const KanaBuffer &buffer) {
+    if (cellNum == 0) {
+        return;
+    }
+    uint8_t const col = cellCol[--cellNum];
+    clearCols(col, tailCol);
+    tailCol = col;
+
+    if (cellNum == 0 && !buffer.empty()) {
+        // 行が空になった場合は前の行を表示する
+        redraw(buffer);
+    }
+}
+
+void CompositionView::redraw(const KanaBuffer &buffer) {
+    clearCols(0, COMPOSITION_COLS);
+    cellNum = 0;
+    tailCol = 0;
+
+    // 行に収まる末尾のかなから表示する
+    uint8_t first = buffer.size();
+    uint8_t cols = 0;
+    while (first > 0 && cols + buffer.at(first - 1).glyphs() <= COMPOSITION_COLS) {
+        first--;
+        cols += buffer.at(first).glyphs();
+    }
+    for (uint8_t i = first; i < buffer.size(); i++) {
+        append(buffer.at(i));
+    }
+}
+
+void CompositionView::drawUnit(const KanaUnit &unit, uint8_t col) {
+    M5.Lcd.clearClipRect();
+    M5.Lcd.setTextSize(2);
+    M5.Lcd.setCursor(col * COMPOSITION_CELL_W, COMPOSITION_VIEW_Y);
+    M5.Lcd.printf("%s", unit.kana());
+}
+
+void CompositionView::clearCols(uint8_t from, uint8_t to) {
+    if (from >= to) {
+        return;
+    }
+    M5.Lcd.clearClipRect();
+    M5.Lcd.fillRect(from * COMPOSITION_CELL_W, COMPOSITION_VIEW_Y, (to - from) * COMPOSITION_CELL_W,
+                    COMPOSITION_CELL_H, TFT_BLACK);
+}
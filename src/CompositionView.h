@@ -0,0 +1,40 @@
+#ifndef COMPOSITION_VIEW_H
+#define COMPOSITION_VIEW_H
+
+#include <M5Unified.h>
+#include "KanaBuffer.h"
+
+// 確定済みかなを表示する行（画面下端）
+#define COMPOSITION_VIEW_Y  208  // 行のy座標（これより上がメイン表示領域）
+#define COMPOSITION_CELL_W  32   // 1文字の幅（efontJA_16を2倍で表示）
+#define COMPOSITION_CELL_H  32   // 1文字の高さ
+#define COMPOSITION_COLS    10   // 1行の文字数
+
+// 確定済みかなを画面下端に表示するクラス
+// 末尾への追加・末尾からの削除では、変化した文字の位置のみを描画する
+class CompositionView {
+public:
+    CompositionView();
+
+    // メイン表示領域（確定済みかなの行より上）を消去し、以降の描画をメイン表示領域に制限する
+    void clearMainArea();
+
+    // バッファの末尾に追加されたかなを描画
+    void append(const KanaUnit &unit);
+
+    // バッファの末尾から削除されたかなを消去（bufferは削除後のバッファ）
+    void removeLast(const KanaBuffer &buffer);
+
+    // 行全体を描画し直す（画面全体を消去した後など）
+    void redraw(const KanaBuffer &buffer);
+
+private:
+    void drawUnit(const KanaUnit &unit, uint8_t col);
+    void clearCols(uint8_t from, uint8_t to);
+
+    uint8_t cellCol[COMPOSITION_COLS];  // 表示中の各かなの開始位置
+    uint8_t cellNum;                    // 表示中のかなの数
+    uint8_t tailCol;                    // 次のかなの開始位置
+};
+
+#endif // COMPOSITION_VIEW_H
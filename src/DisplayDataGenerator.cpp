@@ -1,20 +1,134 @@
 #include "DisplayDataGenerator.h"
+#include "LatencyTracer.h"
 
 
 
-// キーコードと文字の対応表
-char keycode_to_char_AtoZ[] = {
-    'A', 'B', 'C', 'D', 'E', 'F', 'G',
-    'H', 'I', 'J', 'K', 'L', 'M', 'N',
-    'O', 'P', 'Q', 'R', 'S', 'T', 'U',
-    'V', 'W', 'X', 'Y', 'Z'
+// キーボード配列（キーコード+Shift → 文字）
+static KeyLayout key_layout;
+
+// 文字（0x21〜0x7E）ごとの音声ファイル名（/<名前>.wav）
+// アルファベット・数字はその文字、記号は名前
+static const char *const char_clip_names[] = {
+    "exclamation", "quote", "hash", "dollar", "percent", "ampersand", "apostrophe",   // ! " # $ % & '
+    "lparen", "rparen", "asterisk", "plus", "comma", "minus", "period", "slash",      // ( ) * + , - . /
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9",                                 // 0-9
+    "colon", "semicolon", "less", "equal", "greater", "question", "at",               // : ; < = > ? @
+    "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M",                  // A-M
+    "N", "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z",                  // N-Z
+    "lbracket", "backslash", "rbracket", "caret", "underscore", "backquote",          // [ \ ] ^ _ `
+    "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m",                  // a-m
+    "n", "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z",                  // n-z
+    "lbrace", "bar", "rbrace", "tilde"                                                // { | } ~
+};
+
+static_assert(sizeof(char_clip_names) / sizeof(char_clip_names[0]) == 0x7E - 0x21 + 1, "char_clip_names must cover 0x21-0x7E");
+
+// 文字以外のキーの表示スタイル
+enum KeyStyle : uint8_t {
+    KEY_STYLE_CHAR,     // 1文字（大）
+    KEY_STYLE_WORD,     // 5文字程度までの単語
+    KEY_STYLE_LONG,     // 長い単語
+    KEY_STYLE_ARROW     // 矢印（特大）
 };
 
-char keycode_to_char_number[] = {
-    '1', '2', '3', '4', '5', '6', '7',
-    '8', '9', '0'
+struct KeyStyleParam {
+    int font_size;
+    int x;
+    int y;
+};
+
+// KeyStyleごとの表示位置・サイズ
+static const KeyStyleParam key_style_params[] = {
+    {15, 90, -20},  // KEY_STYLE_CHAR
+    {6, 20, 70},    // KEY_STYLE_WORD
+    {4, 10, 80},    // KEY_STYLE_LONG
+    {17, 90, -20},  // KEY_STYLE_ARROW
+};
+
+// 文字以外のキー（キーボード配列で文字が決まらないキー）
+struct SpecialKey {
+    uint8_t keycode;
+    KeyStyle style;
+    const char *label;  // 表示
+    const char *clip;   // 音声ファイル名（/<名前>.wav）
+};
+
+static constexpr SpecialKey special_keys[] = {
+    {0x28, KEY_STYLE_WORD, "Enter", "Enter"},
+    {0x29, KEY_STYLE_WORD, "Esc", "Escape"},
+    {0x2A, KEY_STYLE_LONG, "BackSpace", "BackSpace"},
+    {0x2B, KEY_STYLE_WORD, "Tab", "Tab"},
+    {0x2C, KEY_STYLE_WORD, "Space", "Space"},
+    {0x35, KEY_STYLE_WORD, "全角", "Zenkaku"},  // JIS配列の半角/全角
+    {0x39, KEY_STYLE_WORD, "Caps", "CapsLock"},
+    {0x3A, KEY_STYLE_WORD, "F1", "F1"},
+    {0x3B, KEY_STYLE_WORD, "F2", "F2"},
+    {0x3C, KEY_STYLE_WORD, "F3", "F3"},
+    {0x3D, KEY_STYLE_WORD, "F4", "F4"},
+    {0x3E, KEY_STYLE_WORD, "F5", "F5"},
+    {0x3F, KEY_STYLE_WORD, "F6", "F6"},
+    {0x40, KEY_STYLE_WORD, "F7", "F7"},
+    {0x41, KEY_STYLE_WORD, "F8", "F8"},
+    {0x42, KEY_STYLE_WORD, "F9", "F9"},
+    {0x43, KEY_STYLE_WORD, "F10", "F10"},
+    {0x44, KEY_STYLE_WORD, "F11", "F11"},
+    {0x45, KEY_STYLE_WORD, "F12", "F12"},
+    {0x46, KEY_STYLE_WORD, "PrtSc", "PrintScreen"},
+    {0x47, KEY_STYLE_WORD, "ScrLk", "ScrollLock"},
+    {0x48, KEY_STYLE_WORD, "Pause", "Pause"},
+    {0x49, KEY_STYLE_WORD, "Ins", "Insert"},
+    {0x4A, KEY_STYLE_WORD, "Home", "Home"},
+    {0x4B, KEY_STYLE_WORD, "PgUp", "PageUp"},
+    {0x4C, KEY_STYLE_WORD, "Del", "Delete"},
+    {0x4D, KEY_STYLE_WORD, "End", "End"},
+    {0x4E, KEY_STYLE_WORD, "PgDn", "PageDown"},
+    {0x4F, KEY_STYLE_ARROW, "→", "RA"},
+    {0x50, KEY_STYLE_ARROW, "←", "LA"},
+    {0x51, KEY_STYLE_ARROW, "↓", "DA"},
+    {0x52, KEY_STYLE_ARROW, "↑", "UA"},
+    {0x53, KEY_STYLE_WORD, "NumLk", "NumLock"},
+    {0x58, KEY_STYLE_WORD, "Enter", "Enter"},  // テンキーのEnter
+    {0x65, KEY_STYLE_WORD, "Menu", "Menu"},
+    {0x68, KEY_STYLE_WORD, "F13", "F13"},
+    {0x69, KEY_STYLE_WORD, "F14", "F14"},
+    {0x6A, KEY_STYLE_WORD, "F15", "F15"},
+    {0x6B, KEY_STYLE_WORD, "F16", "F16"},
+    {0x6C, KEY_STYLE_WORD, "F17", "F17"},
+    {0x6D, KEY_STYLE_WORD, "F18", "F18"},
+    {0x6E, KEY_STYLE_WORD, "F19", "F19"},
+    {0x6F, KEY_STYLE_WORD, "F20", "F20"},
+    {0x70, KEY_STYLE_WORD, "F21", "F21"},
+    {0x71, KEY_STYLE_WORD, "F22", "F22"},
+    {0x72, KEY_STYLE_WORD, "F23", "F23"},
+    {0x73, KEY_STYLE_WORD, "F24", "F24"},
+    {0x88, KEY_STYLE_WORD, "かな", "Kana"},      // JIS配列のカタカナ/ひらがな
+    {0x8A, KEY_STYLE_WORD, "変換", "Henkan"},
+    {0x8B, KEY_STYLE_WORD, "無変換", "Muhenkan"},
+};
+
+#define SPECIAL_KEY_NUM (sizeof(special_keys) / sizeof(special_keys[0]))
+#define SPECIAL_KEY_NONE 0xFF
+
+static_assert(SPECIAL_KEY_NUM < SPECIAL_KEY_NONE, "too many special keys");
+
+// キーコード → special_keysの番号（コンパイル時に生成）
+struct SpecialKeyIndex {
+    uint8_t idx[256];
 };
 
+constexpr SpecialKeyIndex build_special_key_index() {
+    SpecialKeyIndex index = {};
+    for (int i = 0; i < 256; i++) {
+        index.idx[i] = SPECIAL_KEY_NONE;
+    }
+    for (size_t n = 0; n < SPECIAL_KEY_NUM; n++) {
+        index.idx[special_keys[n].keycode] = (uint8_t)n;
+    }
+    return index;
+}
+
+static constexpr SpecialKeyIndex special_key_index = build_special_key_index();
+
 // #define DEBUG_LCD
 
 void play_wav(String wav_path){
@@ -39,11 +153,16 @@ void play_wav(String wav_path){
     uint8_t *wav_Buffer = (uint8_t*)malloc(wav_fileSize);
     f.read(wav_Buffer, wav_fileSize);
     f.close();
+    trace_mark(TRACE_SD_READ);
     M5.Speaker.playWav(wav_Buffer);
+    trace_mark(TRACE_SPK_START);
 
 }
 
 
+// カタカナ音声（/katakana/*.wav）がSDにあるか（起動時に1回だけ確認）
+static bool katakana_voice_bank = false;
+
 void spk_SD_setup(){
     { /// I2S Custom configurations are available if you desire.
         auto spk_cfg = M5.Speaker.config();
@@ -58,6 +177,8 @@ void spk_SD_setup(){
     //SDマウント
     SD.begin(GPIO_NUM_4, SPI, 25000000);
 
+    //カタカナ音声の有無を確認（キー入力ごとには確認しない）
+    katakana_voice_bank = SD.exists("/katakana");
 
 }
 
@@ -68,95 +189,55 @@ void set_volume(uint8_t v){
     M5.Lcd.println("volume: "+String(v));
 }
 
+bool load_key_layout(KeyLayoutId id){
+    // 配列ファイルの読み込み（キー入力ごとではなく、配列の切り替え時のみ）
+    String path = String("/layout/") + KeyLayout::name(id) + ".bin";
+    File f = SD.open(path);
+    if (f) {
+        static uint8_t buf[KEY_LAYOUT_FILE_MAX + 1];
+        size_t len = f.read(buf, sizeof(buf));
+        f.close();
+        if (key_layout.loadBinary(id, buf, len)) {
+            return true;
+        }
+    }
+    return key_layout.loadBuiltin(id);
+}
+
+KeyLayoutId get_key_layout(){
+    return key_layout.getId();
+}
+
 // キーコードを文字に変換する関数
-DisplayData convert_keycode_to_DisplayData(int keycode) {
+DisplayData convert_keycode_to_DisplayData(int keycode, uint8_t modifiers) {
     DisplayData ret_val;
-    //アルファベットの場合
-    if (keycode >= 0x04 && keycode <= 0x1d) {
-        ret_val.lcd_str = keycode_to_char_AtoZ[keycode - 0x04];
-        ret_val.wav_path = "/"+ret_val.lcd_str+".wav";
-    }
-    //数値の場合
-    if (keycode >= 0x1E && keycode <= 0x27) {
-        ret_val.lcd_str = keycode_to_char_number[keycode - 0x1E];
-        ret_val.wav_path = "/"+ret_val.lcd_str+".wav";
+    //キーボード配列で文字が決まるキー（アルファベット、数字、記号）の場合
+    char c = key_layout.charOf(keycode, KeyLayout::isShift(modifiers));
+    if (c != '\0') {
+        return convert_char_to_DisplayData(c);
     }
 
-    //特殊な記号の場合
-    //Space, Enter, Ctrl, 矢印, tab, alt, @
-    switch (keycode)
-    {
-      case 0x2c:
-        //space
-        ret_val.lcd_str = "Space";
-        ret_val.font_size = 6;
-        ret_val.x = 20;
-        ret_val.y = 70;
-        ret_val.wav_path = "/"+ret_val.lcd_str+".wav";
-        break;
-      
-      case 0x2b:
-        //tab
-        ret_val.lcd_str = "Tab";
-        ret_val.font_size = 6;
-        ret_val.x = 20;
-        ret_val.y = 70;
-        ret_val.wav_path = "/"+ret_val.lcd_str+".wav";
-        break;
-
-      case 0x28:
-        // Enter
-        ret_val.lcd_str = "Enter";
-        ret_val.font_size = 6;
-        ret_val.x = 20;
-        ret_val.y = 70;
-        ret_val.wav_path = "/"+ret_val.lcd_str+".wav";
-        break;
-        
-      case 0x4f:
-        //→
-        ret_val.lcd_str = "→";
-        ret_val.font_size = 17;
-        ret_val.wav_path = "/RA.wav";
-        break;
-        
-      case 0x50:
-        //←
-        ret_val.lcd_str = "←";
-        ret_val.font_size = 17;
-        ret_val.wav_path = "/LA.wav";
-        break;
-        
-      case 0x51:
-        //↓
-        ret_val.lcd_str = "↓";
-        ret_val.font_size = 17;
-        ret_val.wav_path = "/DA.wav";
-        break;
-        
-      case 0x52:
-        //↑
-        ret_val.lcd_str = "↑";
-        ret_val.font_size = 17;
-        ret_val.wav_path = "/UA.wav";
-        break;
-        
-      case 0x2f:
-        //@
-        ret_val.lcd_str = "@";
-        ret_val.font_size = 6;
-        ret_val.x = 20;
-        ret_val.y = 70;
-        ret_val.wav_path = "/at.wav";
-        break;
-        
-        
-      default:
-        break;
-    
+    //文字以外のキーの場合（Space, Enter, 矢印, ファンクションキーなど）
+    uint8_t idx = special_key_index.idx[keycode & 0xFF];
+    if (idx != SPECIAL_KEY_NONE) {
+        const SpecialKey &key = special_keys[idx];
+        const KeyStyleParam &style = key_style_params[key.style];
+        ret_val.lcd_str = key.label;
+        ret_val.font_size = style.font_size;
+        ret_val.x = style.x;
+        ret_val.y = style.y;
+        ret_val.wav_path = String("/") + key.clip + ".wav";
     }
 
+    return ret_val;
+}
 
+DisplayData convert_char_to_DisplayData(char c) {
+    DisplayData ret_val;
+    if (c >= 0x21 && c <= 0x7E) {
+        ret_val.lcd_str = String(c);
+        ret_val.wav_path = String("/") + char_clip_names[c - 0x21] + ".wav";
+    }
     return ret_val;
 }
 
@@ -171,10 +252,20 @@ DisplayData convert_hiragana_to_DisplayData(String hiragana) {
     return ret_val;
 }
 
-// ローマ字モード用: 子音を中央に表示するDisplayData生成
-DisplayData create_consonant_display_data(char consonant) {
+// カタカナモード用: カタカナからDisplayDataへの変換（中央表示）
+DisplayData convert_katakana_to_DisplayData(String katakana, String hiragana) {
+    DisplayData ret_val = convert_hiragana_to_DisplayData(hiragana);
+    ret_val.lcd_str = katakana;
+    if (katakana_voice_bank) {
+        ret_val.wav_path = "/katakana/" + katakana + ".wav";
+    }
+    return ret_val;
+}
+
+// ローマ字モード用: 入力途中のローマ字（子音）を中央に表示するDisplayData生成
+DisplayData create_consonant_display_data(String romaji) {
     DisplayData ret_val;
-    ret_val.lcd_str = String(consonant);
+    ret_val.lcd_str = romaji;
     ret_val.font_size = 7;  // 小さめのサイズ
     ret_val.x = 90;  // 中央
     ret_val.y = 50;  // 画面中央より少し下
@@ -193,11 +284,30 @@ DisplayData create_romaji_display_data(String romaji) {
     return ret_val;
 }
 
+// キーボード配列表示用のDisplayData生成
+DisplayData create_layout_display_data(KeyLayoutId id) {
+    DisplayData ret_val;
+    if (id == LAYOUT_US) {
+        ret_val.lcd_str = "US配列";
+    } else if (id == LAYOUT_JIS) {
+        ret_val.lcd_str = "JIS配列";
+    } else {
+        ret_val.lcd_str = "ユーザー定義配列";
+    }
+    ret_val.font_size = 2;
+    ret_val.x = 10;
+    ret_val.y = 10;
+    ret_val.wav_path = "";  // 配列切替時は音声再生なし
+    return ret_val;
+}
+
 // モード表示用のDisplayData生成
-DisplayData create_mode_display_data(bool isRomajiMode) {
+DisplayData create_mode_display_data(InputMode mode) {
     DisplayData ret_val;
-    if (isRomajiMode) {
+    if (mode == MODE_ROMAJI) {
         ret_val.lcd_str = "ローマ字モード";
+    } else if (mode == MODE_KATAKANA) {
+        ret_val.lcd_str = "カタカナモード";
     } else {
         ret_val.lcd_str = "アルファベットモード";
     }
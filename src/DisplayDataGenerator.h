@@ -1,6 +1,8 @@
 
 #include <M5Unified.h>
 #include <SD.h>
+#include "RomajiConverter.h"
+#include "KeyLayout.h"
 
 struct DisplayData{
     String lcd_str = "";
@@ -16,18 +18,36 @@ void play_wav(String wav_path);
 
 void spk_SD_setup();
 
-DisplayData convert_keycode_to_DisplayData(int keycode);
+// キーボード配列を読み込む（SDカードの/layout/<名前>.bin、ない場合は組み込みの配列）
+bool load_key_layout(KeyLayoutId id);
+
+// 現在のキーボード配列
+KeyLayoutId get_key_layout();
+
+// modifiers: HIDレポートの修飾キーのバイト（Shiftの判定に使う）
+DisplayData convert_keycode_to_DisplayData(int keycode, uint8_t modifiers = 0);
+
+// 文字（0x21〜0x7E）からDisplayDataへの変換（キーボード配列を通さない）
+// 入力途中のローマ字の読み上げ用。範囲外の文字は既定値（bell）
+DisplayData convert_char_to_DisplayData(char c);
+
+// キーボード配列表示用のDisplayData生成
+DisplayData create_layout_display_data(KeyLayoutId id);
 
 // ローマ字モード用: ひらがなからDisplayDataへの変換（中央表示）
 DisplayData convert_hiragana_to_DisplayData(String hiragana);
 
-// ローマ字モード用: 子音を中央に表示するDisplayData生成
-DisplayData create_consonant_display_data(char consonant);
+// カタカナモード用: カタカナからDisplayDataへの変換（中央表示）
+// カタカナ音声（/katakana/）がSDにない場合は、同じ読みのひらがなの音声を使う
+DisplayData convert_katakana_to_DisplayData(String katakana, String hiragana);
+
+// ローマ字モード用: 入力途中のローマ字（子音）を中央に表示するDisplayData生成
+DisplayData create_consonant_display_data(String romaji);
 
 // ローマ字モード用: ローマ字を右上に小さく表示するDisplayData生成
 DisplayData create_romaji_display_data(String romaji);
 
 // モード表示用のDisplayData生成
-DisplayData create_mode_display_data(bool isRomajiMode);
+DisplayData create_mode_display_data(InputMode mode);
 
 
@@ -0,0 +1,69 @@
+#include "IdleCommitTimer.h"
+
+IdleCommitTimer::IdleCommitTimer() {
+    timer = NULL;
+    ownerTask = NULL;
+    timeoutUs = 0;
+    deadlineUs = 0;
+    armed = false;
+    fired = false;
+}
+
+void IdleCommitTimer::begin(uint32_t timeout_ms) {
+    ownerTask = xTaskGetCurrentTaskHandle();
+    setTimeout(timeout_ms);
+
+    esp_timer_create_args_t args = {};
+    args.callback = onTimeout;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "idle_commit";
+    esp_timer_create(&args, &timer);
+}
+
+void IdleCommitTimer::setTimeout(uint32_t timeout_ms) {
+    timeoutUs = timeout_ms * 1000;
+}
+
+void IdleCommitTimer::arm() {
+    if (timer == NULL) {
+        return;
+    }
+    esp_timer_stop(timer);  // 停止中の場合はエラーになるが問題ない
+    fired = false;
+    armed = true;
+    deadlineUs = esp_timer_get_time() + timeoutUs;
+    esp_timer_start_once(timer, timeoutUs);
+}
+
+void IdleCommitTimer::cancel() {
+    if (timer == NULL) {
+        return;
+    }
+    armed = false;
+    fired = false;
+    esp_timer_stop(timer);
+}
+
+bool IdleCommitTimer::takeExpired() {
+    if (!fired) {
+        return false;
+    }
+    fired = false;
+
+    // 発火したコールバックが再始動前のタイマーのものだった場合は期限を確認する
+    if (!armed || esp_timer_get_time() < deadlineUs) {
+        return false;
+    }
+    armed = false;
+    return true;
+}
+
+void IdleCommitTimer::onTimeout(void *arg) {
+    // esp_timerタスクから呼ばれる: 状態には触れず、所有タスクを起こすだけ
+    IdleCommitTimer *self = (IdleCommitTimer *)arg;
+    self->fired = true;
+    if (self->ownerTask != NULL) {
+        xTaskNotifyGive(self->ownerTask);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef IDLE_COMMIT_TIMER_H
+#define IDLE_COMMIT_TIMER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// 一定時間キー入力がないことを通知するワンショットタイマー
+// タイマーのコールバックは所有タスクを起こすだけで、入力途中の状態の確定は所有タスクが行う
+// キー入力の処理と確定処理が同じタスクで行われるため、確定がキー入力と競合することはない
+class IdleCommitTimer {
+public:
+    IdleCommitTimer();
+
+    // タイマーを生成（所有タスクから呼び出す）
+    // timeout_ms: 最後のキー入力から確定までの時間
+    void begin(uint32_t timeout_ms);
+
+    // 確定までの時間を変更（次のarm()から有効）
+    void setTimeout(uint32_t timeout_ms);
+
+    // キー入力ごとに呼び出し、タイマーを再始動する
+    void arm();
+
+    // タイマーを停止する（入力途中の状態がなくなった場合など）
+    void cancel();
+
+    // タイムアウトしていればtrueを返す（所有タスクから呼び出す）
+    // タイマーの発火後にキー入力があった場合（期限が延びた場合）はfalse
+    bool takeExpired();
+
+private:
+    static void onTimeout(void *arg);
+
+    esp_timer_handle_t timer;
+    TaskHandle_t ownerTask;
+    uint32_t timeoutUs;
+    int64_t deadlineUs;      // 確定する時刻（esp_timer時刻）
+    bool armed;
+    volatile bool fired;     // タイマーのコールバックで設定
+};
+
+#endif // IDLE_COMMIT_TIMER_H
@@ -0,0 +1,47 @@
+#include "KanaBuffer.h"
+
+const char *KanaUnit::kana() const {
+    return katakana ? RomajiConverter::clipKatakana(clipId) : RomajiConverter::clipKana(clipId);
+}
+
+uint8_t KanaUnit::glyphs() const {
+    // かなはすべてUTF-8で3バイト
+    return strlen(kana()) / 3;
+}
+
+KanaBuffer::KanaBuffer() {
+    clear();
+}
+
+void KanaBuffer::push(const RomajiResult &result, bool katakana) {
+    if (count == KANA_BUFFER_MAX) {
+        // 最も古いかなを捨てる
+        head = (head + 1) % KANA_BUFFER_MAX;
+        count--;
+    }
+    KanaUnit &unit = units[(head + count) % KANA_BUFFER_MAX];
+    unit.clipId = result.clipId;
+    unit.katakana = katakana;
+    strcpy(unit.romaji, result.romaji);
+    count++;
+}
+
+bool KanaBuffer::pop(KanaUnit *unit) {
+    if (count == 0) {
+        return false;
+    }
+    count--;
+    if (unit != NULL) {
+        *unit = units[(head + count) % KANA_BUFFER_MAX];
+    }
+    return true;
+}
+
+const KanaUnit &KanaBuffer::at(uint8_t i) const {
+    return units[(head + i) % KANA_BUFFER_MAX];
+}
+
+void KanaBuffer::clear() {
+    head = 0;
+    count = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef KANA_BUFFER_H
+#define KANA_BUFFER_H
+
+#include <Arduino.h>
+#include "RomajiConverter.h"
+
+// 保持する確定済みかなの最大数（超えた場合は古いものから捨てる）
+#define KANA_BUFFER_MAX 64
+
+// 確定済みかなの1単位（1回の確定で出力されたかな、例: "きゃ"、"っ"）
+struct KanaUnit {
+    uint8_t clipId;                      // 音声クリップの番号
+    bool katakana;                       // カタカナモードで確定したか
+    char romaji[ROMAJI_PREFIX_MAX + 2];  // 確定に使われたローマ字
+
+    // 表示するかな（静的テーブル内の文字列）
+    const char *kana() const;
+
+    // かなの文字数（全角）
+    uint8_t glyphs() const;
+};
+
+// 確定済みかなのバッファ（リングバッファ）
+// 末尾への追加・末尾からの削除はO(1)
+class KanaBuffer {
+public:
+    KanaBuffer();
+
+    // 確定したかなを末尾に追加
+    void push(const RomajiResult &result, bool katakana);
+
+    // 末尾のかなを削除（空の場合はfalse）
+    bool pop(KanaUnit *unit);
+
+    // i番目のかな（0が最も古い）
+    const KanaUnit &at(uint8_t i) const;
+
+    // 末尾のかな（空でないこと）
+    const KanaUnit &back() const { return at(count - 1); }
+
+    uint8_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void clear();
+
+private:
+    KanaUnit units[KANA_BUFFER_MAX];
+    uint8_t head;   // 最も古いかなの位置
+    uint8_t count;
+};
+
+#endif // KANA_BUFFER_H
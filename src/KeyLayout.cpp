@@ -0,0 +1,107 @@
+#include "KeyLayout.h"
+
+static_assert(sizeof(KeyLayoutEntry) == KEY_LAYOUT_ENTRY_SIZE, "KeyLayoutEntry must match the file format");
+
+// アルファベット（表示・読み上げは大文字のみ）
+#define LAYOUT_LETTER(c) {(uint8_t)(0x04 + ((c) - 'A')), (c), (c)}
+
+#define LAYOUT_LETTERS \
+    LAYOUT_LETTER('A'), LAYOUT_LETTER('B'), LAYOUT_LETTER('C'), LAYOUT_LETTER('D'), LAYOUT_LETTER('E'), \
+    LAYOUT_LETTER('F'), LAYOUT_LETTER('G'), LAYOUT_LETTER('H'), LAYOUT_LETTER('I'), LAYOUT_LETTER('J'), \
+    LAYOUT_LETTER('K'), LAYOUT_LETTER('L'), LAYOUT_LETTER('M'), LAYOUT_LETTER('N'), LAYOUT_LETTER('O'), \
+    LAYOUT_LETTER('P'), LAYOUT_LETTER('Q'), LAYOUT_LETTER('R'), LAYOUT_LETTER('S'), LAYOUT_LETTER('T'), \
+    LAYOUT_LETTER('U'), LAYOUT_LETTER('V'), LAYOUT_LETTER('W'), LAYOUT_LETTER('X'), LAYOUT_LETTER('Y'), \
+    LAYOUT_LETTER('Z')
+
+// テンキー（NumLock時、配列によらない）
+#define LAYOUT_KEYPAD \
+    {0x54, '/', '/'}, {0x55, '*', '*'}, {0x56, '-', '-'}, {0x57, '+', '+'}, {0x59, '1', '1'}, \
+    {0x5A, '2', '2'}, {0x5B, '3', '3'}, {0x5C, '4', '4'}, {0x5D, '5', '5'}, {0x5E, '6', '6'}, \
+    {0x5F, '7', '7'}, {0x60, '8', '8'}, {0x61, '9', '9'}, {0x62, '0', '0'}, {0x63, '.', '.'}, \
+    {0x67, '=', '='}, {0x85, ',', ','}
+
+// US配列
+static const KeyLayoutEntry layout_us[] = {
+    LAYOUT_LETTERS,
+    {0x1E, '1', '!'}, {0x1F, '2', '@'}, {0x20, '3', '#'}, {0x21, '4', '$'}, {0x22, '5', '%'},
+    {0x23, '6', '^'}, {0x24, '7', '&'}, {0x25, '8', '*'}, {0x26, '9', '('}, {0x27, '0', ')'},
+    {0x2D, '-', '_'}, {0x2E, '=', '+'}, {0x2F, '[', '{'}, {0x30, ']', '}'}, {0x31, '\\', '|'},
+    {0x32, '#', '~'}, {0x33, ';', ':'}, {0x34, '\'', '"'}, {0x35, '`', '~'}, {0x36, ',', '<'},
+    {0x37, '.', '>'}, {0x38, '/', '?'}, {0x64, '\\', '|'},
+    LAYOUT_KEYPAD,
+};
+
+// JIS配列
+static const KeyLayoutEntry layout_jis[] = {
+    LAYOUT_LETTERS,
+    {0x1E, '1', '!'}, {0x1F, '2', '"'}, {0x20, '3', '#'}, {0x21, '4', '$'}, {0x22, '5', '%'},
+    {0x23, '6', '&'}, {0x24, '7', '\''}, {0x25, '8', '('}, {0x26, '9', ')'}, {0x27, '0', 0},
+    {0x2D, '-', '='}, {0x2E, '^', '~'}, {0x2F, '@', '`'}, {0x30, '[', '{'}, {0x31, ']', '}'},
+    {0x32, ']', '}'}, {0x33, ';', '+'}, {0x34, ':', '*'}, {0x36, ',', '<'}, {0x37, '.', '>'},
+    {0x38, '/', '?'},
+    {0x87, '\\', '_'},  // ろ
+    {0x89, '\\', '|'},  // ￥
+    LAYOUT_KEYPAD,
+};
+
+KeyLayout::KeyLayout() {
+    loadBuiltin(LAYOUT_JIS);
+}
+
+bool KeyLayout::loadBuiltin(KeyLayoutId id) {
+    if (id == LAYOUT_US) {
+        apply(id, layout_us, sizeof(layout_us) / sizeof(layout_us[0]));
+        return true;
+    }
+    if (id == LAYOUT_JIS) {
+        apply(id, layout_jis, sizeof(layout_jis) / sizeof(layout_jis[0]));
+        return true;
+    }
+    return false;  // ユーザー定義の配列は組み込みなし
+}
+
+bool KeyLayout::loadBinary(KeyLayoutId id, const uint8_t *data, size_t len) {
+    if (len < KEY_LAYOUT_HEADER_SIZE || data[0] != KEY_LAYOUT_MAGIC0 || data[1] != KEY_LAYOUT_MAGIC1 ||
+        data[2] != KEY_LAYOUT_VERSION) {
+        return false;
+    }
+    size_t const num = data[3];
+    if (len != KEY_LAYOUT_HEADER_SIZE + num * KEY_LAYOUT_ENTRY_SIZE) {
+        return false;
+    }
+
+    // すべてのエントリを確認してから展開する
+    const KeyLayoutEntry *entries = (const KeyLayoutEntry *)(data + KEY_LAYOUT_HEADER_SIZE);
+    for (size_t i = 0; i < num; i++) {
+        uint8_t const c[2] = {entries[i].normal, entries[i].shifted};
+        for (uint8_t j = 0; j < 2; j++) {
+            if (c[j] != 0 && (c[j] < 0x21 || c[j] > 0x7E)) {
+                return false;
+            }
+        }
+    }
+    apply(id, entries, num);
+    return true;
+}
+
+const char *KeyLayout::name(KeyLayoutId id) {
+    switch (id) {
+        case LAYOUT_US:
+            return "us";
+        case LAYOUT_JIS:
+            return "jis";
+        case LAYOUT_USER:
+            return "user";
+        default:
+            return "";
+    }
+}
+
+void KeyLayout::apply(KeyLayoutId id, const KeyLayoutEntry *entries, size_t num) {
+    memset(map, 0, sizeof(map));
+    for (size_t i = 0; i < num; i++) {
+        map[entries[i].keycode][0] = entries[i].normal;
+        map[entries[i].keycode][1] = entries[i].shifted;
+    }
+    this->id = id;
+}
@@ -0,0 +1,62 @@
+#ifndef KEY_LAYOUT_H
+#define KEY_LAYOUT_H
+
+#include <Arduino.h>
+
+// キーボード配列
+enum KeyLayoutId {
+    LAYOUT_US,      // US配列
+    LAYOUT_JIS,     // JIS配列
+    LAYOUT_USER,    // ユーザー定義（SDカードの/layout/user.binのみ）
+    LAYOUT_NUM
+};
+
+// 配列ファイル（/layout/us.bin, /layout/jis.bin, /layout/user.bin）の形式
+//   ヘッダ（4バイト）: 'K', 'L', バージョン(1), エントリ数N
+//   エントリ（3バイト x N）: キーコード, 文字（Shiftなし）, 文字（Shiftあり）
+//   文字は表示可能なASCII（0x21〜0x7E）、0は文字なし
+#define KEY_LAYOUT_MAGIC0       'K'
+#define KEY_LAYOUT_MAGIC1       'L'
+#define KEY_LAYOUT_VERSION      1
+#define KEY_LAYOUT_HEADER_SIZE  4
+#define KEY_LAYOUT_ENTRY_SIZE   3
+#define KEY_LAYOUT_FILE_MAX     (KEY_LAYOUT_HEADER_SIZE + 255 * KEY_LAYOUT_ENTRY_SIZE)
+
+// 配列の1エントリ（配列ファイルのエントリと同じ形式）
+struct KeyLayoutEntry {
+    uint8_t keycode;
+    uint8_t normal;     // Shiftなし
+    uint8_t shifted;    // Shiftあり
+};
+
+// キーコード+Shift → 文字 の対応表
+// 配列の読み込み時に 256 x 2 の表に展開し、キー入力ごとの変換は表の参照1回で行う
+class KeyLayout {
+public:
+    KeyLayout();
+
+    // 組み込みの配列（US/JIS）を読み込む
+    bool loadBuiltin(KeyLayoutId id);
+
+    // 配列ファイルの内容を読み込む（形式が正しくない場合はfalseを返し、現在の配列を維持する）
+    bool loadBinary(KeyLayoutId id, const uint8_t *data, size_t len);
+
+    // キーコードに対応する文字（文字がない場合は'\0'）
+    char charOf(uint8_t keycode, bool shift) const { return (char)map[keycode][shift ? 1 : 0]; }
+
+    KeyLayoutId getId() const { return id; }
+
+    // 配列の名前（"us", "jis", "user"、配列ファイル名に使う）
+    static const char *name(KeyLayoutId id);
+
+    // HIDレポートの修飾キーのバイトからShiftの状態を取得
+    static bool isShift(uint8_t modifiers) { return (modifiers & 0x22) != 0; }
+
+private:
+    void apply(KeyLayoutId id, const KeyLayoutEntry *entries, size_t num);
+
+    uint8_t map[256][2];
+    KeyLayoutId id;
+};
+
+#endif // KEY_LAYOUT_H
@@ -0,0 +1,188 @@
+#include "LatencyTracer.h"
+
+#ifdef LATENCY_TRACE
+
+#include <esp_timer.h>
+
+// CPUサイクルカウンタ(CCOUNT)はコアごとに独立しており、USBホスト処理（コア1）と
+// main_task（コア0）の間で比較できないため、全コア共通のesp_timerを時刻源とする
+
+static TraceRecord trace_buf[TRACE_BUF_SIZE];
+static uint16_t trace_head = 0;   // 次に書き込む位置
+static uint16_t trace_count = 0;  // 有効な記録数
+
+// 段階ごとのレイテンシヒストグラム（直前の段階からの経過時間）
+static uint32_t trace_hist[TRACE_STAGE_NUM][TRACE_HIST_BUCKETS];
+
+// 直前の割り込み時刻（ISRから更新、以降の割り込みで上書きされる）
+static volatile uint32_t last_intr_us = 0;
+
+// 受信してまだディスパッチされていないレポート（USBホストのタスクから更新）
+static bool pending_valid = false;
+static uint32_t pending_intr_us = 0;
+static uint32_t pending_report_us = 0;
+
+// 計測中のキー入力（main_taskのみが更新）
+static uint16_t current_seq = 0;
+static bool current_active = false;
+static uint32_t current_prev_us = 0;  // 直前の段階の時刻
+
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t trace_now_us() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+// 経過時間からバケット番号を求める（log2スケール）
+static uint8_t trace_bucket(uint32_t latency_us) {
+    uint8_t bucket = 0;
+    uint32_t v = latency_us + 1;
+    while (v > 1 && bucket < TRACE_HIST_BUCKETS - 1) {
+        v >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// 記録を追加し、直前の段階からの経過時間をヒストグラムに数える
+// （trace_muxを取得した状態で呼び出すこと）
+static void trace_push(uint16_t seq, TraceStage stage, uint32_t time_us, uint32_t prev_us) {
+    TraceRecord &rec = trace_buf[trace_head];
+    rec.key_seq = seq;
+    rec.stage = (uint8_t)stage;
+    rec.time_us = time_us;
+
+    trace_head = (trace_head + 1) % TRACE_BUF_SIZE;
+    if (trace_count < TRACE_BUF_SIZE) {
+        trace_count++;
+    }
+
+    trace_hist[stage][trace_bucket(time_us - prev_us)]++;
+}
+
+void IRAM_ATTR trace_intr() {
+    last_intr_us = trace_now_us();
+}
+
+void trace_key_begin() {
+    uint32_t now = trace_now_us();
+
+    portENTER_CRITICAL(&trace_mux);
+    pending_valid = true;
+    pending_intr_us = last_intr_us;
+    pending_report_us = now;
+    portEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_key_dispatch() {
+    uint32_t now = trace_now_us();
+
+    portENTER_CRITICAL(&trace_mux);
+    if (pending_valid) {
+        pending_valid = false;
+        current_seq++;
+        current_active = true;
+        trace_push(current_seq, TRACE_INTR, pending_intr_us, pending_intr_us);
+        trace_push(current_seq, TRACE_REPORT_CB, pending_report_us, pending_intr_us);
+        trace_push(current_seq, TRACE_DISPATCH, now, pending_report_us);
+        current_prev_us = now;
+    } else {
+        // レポートの受信を記録していない（トレースのリセット直後など）
+        current_active = false;
+    }
+    portEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_mark(TraceStage stage) {
+    if (!current_active) {
+        return;
+    }
+    uint32_t now = trace_now_us();
+
+    portENTER_CRITICAL(&trace_mux);
+    trace_push(current_seq, stage, now, current_prev_us);
+    portEXIT_CRITICAL(&trace_mux);
+    current_prev_us = now;
+
+    if (stage == TRACE_SPK_START) {
+        current_active = false;
+    }
+}
+
+void trace_reset() {
+    portENTER_CRITICAL(&trace_mux);
+    trace_head = 0;
+    trace_count = 0;
+    memset(trace_hist, 0, sizeof(trace_hist));
+    portEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_dump_csv(Print &out) {
+    // 出力中に書き換えられないようにコピーしてから出力する
+    static TraceRecord buf[TRACE_BUF_SIZE];
+    static uint32_t hist[TRACE_STAGE_NUM][TRACE_HIST_BUCKETS];
+    uint16_t head, count;
+
+    portENTER_CRITICAL(&trace_mux);
+    memcpy(buf, trace_buf, sizeof(buf));
+    memcpy(hist, trace_hist, sizeof(hist));
+    head = trace_head;
+    count = trace_count;
+    portEXIT_CRITICAL(&trace_mux);
+
+    // ヒストグラム: stage,bucket0,...,bucketN
+    out.print("#hist,stage");
+    for (uint8_t b = 0; b < TRACE_HIST_BUCKETS; b++) {
+        out.printf(",lt%luus", (unsigned long)((1UL << (b + 1)) - 1));
+    }
+    out.println();
+    for (uint8_t s = 0; s < TRACE_STAGE_NUM; s++) {
+        out.printf("hist,%u", s);
+        for (uint8_t b = 0; b < TRACE_HIST_BUCKETS; b++) {
+            out.printf(",%lu", (unsigned long)hist[s][b]);
+        }
+        out.println();
+    }
+
+    // トレース: 古い順に seq,stage,time_us
+    out.println("#trace,seq,stage,time_us");
+    uint16_t start = (head + TRACE_BUF_SIZE - count) % TRACE_BUF_SIZE;
+    for (uint16_t i = 0; i < count; i++) {
+        const TraceRecord &rec = buf[(start + i) % TRACE_BUF_SIZE];
+        out.printf("trace,%u,%u,%lu\n", rec.key_seq, rec.stage, (unsigned long)rec.time_us);
+    }
+}
+
+void trace_dump_binary(Print &out) {
+    static uint32_t hist[TRACE_STAGE_NUM][TRACE_HIST_BUCKETS];
+
+    portENTER_CRITICAL(&trace_mux);
+    memcpy(hist, trace_hist, sizeof(hist));
+    portEXIT_CRITICAL(&trace_mux);
+
+    // ヘッダ: 'L','T', 段階数, バケット数 の後に uint32(リトルエンディアン)のカウントが続く
+    const uint8_t header[4] = {'L', 'T', TRACE_STAGE_NUM, TRACE_HIST_BUCKETS};
+    out.write(header, sizeof(header));
+    out.write((const uint8_t *)hist, sizeof(hist));
+}
+
+void trace_poll_serial() {
+    while (Serial.available() > 0) {
+        switch (Serial.read()) {
+            case 't':
+                trace_dump_csv(Serial);
+                break;
+            case 'b':
+                trace_dump_binary(Serial);
+                break;
+            case 'r':
+                trace_reset();
+                Serial.println("trace reset");
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+#endif // LATENCY_TRACE
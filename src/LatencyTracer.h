@@ -0,0 +1,74 @@
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <Arduino.h>
+
+// キー入力1回分の処理段階（MAX3421E割り込み → PCM再生開始）
+enum TraceStage {
+    TRACE_INTR,         // MAX3421E INT割り込み
+    TRACE_REPORT_CB,    // tuh_hid_report_received_cb
+    TRACE_DISPATCH,     // main_taskでのディスパッチ
+    TRACE_CLIP_LOOKUP,  // 音声クリップ（wavパス）の決定
+    TRACE_SD_READ,      // SDカードからの読み込み完了
+    TRACE_SPK_START,    // M5.Speaker.playWav() 呼び出し完了
+    TRACE_STAGE_NUM
+};
+
+// トレースバッファの記録数（リングバッファ、古いものから上書き）
+#define TRACE_BUF_SIZE 256
+
+// ヒストグラムのバケット数: バケットiは [2^i - 1, 2^(i+1) - 1) マイクロ秒
+// 段階ごとに直前の段階からの経過時間を数える（TRACE_INTRは直前の段階がないためバケット0に数える）
+#define TRACE_HIST_BUCKETS 21
+
+// トレースバッファの1記録
+struct TraceRecord {
+    uint16_t key_seq;   // キー入力の通し番号
+    uint8_t stage;      // TraceStage
+    uint32_t time_us;   // esp_timer時刻（マイクロ秒、下位32bit）
+};
+
+#ifdef LATENCY_TRACE
+
+// 割り込み発生時刻を記録（ISRから呼び出し）
+void trace_intr();
+
+// キー入力のレポートを受信した（HIDレポート受信時に呼び出し）
+// 直前の割り込み時刻と現在時刻をこのレポートのものとして保持する
+// main_taskがディスパッチする前に次のレポートが来た場合は上書きする（global_reportsと同じ）
+void trace_key_begin();
+
+// 保持しているレポートの計測を開始（main_taskでのディスパッチ時に呼び出し）
+// TRACE_INTR、TRACE_REPORT_CB、TRACE_DISPATCHを記録する
+void trace_key_dispatch();
+
+// 現在計測中のキー入力に段階を記録（TRACE_SPK_STARTで計測を終了）
+// 計測中でなければ何もしない（一定時間後の確定など、キー入力によらない再生）
+void trace_mark(TraceStage stage);
+
+// トレースバッファとヒストグラムを消去
+void trace_reset();
+
+// ヒストグラムとトレースバッファをCSVで出力
+void trace_dump_csv(Print &out);
+
+// ヒストグラムをバイナリで出力
+void trace_dump_binary(Print &out);
+
+// シリアルからのコマンドを処理（'t': CSV出力, 'b': バイナリ出力, 'r': リセット）
+void trace_poll_serial();
+
+#else
+
+inline void trace_intr() {}
+inline void trace_key_begin() {}
+inline void trace_key_dispatch() {}
+inline void trace_mark(TraceStage stage) { (void)stage; }
+inline void trace_reset() {}
+inline void trace_dump_csv(Print &out) { (void)out; }
+inline void trace_dump_binary(Print &out) { (void)out; }
+inline void trace_poll_serial() {}
+
+#endif // LATENCY_TRACE
+
+#endif // LATENCY_TRACER_H
@@ -2,11 +2,13 @@
 #define ROMAJI_CONVERTER_H
 
 #include <Arduino.h>
+#include "RomajiDfa.h"
 
 // 入力モード
 enum InputMode {
     MODE_ALPHABET,  // アルファベットモード
-    MODE_ROMAJI     // ローマ字モード
+    MODE_ROMAJI,    // ローマ字モード（ひらがな）
+    MODE_KATAKANA   // カタカナモード
 };
 
 // ローマ字入力状態
@@ -16,51 +18,75 @@ enum RomajiState {
     STATE_N_WAIT        // n待機状態
 };
 
+// 読み上げなし
+#define ROMAJI_NO_CLIP ROMAJI_NO_KANA
+
+// キー入力の処理結果（ヒープ確保なしで返せるPOD）
+struct RomajiResult {
+    uint8_t clipId;     // 読み上げる音声クリップの番号（ROMAJI_NO_CLIPの場合は読み上げなし）
+    const char *kana;   // 確定したかな（モードに応じてひらがな/カタカナ、静的テーブル内の文字列、読み上げなしの場合はNULL）
+    char romaji[ROMAJI_PREFIX_MAX + 2];  // かなの確定に使われたローマ字（例: "kya"）
+
+    bool hasKana() const { return clipId != ROMAJI_NO_CLIP; }
+};
+
 // ローマ字変換クラス
 class RomajiConverter {
 public:
     RomajiConverter();
-    
-    // モード切替
+
+    // モード切替（アルファベット → ローマ字 → カタカナ → アルファベット）
     void toggleMode();
+    void setMode(InputMode mode);
     InputMode getMode() const { return currentMode; }
-    
+
+    // かな入力モード（ローマ字モード・カタカナモード）かどうか
+    bool isKanaMode() const { return currentMode != MODE_ALPHABET; }
+
     // キーコードから文字への変換（小文字）
     char keycodeToChar(uint8_t keycode);
-    
+
     // 文字が母音かどうか
     bool isVowel(char c);
-    
+
     // 文字が子音かどうか
     bool isConsonant(char c);
-    
-    // ローマ字モードでのキー入力処理
-    // 戻り値: 読み上げるべきひらがな（空文字列の場合は読み上げなし）
-    String processKeyInput(uint8_t keycode);
-    
+
+    // ローマ字モード・カタカナモードでのキー入力処理
+    // 戻り値: 確定したかな（確定しない場合はclipIdがROMAJI_NO_CLIP）
+    RomajiResult processKey(uint8_t keycode);
+
+    // 入力途中の状態を確定して初期状態に戻す（一定時間入力がない場合に呼び出す）
+    // n待機状態: "ん"を確定する
+    // 子音待機状態: かなは確定せず（clipIdがROMAJI_NO_CLIP）、romajiに入力途中のローマ字を返す
+    // 初期状態: 何もしない（romajiは空文字列）
+    RomajiResult flushPending();
+
+    // 入力途中のローマ字の最後の1文字を削除する（例: "ky" → "k"）
+    // 戻り値: 削除した文字（入力途中のローマ字がない場合は'\0'）
+    char backspace();
+
     // 状態をリセット
     void resetState();
-    
+
     // 現在の状態を取得
-    RomajiState getState() const { return state; }
-    
+    RomajiState getState() const;
+
     // 最後に入力された子音を取得
-    char getLastConsonant() const { return lastConsonant; }
-    
-    // 現在のローマ字入力を取得（例: "ka", "m"など）
-    String getCurrentRomaji() const;
+    char getLastConsonant() const;
+
+    // 現在の入力途中のローマ字を取得（例: "k", "ky", "n"など、初期状態では""）
+    const char *getCurrentRomaji() const;
+
+    // 音声クリップ番号に対応するかな（ひらがな）を取得
+    static const char *clipKana(uint8_t clipId);
+
+    // 音声クリップ番号に対応するカタカナを取得
+    static const char *clipKatakana(uint8_t clipId);
 
 private:
     InputMode currentMode;
-    RomajiState state;
-    char lastConsonant;  // 最後に入力された子音
-    
-    // ローマ字からひらがなへのマッピング
-    String romajiToHiragana(char consonant, char vowel);
-    
-    // 母音単独のひらがなマッピング
-    String vowelToHiragana(char vowel);
+    uint8_t dfaState;  // ローマ字オートマトンの状態（RomajiDfa.h）
 };
 
 #endif // ROMAJI_CONVERTER_H
-
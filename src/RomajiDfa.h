@@ -0,0 +1,328 @@
+#ifndef ROMAJI_DFA_H
+#define ROMAJI_DFA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ローマ字入力の決定性有限オートマトン（DFA）
+// ROMAJI_RULESの対応表からコンパイル時に 状態 x 入力文字 の遷移表を生成する。
+// 1キーの処理は遷移表の参照1回のみで、遷移ごとに「次の状態」「確定したかな」「確定に使われたローマ字の範囲」を持つ。
+
+// ローマ字とかなの対応
+struct RomajiRule {
+    const char *romaji;
+    const char *kana;
+};
+
+// ローマ字対応表（ヘボン式・訓令式・小書き文字を含む）
+// 1文字のルール（"n"）は後続の文字によって確定する（n待機状態）
+constexpr RomajiRule ROMAJI_RULES[] = {
+    // 母音
+    {"a", "あ"}, {"i", "い"}, {"u", "う"}, {"e", "え"}, {"o", "お"},
+
+    // か行
+    {"ka", "か"}, {"ki", "き"}, {"ku", "く"}, {"ke", "け"}, {"ko", "こ"},
+    {"kya", "きゃ"}, {"kyi", "きぃ"}, {"kyu", "きゅ"}, {"kye", "きぇ"}, {"kyo", "きょ"},
+    {"kwa", "くぁ"},
+    {"ca", "か"}, {"ci", "し"}, {"cu", "く"}, {"ce", "せ"}, {"co", "こ"},
+    {"qa", "くぁ"}, {"qi", "くぃ"}, {"qu", "く"}, {"qe", "くぇ"}, {"qo", "くぉ"},
+
+    // が行
+    {"ga", "が"}, {"gi", "ぎ"}, {"gu", "ぐ"}, {"ge", "げ"}, {"go", "ご"},
+    {"gya", "ぎゃ"}, {"gyi", "ぎぃ"}, {"gyu", "ぎゅ"}, {"gye", "ぎぇ"}, {"gyo", "ぎょ"},
+    {"gwa", "ぐぁ"},
+
+    // さ行
+    {"sa", "さ"}, {"si", "し"}, {"su", "す"}, {"se", "せ"}, {"so", "そ"},
+    {"sha", "しゃ"}, {"shi", "し"}, {"shu", "しゅ"}, {"she", "しぇ"}, {"sho", "しょ"},
+    {"sya", "しゃ"}, {"syi", "しぃ"}, {"syu", "しゅ"}, {"sye", "しぇ"}, {"syo", "しょ"},
+
+    // ざ行
+    {"za", "ざ"}, {"zi", "じ"}, {"zu", "ず"}, {"ze", "ぜ"}, {"zo", "ぞ"},
+    {"zya", "じゃ"}, {"zyi", "じぃ"}, {"zyu", "じゅ"}, {"zye", "じぇ"}, {"zyo", "じょ"},
+    {"ja", "じゃ"}, {"ji", "じ"}, {"ju", "じゅ"}, {"je", "じぇ"}, {"jo", "じょ"},
+    {"jya", "じゃ"}, {"jyi", "じぃ"}, {"jyu", "じゅ"}, {"jye", "じぇ"}, {"jyo", "じょ"},
+
+    // た行
+    {"ta", "た"}, {"ti", "ち"}, {"tu", "つ"}, {"te", "て"}, {"to", "と"},
+    {"tya", "ちゃ"}, {"tyi", "ちぃ"}, {"tyu", "ちゅ"}, {"tye", "ちぇ"}, {"tyo", "ちょ"},
+    {"cha", "ちゃ"}, {"chi", "ち"}, {"chu", "ちゅ"}, {"che", "ちぇ"}, {"cho", "ちょ"},
+    {"cya", "ちゃ"}, {"cyi", "ちぃ"}, {"cyu", "ちゅ"}, {"cye", "ちぇ"}, {"cyo", "ちょ"},
+    {"tsa", "つぁ"}, {"tsi", "つぃ"}, {"tsu", "つ"}, {"tse", "つぇ"}, {"tso", "つぉ"},
+    {"tha", "てゃ"}, {"thi", "てぃ"}, {"thu", "てゅ"}, {"the", "てぇ"}, {"tho", "てょ"},
+    {"twu", "とぅ"},
+
+    // だ行
+    {"da", "だ"}, {"di", "ぢ"}, {"du", "づ"}, {"de", "で"}, {"do", "ど"},
+    {"dya", "ぢゃ"}, {"dyi", "ぢぃ"}, {"dyu", "ぢゅ"}, {"dye", "ぢぇ"}, {"dyo", "ぢょ"},
+    {"dha", "でゃ"}, {"dhi", "でぃ"}, {"dhu", "でゅ"}, {"dhe", "でぇ"}, {"dho", "でょ"},
+    {"dwu", "どぅ"},
+
+    // な行
+    {"na", "な"}, {"ni", "に"}, {"nu", "ぬ"}, {"ne", "ね"}, {"no", "の"},
+    {"nya", "にゃ"}, {"nyi", "にぃ"}, {"nyu", "にゅ"}, {"nye", "にぇ"}, {"nyo", "にょ"},
+    {"n", "ん"},
+
+    // は行
+    {"ha", "は"}, {"hi", "ひ"}, {"hu", "ふ"}, {"he", "へ"}, {"ho", "ほ"},
+    {"hya", "ひゃ"}, {"hyi", "ひぃ"}, {"hyu", "ひゅ"}, {"hye", "ひぇ"}, {"hyo", "ひょ"},
+    {"fa", "ふぁ"}, {"fi", "ふぃ"}, {"fu", "ふ"}, {"fe", "ふぇ"}, {"fo", "ふぉ"},
+    {"fya", "ふゃ"}, {"fyu", "ふゅ"}, {"fyo", "ふょ"},
+
+    // ば行・ぱ行・ゔ
+    {"ba", "ば"}, {"bi", "び"}, {"bu", "ぶ"}, {"be", "べ"}, {"bo", "ぼ"},
+    {"bya", "びゃ"}, {"byi", "びぃ"}, {"byu", "びゅ"}, {"bye", "びぇ"}, {"byo", "びょ"},
+    {"pa", "ぱ"}, {"pi", "ぴ"}, {"pu", "ぷ"}, {"pe", "ぺ"}, {"po", "ぽ"},
+    {"pya", "ぴゃ"}, {"pyi", "ぴぃ"}, {"pyu", "ぴゅ"}, {"pye", "ぴぇ"}, {"pyo", "ぴょ"},
+    {"va", "ゔぁ"}, {"vi", "ゔぃ"}, {"vu", "ゔ"}, {"ve", "ゔぇ"}, {"vo", "ゔぉ"},
+    {"vya", "ゔゃ"}, {"vyu", "ゔゅ"}, {"vyo", "ゔょ"},
+
+    // ま行
+    {"ma", "ま"}, {"mi", "み"}, {"mu", "む"}, {"me", "め"}, {"mo", "も"},
+    {"mya", "みゃ"}, {"myi", "みぃ"}, {"myu", "みゅ"}, {"mye", "みぇ"}, {"myo", "みょ"},
+
+    // や行
+    {"ya", "や"}, {"yi", "い"}, {"yu", "ゆ"}, {"ye", "いぇ"}, {"yo", "よ"},
+
+    // ら行
+    {"ra", "ら"}, {"ri", "り"}, {"ru", "る"}, {"re", "れ"}, {"ro", "ろ"},
+    {"rya", "りゃ"}, {"ryi", "りぃ"}, {"ryu", "りゅ"}, {"rye", "りぇ"}, {"ryo", "りょ"},
+
+    // わ行
+    {"wa", "わ"}, {"wi", "うぃ"}, {"wu", "う"}, {"we", "うぇ"}, {"wo", "を"},
+    {"wha", "うぁ"}, {"whi", "うぃ"}, {"whu", "う"}, {"whe", "うぇ"}, {"who", "うぉ"},
+    {"wyi", "ゐ"}, {"wye", "ゑ"},
+
+    // 小書き文字
+    {"xa", "ぁ"}, {"xi", "ぃ"}, {"xu", "ぅ"}, {"xe", "ぇ"}, {"xo", "ぉ"},
+    {"la", "ぁ"}, {"li", "ぃ"}, {"lu", "ぅ"}, {"le", "ぇ"}, {"lo", "ぉ"},
+    {"xya", "ゃ"}, {"xyu", "ゅ"}, {"xyo", "ょ"},
+    {"lya", "ゃ"}, {"lyu", "ゅ"}, {"lyo", "ょ"},
+    {"xtu", "っ"}, {"xtsu", "っ"}, {"ltu", "っ"}, {"ltsu", "っ"},
+    {"xwa", "ゎ"}, {"lwa", "ゎ"},
+    {"xka", "ゕ"}, {"xke", "ゖ"}, {"lka", "ゕ"}, {"lke", "ゖ"},
+    {"xn", "ん"},
+};
+
+constexpr size_t ROMAJI_RULE_NUM = sizeof(ROMAJI_RULES) / sizeof(ROMAJI_RULES[0]);
+
+#define ROMAJI_ALPHABET   26    // 入力文字 a-z
+#define ROMAJI_STATE_NUM  59    // 状態数（入力途中のローマ字の種類）。ROMAJI_RULESで状態が増減したら合わせる
+#define ROMAJI_KANA_MAX   255   // かなの種類の上限
+#define ROMAJI_PREFIX_MAX 4     // 入力途中のローマ字の最大長
+#define ROMAJI_KANA_BYTES 8     // かな1つの最大バイト数（UTF-8で2文字+終端）
+#define ROMAJI_NO_KANA    0xFF  // 確定したかながない
+#define ROMAJI_ROOT       0     // 初期状態
+
+// 遷移表の1要素
+struct RomajiTransition {
+    uint8_t next;  // 次の状態
+    uint8_t kana;  // 確定したかな（kana[]の番号、ROMAJI_NO_KANAの場合はなし）
+    uint8_t span;  // かなの確定に使われたローマ字の範囲（「入力途中のローマ字+入力文字」内の 開始位置<<4 | 長さ）
+};
+
+static_assert(sizeof(RomajiTransition) == 3, "RomajiTransition must stay 3 bytes");
+
+constexpr uint8_t romaji_span(uint8_t start, uint8_t len) {
+    return (uint8_t)((start << 4) | len);
+}
+
+struct RomajiDfa {
+    RomajiTransition trans[ROMAJI_STATE_NUM][ROMAJI_ALPHABET];
+
+    // 状態ごとの入力途中のローマ字（例: "ky"）
+    char prefix[ROMAJI_STATE_NUM][ROMAJI_PREFIX_MAX + 1];
+
+    // 入力途中で確定できるかな（"n" → ん）。ない場合はROMAJI_NO_KANA
+    uint8_t pendingKana[ROMAJI_STATE_NUM];
+
+    const char *kana[ROMAJI_KANA_MAX];
+
+    // kana[]と同じ番号のカタカナ（カタカナモードの出力表）
+    char katakana[ROMAJI_KANA_MAX][ROMAJI_KANA_BYTES];
+
+    uint8_t stateNum;
+    uint8_t kanaNum;
+};
+
+//--------------------------------------------------------------------+
+// コンパイル時の遷移表生成
+//--------------------------------------------------------------------+
+
+constexpr size_t romaji_strlen(const char *s) {
+    size_t n = 0;
+    while (s[n] != '\0') {
+        n++;
+    }
+    return n;
+}
+
+constexpr bool romaji_streq(const char *a, const char *b) {
+    size_t i = 0;
+    while (a[i] != '\0' && a[i] == b[i]) {
+        i++;
+    }
+    return a[i] == b[i];
+}
+
+constexpr bool romaji_is_vowel(char c) {
+    return c == 'a' || c == 'i' || c == 'u' || c == 'e' || c == 'o';
+}
+
+// ひらがな（UTF-8）をカタカナに変換する（U+3041〜U+3096 に 0x60 を加える）
+constexpr void romaji_hiragana_to_katakana(const char *src, char *dst) {
+    size_t i = 0;
+    while (src[i] != '\0') {
+        uint8_t const b0 = (uint8_t)src[i];
+        if ((b0 & 0xF0) == 0xE0) {
+            // 3バイト文字
+            uint16_t cp = (uint16_t)(((b0 & 0x0F) << 12) | (((uint8_t)src[i + 1] & 0x3F) << 6) |
+                                     ((uint8_t)src[i + 2] & 0x3F));
+            if (cp >= 0x3041 && cp <= 0x3096) {
+                cp += 0x60;
+            }
+            dst[i] = (char)(0xE0 | (cp >> 12));
+            dst[i + 1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            dst[i + 2] = (char)(0x80 | (cp & 0x3F));
+            i += 3;
+        } else {
+            dst[i] = src[i];
+            i++;
+        }
+    }
+    dst[i] = '\0';
+}
+
+// かなを登録して番号を返す（登録済みの場合はその番号）
+constexpr uint8_t romaji_kana_id(RomajiDfa &dfa, const char *kana) {
+    for (uint8_t i = 0; i < dfa.kanaNum; i++) {
+        if (romaji_streq(dfa.kana[i], kana)) {
+            return i;
+        }
+    }
+    dfa.kana[dfa.kanaNum] = kana;
+    return dfa.kanaNum++;
+}
+
+// 入力途中のローマ字に対応する状態を返す（ない場合は0）
+constexpr uint8_t romaji_find_state(const RomajiDfa &dfa, const char *prefix) {
+    for (uint8_t s = 0; s < dfa.stateNum; s++) {
+        if (romaji_streq(dfa.prefix[s], prefix)) {
+            return s;
+        }
+    }
+    return 0;
+}
+
+constexpr RomajiDfa build_romaji_dfa() {
+    RomajiDfa dfa{};
+
+    // 生成中の作業領域: 子状態（0はなし）と、その文字で確定するかな
+    uint8_t child[ROMAJI_STATE_NUM][ROMAJI_ALPHABET] = {};
+    uint8_t leaf[ROMAJI_STATE_NUM][ROMAJI_ALPHABET] = {};
+
+    for (uint8_t s = 0; s < ROMAJI_STATE_NUM; s++) {
+        dfa.pendingKana[s] = ROMAJI_NO_KANA;
+        for (uint8_t c = 0; c < ROMAJI_ALPHABET; c++) {
+            leaf[s][c] = ROMAJI_NO_KANA;
+        }
+    }
+    dfa.stateNum = 1;  // ROMAJI_ROOT
+
+    // 1. 全ルールの入力途中（最後の1文字を除く部分）を状態として登録
+    for (size_t r = 0; r < ROMAJI_RULE_NUM; r++) {
+        const char *romaji = ROMAJI_RULES[r].romaji;
+        size_t const len = romaji_strlen(romaji);
+        uint8_t s = ROMAJI_ROOT;
+        for (size_t i = 0; i + 1 < len; i++) {
+            uint8_t const c = (uint8_t)(romaji[i] - 'a');
+            if (child[s][c] == 0) {
+                uint8_t const ns = dfa.stateNum++;
+                for (size_t j = 0; j <= i; j++) {
+                    dfa.prefix[ns][j] = romaji[j];
+                }
+                child[s][c] = ns;
+            }
+            s = child[s][c];
+        }
+    }
+
+    // 2. 最後の1文字でかなを確定させる（その先に続きがある場合は入力途中で確定できるかなとする）
+    for (size_t r = 0; r < ROMAJI_RULE_NUM; r++) {
+        const char *romaji = ROMAJI_RULES[r].romaji;
+        size_t const len = romaji_strlen(romaji);
+        uint8_t s = ROMAJI_ROOT;
+        for (size_t i = 0; i + 1 < len; i++) {
+            s = child[s][romaji[i] - 'a'];
+        }
+        uint8_t const c = (uint8_t)(romaji[len - 1] - 'a');
+        uint8_t const kana = romaji_kana_id(dfa, ROMAJI_RULES[r].kana);
+        if (child[s][c] != 0) {
+            dfa.pendingKana[child[s][c]] = kana;
+        } else {
+            leaf[s][c] = kana;
+        }
+    }
+
+    uint8_t const sokuon = romaji_kana_id(dfa, "っ");
+    uint8_t const state_c = romaji_find_state(dfa, "c");
+
+    // 3. 遷移表を生成（初期状態の行を先に生成し、他の状態のやり直しに使う）
+    for (uint8_t s = 0; s < dfa.stateNum; s++) {
+        uint8_t const plen = (uint8_t)romaji_strlen(dfa.prefix[s]);
+
+        for (uint8_t c = 0; c < ROMAJI_ALPHABET; c++) {
+            char const ch = (char)('a' + c);
+            RomajiTransition &t = dfa.trans[s][c];
+
+            if (child[s][c] != 0) {
+                // 入力途中
+                t.next = child[s][c];
+                t.kana = ROMAJI_NO_KANA;
+                t.span = 0;
+            } else if (leaf[s][c] != ROMAJI_NO_KANA) {
+                // かなが確定
+                t.next = ROMAJI_ROOT;
+                t.kana = leaf[s][c];
+                t.span = romaji_span(0, plen + 1);
+            } else if (s == ROMAJI_ROOT) {
+                // 対応するルールがない文字
+                t.next = ROMAJI_ROOT;
+                t.kana = ROMAJI_NO_KANA;
+                t.span = 0;
+            } else if (dfa.pendingKana[s] != ROMAJI_NO_KANA) {
+                // n待機状態: "ん"を確定し、入力文字を新規入力として扱う
+                // n + n の場合は"ん"を確定してn待機状態を維持する（表示は"nn"）
+                bool const repeat = (dfa.prefix[s][0] == ch);
+                t.next = repeat ? s : dfa.trans[ROMAJI_ROOT][c].next;
+                t.kana = dfa.pendingKana[s];
+                t.span = romaji_span(0, repeat ? plen + 1 : plen);
+            } else if (plen == 1 && dfa.prefix[s][0] == ch && !romaji_is_vowel(ch)) {
+                // 同じ子音の連続（kk, ss, tt など）: "っ"を確定して子音待機状態を維持する
+                t.next = s;
+                t.kana = sokuon;
+                t.span = romaji_span(0, 1);
+            } else if (romaji_streq(dfa.prefix[s], "t") && ch == 'c') {
+                // tch（ヘボン式の促音）
+                t.next = state_c;
+                t.kana = sokuon;
+                t.span = romaji_span(0, 1);
+            } else {
+                // 無効な組み合わせ: 入力途中のローマ字を破棄し、入力文字を新規入力として扱う
+                t = dfa.trans[ROMAJI_ROOT][c];
+                if (t.kana != ROMAJI_NO_KANA) {
+                    t.span = romaji_span(plen, 1);
+                }
+            }
+        }
+    }
+
+    // 4. カタカナの出力表を生成
+    for (uint8_t k = 0; k < dfa.kanaNum; k++) {
+        romaji_hiragana_to_katakana(dfa.kana[k], dfa.katakana[k]);
+    }
+
+    return dfa;
+}
+
+#endif // ROMAJI_DFA_H
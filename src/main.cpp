@@ -32,6 +32,11 @@
 #include "usbh_helper.h"
 #include "DisplayDataGenerator.h"
 #include "RomajiConverter.h"
+#include "LatencyTracer.h"
+#include "ChordDetector.h"
+#include "IdleCommitTimer.h"
+#include "KanaBuffer.h"
+#include "CompositionView.h"
 
 #define DEBUG_MODE_SERIAL //現状必須。
 // #define DEBUG_LCD
@@ -44,68 +49,263 @@ bool is_in_push = false;
 // ローマ字変換インスタンス
 RomajiConverter romajiConverter;
 
-// Ctrl+M検出用のフラグ（キーが離されたことを検出するため）
-bool ctrl_m_pressed = false;
+// ホットキー（Ctrl+Mなど）検出インスタンス
+ChordDetector chordDetector;
 
+// 入力途中のローマ字を一定時間後に確定するタイマー
+IdleCommitTimer idleCommitTimer;
+
+// 最後のキー入力から入力途中のローマ字を確定するまでの時間
+#define IDLE_COMMIT_TIMEOUT_MS 2000
+
+// 確定済みかなのバッファと、画面下端への表示
+KanaBuffer kanaBuffer;
+CompositionView compositionView;
+
+// 一定時間後に確定した入力途中のローマ字（メインループで前の音声が終わるたびに1文字ずつ読み上げる）
+char pendingLetters[ROMAJI_PREFIX_MAX + 2] = "";
+uint8_t pendingLetterPos = 0;
+
+// 読み上げ待ちのローマ字を取り消す（次のキー入力・モード切替）
+void cancel_pending_letters(){
+  pendingLetters[0] = '\0';
+  pendingLetterPos = 0;
+}
+
+// キーコード
+#define KEYCODE_L     0x0F
+#define KEYCODE_M     0x10
+#define KEYCODE_RIGHT 0x4F
+#define KEYCODE_LEFT  0x50
+#define KEYCODE_BACKSPACE 0x2A
+
+// 起動時のキーボード配列
+#define DEFAULT_KEY_LAYOUT LAYOUT_JIS
+
+// 画面を消去（かな入力モードでは確定済みかなの行を残す）
+void clear_screen(){
+  if(romajiConverter.isKanaMode()){
+    compositionView.clearMainArea();
+  } else {
+    M5.Lcd.clearDisplay();
+  }
+}
+
+// Ctrl+M: モード切替
+void on_mode_toggle(ChordEvent event){
+  if(event != CHORD_PRESS){
+    return;
+  }
+  romajiConverter.toggleMode();
+  idleCommitTimer.cancel();
+  cancel_pending_letters();
+  kanaBuffer.clear();
+
+  // モード表示
+  M5.Lcd.clearClipRect();
+  M5.Lcd.clearDisplay();
+  DisplayData modeData = create_mode_display_data(romajiConverter.getMode());
+  M5.Lcd.setCursor(modeData.x, modeData.y);
+  M5.Lcd.setTextSize(modeData.font_size);
+  M5.Lcd.printf("%s", modeData.lcd_str.c_str());
+  compositionView.redraw(kanaBuffer);
+  M5.Lcd.waitDisplay();
+
+  #ifdef DEBUG_MODE_SERIAL
+  static const char *mode_names[] = {"ALPHABET", "ROMAJI", "KATAKANA"};
+  Serial.printf("Mode switched to: %s\n", mode_names[romajiConverter.getMode()]);
+  #endif
+}
+
+// Ctrl+→: 音声大を設定
+void on_volume_up(ChordEvent event){
+  if(event == CHORD_PRESS){
+    clear_screen();
+    set_volume(100);
+  }
+}
+
+// Ctrl+←: 音声小を設定
+void on_volume_down(ChordEvent event){
+  if(event == CHORD_PRESS){
+    clear_screen();
+    set_volume(20);
+  }
+}
+
+// Ctrl+L: キーボード配列の切替（US → JIS → ユーザー定義 → US、読み込めない配列は飛ばす）
+void on_layout_toggle(ChordEvent event){
+  if(event != CHORD_PRESS){
+    return;
+  }
+  KeyLayoutId id = get_key_layout();
+  for(int i = 0; i < LAYOUT_NUM; i++){
+    id = (KeyLayoutId)((id + 1) % LAYOUT_NUM);
+    if(load_key_layout(id)){
+      break;
+    }
+  }
+
+  // 配列表示
+  clear_screen();
+  DisplayData layoutData = create_layout_display_data(get_key_layout());
+  M5.Lcd.setCursor(layoutData.x, layoutData.y);
+  M5.Lcd.setTextSize(layoutData.font_size);
+  M5.Lcd.printf("%s", layoutData.lcd_str.c_str());
+  M5.Lcd.waitDisplay();
+
+  #ifdef DEBUG_MODE_SERIAL
+  Serial.printf("Layout switched to: %s\n", KeyLayout::name(get_key_layout()));
+  #endif
+}
+
+
+// 確定したかなを表示して読み上げる
+void show_kana(const RomajiResult &result){
+  // かなの確定に使われたローマ字を右上に小さく表示
+  DisplayData romajiData = create_romaji_display_data(result.romaji);
+  M5.Lcd.setCursor(romajiData.x, romajiData.y);
+  M5.Lcd.setTextSize(romajiData.font_size);
+  M5.Lcd.printf("%s", romajiData.lcd_str.c_str());
+
+  // かなを中央に表示（カタカナモードでは出力表が違うだけで、音声は同じクリップ番号から引く）
+  DisplayData kanaData;
+  if(romajiConverter.getMode() == MODE_KATAKANA){
+    kanaData = convert_katakana_to_DisplayData(result.kana, RomajiConverter::clipKana(result.clipId));
+  } else {
+    kanaData = convert_hiragana_to_DisplayData(result.kana);
+  }
+  trace_mark(TRACE_CLIP_LOOKUP);
+  play_wav(kanaData.wav_path);
+  M5.Lcd.setCursor(kanaData.x, kanaData.y);
+  M5.Lcd.setTextSize(kanaData.font_size);
+  M5.Lcd.printf("%s", kanaData.lcd_str.c_str());
+  M5.Lcd.waitDisplay();
+}
+
+// 確定したかなをバッファに追加し、表示して読み上げる
+void commit_kana(const RomajiResult &result){
+  kanaBuffer.push(result, romajiConverter.getMode() == MODE_KATAKANA);
+  compositionView.append(kanaBuffer.back());
+  show_kana(result);
+}
+
+// 入力途中のローマ字（k, ky, nなど）を中央に表示
+void show_pending_romaji(){
+  DisplayData consonantData = create_consonant_display_data(romajiConverter.getCurrentRomaji());
+  M5.Lcd.setCursor(consonantData.x, consonantData.y);
+  M5.Lcd.setTextSize(consonantData.font_size);
+  M5.Lcd.printf("%s", consonantData.lcd_str.c_str());
+  M5.Lcd.waitDisplay();
+}
+
+// Backspace: 入力途中のローマ字の最後の1文字、または最後に確定したかなを削除し、削除したものを読み上げる
+void kana_backspace(){
+  char dropped = romajiConverter.backspace();
+  if(dropped != '\0'){
+    DisplayData letterData = convert_char_to_DisplayData(dropped);
+    trace_mark(TRACE_CLIP_LOOKUP);
+    play_wav(letterData.wav_path);
+
+    if(romajiConverter.getState() != STATE_INITIAL){
+      idleCommitTimer.arm();
+      show_pending_romaji();
+    } else {
+      idleCommitTimer.cancel();
+    }
+    return;
+  }
+
+  KanaUnit unit;
+  if(!kanaBuffer.pop(&unit)){
+    return;  // 削除するものがない
+  }
+  // 削除したかなの位置のみを消去
+  compositionView.removeLast(kanaBuffer);
+
+  RomajiResult deleted;
+  deleted.clipId = unit.clipId;
+  deleted.kana = unit.kana();
+  strcpy(deleted.romaji, unit.romaji);
+  show_kana(deleted);
+}
+
+// 読み上げ待ちのローマ字を、前の音声が終わっていれば1文字表示して読み上げる
+// 音声の終わりを待ってブロックしないため、読み上げ中もキー入力を処理できる
+void speak_pending_letter(){
+  if(pendingLetters[pendingLetterPos] == '\0' || M5.Speaker.isPlaying()){
+    return;
+  }
+  DisplayData letterData = convert_char_to_DisplayData(pendingLetters[pendingLetterPos++]);
+  clear_screen();
+  play_wav(letterData.wav_path);
+  M5.Lcd.setCursor(letterData.x, letterData.y);
+  M5.Lcd.setTextSize(letterData.font_size);
+  M5.Lcd.printf("%s", letterData.lcd_str.c_str());
+  M5.Lcd.waitDisplay();
+}
+
+// 一定時間入力がない場合に入力途中のローマ字を確定する
+// n待機状態は"ん"、子音待機状態は入力途中のアルファベットを1文字ずつ読み上げる
+void idle_commit(){
+  RomajiResult result = romajiConverter.flushPending();
+  if(result.romaji[0] == '\0'){
+    return;
+  }
+
+  clear_screen();
+  if(result.hasKana()){
+    commit_kana(result);
+    return;
+  }
+
+  strcpy(pendingLetters, result.romaji);
+  pendingLetterPos = 0;
+  speak_pending_letter();
+}
 
 void main_task(void *parameter){
+  // タイマーのコールバックはこのタスクを起こすだけで、確定処理はこのタスクで行う
+  idleCommitTimer.begin(IDLE_COMMIT_TIMEOUT_MS);
+
   while(1){
 
     M5.update();
+    trace_poll_serial();
+
+    // ホットキーの検出（押下・解放・長押しのエッジごとにハンドラが呼ばれる）
+    chordDetector.update(global_reports, millis());
+
     if(global_reports[2] != 0x00 && is_in_push == false){
       is_in_push = true;
+      trace_key_dispatch();
+      cancel_pending_letters();
       
-      M5.Lcd.clearDisplay();
-
-      #ifdef DEBUG_LCD
-      M5.Lcd.setCursor(0,10);
-      M5.Lcd.setTextSize(1);
-      for (uint16_t i = 0; i < DATA_LEN; i++) {
-        M5.Lcd.printf("0x%02X ", global_reports[i]);
-        M5.Lcd.println("");
-      }
-      #endif
-      
-      // Ctrl+Mの検出（左Ctrl: bit 0, 右Ctrl: bit 4, Mキー: 0x10）
-      bool ctrl_pressed = (global_reports[0] & 0x01) || (global_reports[0] & 0x10);
-      bool m_pressed = (global_reports[2] == 0x10);
-      
-      if(ctrl_pressed && m_pressed && !ctrl_m_pressed){
-        // Ctrl+Mが押された（初回検出）
-        ctrl_m_pressed = true;
-        romajiConverter.toggleMode();
-        
-        // モード表示
-        DisplayData modeData = create_mode_display_data(romajiConverter.getMode() == MODE_ROMAJI);
-        M5.Lcd.setCursor(modeData.x, modeData.y);
-        M5.Lcd.setTextSize(modeData.font_size);
-        M5.Lcd.printf("%s", modeData.lcd_str.c_str());
-        M5.Lcd.waitDisplay();
-        
-        #ifdef DEBUG_MODE_SERIAL
-        Serial.printf("Mode switched to: %s\n", 
-                      romajiConverter.getMode() == MODE_ROMAJI ? "ROMAJI" : "ALPHABET");
+      // ホットキーはchordDetectorのハンドラで処理済み
+      if(!chordDetector.isAnyActive()){
+        clear_screen();
+
+        #ifdef DEBUG_LCD
+        M5.Lcd.setCursor(0,10);
+        M5.Lcd.setTextSize(1);
+        for (uint16_t i = 0; i < DATA_LEN; i++) {
+          M5.Lcd.printf("0x%02X ", global_reports[i]);
+          M5.Lcd.println("");
+        }
         #endif
-      }
-      else if(global_reports[0] == 0x01 && global_reports[2] == 0x4F){
-        //音声大を設定
-        set_volume(100);
-      }
-      else if(global_reports[0] == 0x01 && global_reports[2] == 0x50){
-        //音声小を設定
-        set_volume(20);
-      }
-      else if(!(ctrl_pressed && m_pressed)){
-        // Ctrl+M以外のキー入力処理
-        if(romajiConverter.getMode() == MODE_ROMAJI){
-          // ローマ字モード
+
+        if(romajiConverter.isKanaMode()){
+          // ローマ字モード・カタカナモード
           char inputChar = romajiConverter.keycodeToChar(global_reports[2]);
           
           // 特殊キー（Enter、Space、矢印、@など）の場合はアルファベットモードと同じ処理
-          if(inputChar == '\0'){
+          if(global_reports[2] == KEYCODE_BACKSPACE){
+            kana_backspace();
+          } else if(inputChar == '\0'){
             // 特殊キーの場合（アルファベット以外）
-            DisplayData dispdata = convert_keycode_to_DisplayData(global_reports[2]);
-            M5.Lcd.clearDisplay();
+            DisplayData dispdata = convert_keycode_to_DisplayData(global_reports[2], global_reports[0]);
+            trace_mark(TRACE_CLIP_LOOKUP);
+            clear_screen();
             play_wav(dispdata.wav_path);
             M5.Lcd.setCursor(dispdata.x,dispdata.y);
             M5.Lcd.setTextSize(dispdata.font_size);
@@ -113,70 +313,31 @@ void main_task(void *parameter){
             M5.Lcd.waitDisplay();
           } else {
             // アルファベットキーの場合（ローマ字処理）
-            RomajiState oldState = romajiConverter.getState();
-            char oldConsonant = romajiConverter.getLastConsonant();
-            
-            String hiragana = romajiConverter.processKeyInput(global_reports[2]);
+            RomajiResult result = romajiConverter.processKey(global_reports[2]);
             RomajiState newState = romajiConverter.getState();
             
             // 画面をクリア（前回の表示を消す）
-            M5.Lcd.clearDisplay();
+            clear_screen();
             
-            if(hiragana.length() > 0){
-              // 読み上げるべきひらがながある場合（母音入力後など）
-              // ローマ字を右上に小さく表示
-              String currentRomaji = "";
-              if(oldState == STATE_CONSONANT && oldConsonant != '\0' && romajiConverter.isVowel(inputChar)){
-                // 子音+母音の組み合わせ
-                currentRomaji = String(oldConsonant) + String(inputChar);
-              } else if(oldState == STATE_N_WAIT && romajiConverter.isVowel(inputChar)){
-                // n+母音の組み合わせ
-                currentRomaji = "n" + String(inputChar);
-              } else if(oldState == STATE_INITIAL && romajiConverter.isVowel(inputChar)){
-                // 母音単独入力
-                currentRomaji = String(inputChar);
-              } else if(hiragana == "ん"){
-                // 「ん」が読み上げられる場合
-                if(oldState == STATE_N_WAIT && inputChar == 'n'){
-                  currentRomaji = "nn";
-                } else if(oldState == STATE_N_WAIT && romajiConverter.isConsonant(inputChar)){
-                  currentRomaji = "n" + String(inputChar);
-                }
-              }
-              
-              if(currentRomaji.length() > 0){
-                DisplayData romajiData = create_romaji_display_data(currentRomaji);
-                M5.Lcd.setCursor(romajiData.x, romajiData.y);
-                M5.Lcd.setTextSize(romajiData.font_size);
-                M5.Lcd.printf("%s", romajiData.lcd_str.c_str());
-              }
-              
-              // ひらがなを中央に表示
-              DisplayData hiraganaData = convert_hiragana_to_DisplayData(hiragana);
-              play_wav(hiraganaData.wav_path);
-              M5.Lcd.setCursor(hiraganaData.x, hiraganaData.y);
-              M5.Lcd.setTextSize(hiraganaData.font_size);
-              M5.Lcd.printf("%s", hiraganaData.lcd_str.c_str());
-              M5.Lcd.waitDisplay();
-            } else if(newState == STATE_CONSONANT && romajiConverter.getLastConsonant() != '\0'){
-              // 子音入力時: 子音を中央に表示
-              DisplayData consonantData = create_consonant_display_data(romajiConverter.getLastConsonant());
-              M5.Lcd.setCursor(consonantData.x, consonantData.y);
-              M5.Lcd.setTextSize(consonantData.font_size);
-              M5.Lcd.printf("%s", consonantData.lcd_str.c_str());
-              M5.Lcd.waitDisplay();
-            } else if(newState == STATE_N_WAIT){
-              // n待機状態: "n"を中央に表示
-              DisplayData nData = create_consonant_display_data('n');
-              M5.Lcd.setCursor(nData.x, nData.y);
-              M5.Lcd.setTextSize(nData.font_size);
-              M5.Lcd.printf("%s", nData.lcd_str.c_str());
-              M5.Lcd.waitDisplay();
+            // 入力途中の状態があれば、一定時間後に確定する
+            if(newState != STATE_INITIAL){
+              idleCommitTimer.arm();
+            } else {
+              idleCommitTimer.cancel();
+            }
+
+            if(result.hasKana()){
+              // 読み上げるべきかながある場合（母音入力後など）
+              commit_kana(result);
+            } else if(newState != STATE_INITIAL){
+              // 子音待機状態・n待機状態: 入力途中のローマ字を中央に表示
+              show_pending_romaji();
             }
           }
         } else {
           // アルファベットモード（既存の処理）
-          DisplayData dispdata = convert_keycode_to_DisplayData(global_reports[2]);
+          DisplayData dispdata = convert_keycode_to_DisplayData(global_reports[2], global_reports[0]);
+          trace_mark(TRACE_CLIP_LOOKUP);
           play_wav(dispdata.wav_path);
           M5.Lcd.setCursor(dispdata.x,dispdata.y);
           M5.Lcd.setTextSize(dispdata.font_size);
@@ -189,13 +350,16 @@ void main_task(void *parameter){
     
     if(global_reports[2] == 0x00){
       is_in_push = false;
-      // Ctrl+Mが離されたことを検出
-      if(ctrl_m_pressed){
-        ctrl_m_pressed = false;
-      }
     }
 
-    delay(10);
+    // 入力途中のローマ字の確定（キー入力と同じタスクで処理するため競合しない）
+    if(idleCommitTimer.takeExpired()){
+      idle_commit();
+    }
+    speak_pending_letter();
+
+    // 10ms待つ（確定タイマーの発火時はすぐに起きる）
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
   }
 }
 
@@ -211,6 +375,9 @@ void setup() {
   M5.Lcd.println("hello.");
   M5.Lcd.setTextFont(&fonts::efontJA_16);
 
+  // 一度つないだキーボードのディスクリプタを NVS に保存し、抜き差し時の列挙を短くする
+  USBHost.setDescriptorCache(true);
+
   // init host stack on controller (rhport) 1
   USBHost.begin(1);
 
@@ -227,11 +394,20 @@ void setup() {
 
   M5.Lcd.printf("finish setup");
 
+  // ホットキーの登録（左右どちらのCtrlでも可）
+  chordDetector.addChord(CHORD_MOD_CTRL, KEYCODE_M, on_mode_toggle);
+  chordDetector.addChord(CHORD_MOD_CTRL, KEYCODE_RIGHT, on_volume_up);
+  chordDetector.addChord(CHORD_MOD_CTRL, KEYCODE_LEFT, on_volume_down);
+  chordDetector.addChord(CHORD_MOD_CTRL, KEYCODE_L, on_layout_toggle);
+
   xTaskCreatePinnedToCore(main_task, "MainTask", 10000, NULL, 1, NULL, 0);
 
 
   spk_SD_setup();
 
+  // キーボード配列の読み込み（SDカードの配列ファイルがあれば優先）
+  load_key_layout(DEFAULT_KEY_LAYOUT);
+
 }
 
 void loop() {
@@ -261,6 +437,11 @@ void key_input_parser(uint8_t const *report, uint16_t len){
     memcpy(global_reports, report, len);
   }
 
+  // キーが押された場合のみレイテンシ計測を開始
+  if(len > 2 && report[2] != 0x00){
+    trace_key_begin();
+  }
+
 
   #ifdef DEBUG_MODE_SERIAL
   Serial.printf("call: key_input_parser");
@@ -281,6 +462,12 @@ void tuh_hid_report_sent_cb(uint8_t dev_addr, uint8_t idx,
 
 extern "C" {
 
+// MAX3421E割り込み発生時に呼び出される（ISRコンテキスト）
+void tuh_max3421_isr_cb(uint8_t rhport) {
+  (void) rhport;
+  trace_intr();
+}
+
 // Invoked when device with hid interface is mounted
 // Report descriptor is also available for use.
 // tuh_hid_parse_report_descriptor() can be used to parse common/simple enough
@@ -0,0 +1,29 @@
+// PC上でのテスト用: ヒープ確保回数の計数
+// operator new / delete を置き換えるため、1つのテストにつき1つのソースファイルでのみインクルードする
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdlib.h>
+#include <new>
+
+static size_t alloc_count = 0;
+
+void *operator new(size_t size) {
+    alloc_count++;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,62 @@
+// PC上でのテスト用 Arduino.h の代替（pio test -e native）
+// src/ のうちハードウェアに依存しないモジュールをビルドするのに必要な最小限の定義のみ
+#ifndef ARDUINO_SHIM_H
+#define ARDUINO_SHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Arduino の String の最小限の代替
+// ヒープ確保をテストで数えられるように new[] / delete[] を使う
+class String {
+public:
+    String(const char *s = "") { assign(s, strlen(s)); }
+    explicit String(char c) { assign(&c, 1); }
+    String(const String &other) { assign(other.buf, other.len); }
+    ~String() { delete[] buf; }
+
+    String &operator=(const String &other) {
+        if (this != &other) {
+            delete[] buf;
+            assign(other.buf, other.len);
+        }
+        return *this;
+    }
+
+    String &operator+=(const String &other) {
+        char *next = new char[len + other.len + 1];
+        memcpy(next, buf, len);
+        memcpy(next + len, other.buf, other.len + 1);
+        delete[] buf;
+        buf = next;
+        len += other.len;
+        return *this;
+    }
+
+    friend String operator+(const String &a, const String &b) {
+        String ret(a);
+        ret += b;
+        return ret;
+    }
+
+    bool operator==(const char *s) const { return strcmp(buf, s) == 0; }
+    bool operator==(const String &s) const { return strcmp(buf, s.buf) == 0; }
+
+    const char *c_str() const { return buf; }
+    unsigned int length() const { return len; }
+
+private:
+    char *buf;
+    unsigned int len;
+
+    void assign(const char *s, size_t n) {
+        buf = new char[n + 1];
+        memcpy(buf, s, n);
+        buf[n] = '\0';
+        len = (unsigned int)n;
+    }
+};
+
+#endif // ARDUINO_SHIM_H
@@ -0,0 +1,299 @@
+// ChordDetector のテスト（pio test -e native）
+#include <unity.h>
+#include "ChordDetector.h"
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+#define MOD_LCTRL 0x01
+#define MOD_LSHIFT 0x02
+#define MOD_RCTRL 0x10
+#define KEY_K 0x0E
+#define KEY_M 0x10
+
+// ハンドラに文脈を渡せないため、ホットキーごとのハンドラでイベントを記録する
+#define LOG_MAX 32
+
+struct LogEntry {
+    int chord;
+    ChordEvent event;
+};
+
+static ChordDetector detector;
+static LogEntry event_log[LOG_MAX];
+static int log_count;
+static int chord_count;
+
+static void record(int chord, ChordEvent event) {
+    TEST_ASSERT_TRUE(log_count < LOG_MAX);
+    event_log[log_count].chord = chord;
+    event_log[log_count].event = event;
+    log_count++;
+}
+
+static void on_chord0(ChordEvent event) { record(0, event); }
+static void on_chord1(ChordEvent event) { record(1, event); }
+static void on_chord2(ChordEvent event) { record(2, event); }
+
+static ChordHandler const handlers[] = {on_chord0, on_chord1, on_chord2};
+
+// 登録順に0, 1, 2の番号でイベントを記録するホットキーを追加する
+static int add(uint8_t modifiers, uint8_t keycode, uint32_t hold_ms = 0) {
+    chord_count++;
+    return detector.addChord(modifiers, keycode, handlers[chord_count - 1], hold_ms);
+}
+
+// 修飾キーと最大2つのキーコードからレポートを作って渡す
+static void send(uint32_t now_ms, uint8_t modifiers, uint8_t key1 = 0, uint8_t key2 = 0) {
+    uint8_t report[8] = {modifiers, 0, key1, key2, 0, 0, 0, 0};
+    detector.update(report, now_ms);
+}
+
+static void assert_log(int index, int chord, ChordEvent event) {
+    TEST_ASSERT_TRUE(index < log_count);
+    TEST_ASSERT_EQUAL(chord, event_log[index].chord);
+    TEST_ASSERT_EQUAL(event, event_log[index].event);
+}
+
+void setUp(void) {
+    detector = ChordDetector();
+    log_count = 0;
+    chord_count = 0;
+}
+
+void tearDown(void) {
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_press_release(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+
+    send(0, MOD_LCTRL, KEY_M);
+    TEST_ASSERT_EQUAL(1, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    TEST_ASSERT_TRUE(detector.isAnyActive());
+
+    send(10, 0);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+    TEST_ASSERT_FALSE(detector.isAnyActive());
+}
+
+void test_right_modifier(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+
+    // 右Ctrlも左Ctrlと同じ扱い
+    send(0, MOD_RCTRL, KEY_M);
+    send(10, 0);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+}
+
+void test_modifiers_must_match_exactly(void) {
+    add(CHORD_MOD_CTRL, KEY_M);
+
+    send(0, MOD_LCTRL | MOD_LSHIFT, KEY_M);
+    send(10, 0, KEY_M);
+    send(20, 0);
+    TEST_ASSERT_EQUAL(0, log_count);
+    TEST_ASSERT_FALSE(detector.isAnyActive());
+}
+
+void test_repeated_report_does_not_refire(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+
+    // 押しっぱなしの間、同じレポートが何度届いても押下は1回だけ
+    for (uint32_t t = 0; t < 1000; t += 8) {
+        send(t, MOD_LCTRL, KEY_M);
+    }
+    TEST_ASSERT_EQUAL(1, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+
+    for (uint32_t t = 1000; t < 1100; t += 8) {
+        send(t, 0);
+    }
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+}
+
+void test_rollover_keeps_state(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+
+    send(0, MOD_LCTRL, KEY_M);
+    // 同時押し過多のレポートでは解放も再押下も起きない
+    uint8_t rollover[8] = {MOD_LCTRL, 0, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01};
+    detector.update(rollover, 10);
+    send(20, MOD_LCTRL, KEY_M);
+    TEST_ASSERT_EQUAL(1, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    TEST_ASSERT_TRUE(detector.isAnyActive());
+}
+
+void test_modifier_held_across_taps(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+    int ctrl_k = add(CHORD_MOD_CTRL, KEY_K);
+
+    // Ctrlを押したままM, K, Mを順に叩く
+    send(0, MOD_LCTRL);
+    send(10, MOD_LCTRL, KEY_M);
+    send(20, MOD_LCTRL);
+    send(30, MOD_LCTRL, KEY_K);
+    send(40, MOD_LCTRL);
+    send(50, MOD_LCTRL, KEY_M);
+    send(60, MOD_LCTRL);
+    send(70, 0);
+
+    TEST_ASSERT_EQUAL(6, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+    assert_log(2, ctrl_k, CHORD_PRESS);
+    assert_log(3, ctrl_k, CHORD_RELEASE);
+    assert_log(4, ctrl_m, CHORD_PRESS);
+    assert_log(5, ctrl_m, CHORD_RELEASE);
+}
+
+void test_release_key_first(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+
+    send(0, MOD_LCTRL, KEY_M);
+    // キーを先に離した時点で解放、その後の修飾キーの解放では何も起きない
+    send(10, MOD_LCTRL);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+
+    send(20, 0);
+    TEST_ASSERT_EQUAL(2, log_count);
+}
+
+void test_release_modifier_first(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+
+    send(0, MOD_LCTRL, KEY_M);
+    // 修飾キーを先に離した時点で解放、その後のキーの解放では何も起きない
+    send(10, 0, KEY_M);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+    TEST_ASSERT_FALSE(detector.isAnyActive());
+
+    send(20, 0);
+    TEST_ASSERT_EQUAL(2, log_count);
+}
+
+void test_release_modifier_first_switches_chord(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+    int plain_m = add(0, KEY_M);
+
+    send(0, MOD_LCTRL, KEY_M);
+    // 修飾キーだけを離すと、同じキーの修飾なしホットキーに切り替わる（解放が先）
+    send(10, 0, KEY_M);
+    send(20, 0);
+
+    TEST_ASSERT_EQUAL(4, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+    assert_log(2, plain_m, CHORD_PRESS);
+    assert_log(3, plain_m, CHORD_RELEASE);
+}
+
+void test_overlapping_chords_share_modifier(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+    int ctrl_k = add(CHORD_MOD_CTRL, KEY_K);
+
+    // Ctrl+Mを押したままKを追加で押す
+    send(0, MOD_LCTRL, KEY_M);
+    send(10, MOD_LCTRL, KEY_M, KEY_K);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    assert_log(1, ctrl_k, CHORD_PRESS);
+
+    // Mを離してもCtrl+Kは押されたまま（Kはレポートの先頭に詰められる）
+    send(20, MOD_LCTRL, KEY_K);
+    TEST_ASSERT_EQUAL(3, log_count);
+    assert_log(2, ctrl_m, CHORD_RELEASE);
+    TEST_ASSERT_TRUE(detector.isAnyActive());
+
+    // 共有している修飾キーを離すと残りも解放される
+    send(30, 0, KEY_K);
+    TEST_ASSERT_EQUAL(4, log_count);
+    assert_log(3, ctrl_k, CHORD_RELEASE);
+    TEST_ASSERT_FALSE(detector.isAnyActive());
+}
+
+void test_overlapping_chords_released_together(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M);
+    int ctrl_k = add(CHORD_MOD_CTRL, KEY_K);
+
+    // 同じレポートで押されて同じレポートで離される
+    send(0, MOD_LCTRL, KEY_K, KEY_M);
+    send(10, 0);
+
+    TEST_ASSERT_EQUAL(4, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    assert_log(1, ctrl_k, CHORD_PRESS);
+    assert_log(2, ctrl_m, CHORD_RELEASE);
+    assert_log(3, ctrl_k, CHORD_RELEASE);
+}
+
+void test_hold_fires_once(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M, 500);
+
+    send(0, MOD_LCTRL, KEY_M);
+    send(499, MOD_LCTRL, KEY_M);
+    TEST_ASSERT_EQUAL(1, log_count);
+
+    // 長押しは時間経過を満たした最初の更新で1回だけ
+    send(500, MOD_LCTRL, KEY_M);
+    send(900, MOD_LCTRL, KEY_M);
+    send(2000, MOD_LCTRL, KEY_M);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(1, ctrl_m, CHORD_HOLD);
+
+    send(2010, 0);
+    TEST_ASSERT_EQUAL(3, log_count);
+    assert_log(2, ctrl_m, CHORD_RELEASE);
+}
+
+void test_hold_not_fired_after_short_press(void) {
+    int ctrl_m = add(CHORD_MOD_CTRL, KEY_M, 500);
+
+    send(0, MOD_LCTRL, KEY_M);
+    send(100, 0);
+    send(1000, 0);
+    TEST_ASSERT_EQUAL(2, log_count);
+    assert_log(0, ctrl_m, CHORD_PRESS);
+    assert_log(1, ctrl_m, CHORD_RELEASE);
+
+    // 押し直すと長押しの計測もやり直す
+    send(1100, MOD_LCTRL, KEY_M);
+    send(1500, MOD_LCTRL, KEY_M);
+    TEST_ASSERT_EQUAL(3, log_count);
+    send(1600, MOD_LCTRL, KEY_M);
+    TEST_ASSERT_EQUAL(4, log_count);
+    assert_log(3, ctrl_m, CHORD_HOLD);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_press_release);
+    RUN_TEST(test_right_modifier);
+    RUN_TEST(test_modifiers_must_match_exactly);
+    RUN_TEST(test_repeated_report_does_not_refire);
+    RUN_TEST(test_rollover_keeps_state);
+    RUN_TEST(test_modifier_held_across_taps);
+    RUN_TEST(test_release_key_first);
+    RUN_TEST(test_release_modifier_first);
+    RUN_TEST(test_release_modifier_first_switches_chord);
+    RUN_TEST(test_overlapping_chords_share_modifier);
+    RUN_TEST(test_overlapping_chords_released_together);
+    RUN_TEST(test_hold_fires_once);
+    RUN_TEST(test_hold_not_fired_after_short_press);
+    return UNITY_END();
+}
@@ -0,0 +1,96 @@
+// KanaBuffer のテスト（pio test -e native）
+#include <unity.h>
+#include "KanaBuffer.h"
+
+// HIDキーコード
+#define KEY(c) ((uint8_t)(0x04 + ((c) - 'a')))
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static KanaBuffer buffer;
+static RomajiConverter converter;
+
+void setUp(void) {
+    buffer.clear();
+    converter = RomajiConverter();
+    converter.setMode(MODE_ROMAJI);
+}
+
+void tearDown(void) {
+}
+
+// ローマ字列を入力し、確定したかなをバッファに追加する
+static void type(const char *romaji) {
+    for (const char *p = romaji; *p; p++) {
+        RomajiResult r = converter.processKey(KEY(*p));
+        if (r.hasKana()) {
+            buffer.push(r, converter.getMode() == MODE_KATAKANA);
+        }
+    }
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_push_pop(void) {
+    type("kyouha");
+    TEST_ASSERT_EQUAL(3, buffer.size());
+    TEST_ASSERT_EQUAL_STRING("きょ", buffer.at(0).kana());
+    TEST_ASSERT_EQUAL(2, buffer.at(0).glyphs());
+    TEST_ASSERT_EQUAL_STRING("kyo", buffer.at(0).romaji);
+    TEST_ASSERT_EQUAL_STRING("は", buffer.back().kana());
+
+    KanaUnit unit;
+    TEST_ASSERT_TRUE(buffer.pop(&unit));
+    TEST_ASSERT_EQUAL_STRING("は", unit.kana());
+    TEST_ASSERT_EQUAL_STRING("ha", unit.romaji);
+    TEST_ASSERT_EQUAL(2, buffer.size());
+    TEST_ASSERT_EQUAL_STRING("う", buffer.back().kana());
+}
+
+void test_pop_empty(void) {
+    KanaUnit unit;
+    TEST_ASSERT_FALSE(buffer.pop(&unit));
+    TEST_ASSERT_TRUE(buffer.empty());
+}
+
+void test_katakana_unit(void) {
+    converter.setMode(MODE_KATAKANA);
+    type("matcha");
+    TEST_ASSERT_EQUAL(3, buffer.size());
+    TEST_ASSERT_EQUAL_STRING("マ", buffer.at(0).kana());
+    TEST_ASSERT_EQUAL_STRING("ッ", buffer.at(1).kana());
+    TEST_ASSERT_EQUAL_STRING("チャ", buffer.at(2).kana());
+}
+
+void test_overflow_drops_oldest(void) {
+    for (int i = 0; i < KANA_BUFFER_MAX; i++) {
+        type("a");
+    }
+    type("ki");
+    TEST_ASSERT_EQUAL(KANA_BUFFER_MAX, buffer.size());
+    TEST_ASSERT_EQUAL_STRING("あ", buffer.at(0).kana());
+    TEST_ASSERT_EQUAL_STRING("き", buffer.back().kana());
+
+    // 末尾から削除しきれる
+    KanaUnit unit;
+    for (int i = 0; i < KANA_BUFFER_MAX; i++) {
+        TEST_ASSERT_TRUE(buffer.pop(&unit));
+    }
+    TEST_ASSERT_FALSE(buffer.pop(&unit));
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop);
+    RUN_TEST(test_pop_empty);
+    RUN_TEST(test_katakana_unit);
+    RUN_TEST(test_overflow_drops_oldest);
+    return UNITY_END();
+}
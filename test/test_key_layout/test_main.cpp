@@ -0,0 +1,137 @@
+// KeyLayout のテスト（pio test -e native）
+#include <unity.h>
+#include "KeyLayout.h"
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static KeyLayout layout;
+
+void setUp(void) {
+    layout = KeyLayout();
+}
+
+void tearDown(void) {
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_default_is_jis(void) {
+    TEST_ASSERT_EQUAL(LAYOUT_JIS, layout.getId());
+    TEST_ASSERT_EQUAL('@', layout.charOf(0x2F, false));
+}
+
+void test_letters_and_digits(void) {
+    TEST_ASSERT_TRUE(layout.loadBuiltin(LAYOUT_US));
+    TEST_ASSERT_EQUAL('A', layout.charOf(0x04, false));
+    TEST_ASSERT_EQUAL('A', layout.charOf(0x04, true));
+    TEST_ASSERT_EQUAL('Z', layout.charOf(0x1D, false));
+    TEST_ASSERT_EQUAL('1', layout.charOf(0x1E, false));
+    TEST_ASSERT_EQUAL('0', layout.charOf(0x27, false));
+}
+
+void test_us_symbols(void) {
+    TEST_ASSERT_TRUE(layout.loadBuiltin(LAYOUT_US));
+    TEST_ASSERT_EQUAL('@', layout.charOf(0x1F, true));
+    TEST_ASSERT_EQUAL('[', layout.charOf(0x2F, false));
+    TEST_ASSERT_EQUAL('"', layout.charOf(0x34, true));
+    TEST_ASSERT_EQUAL('\0', layout.charOf(0x87, false));
+}
+
+void test_jis_symbols(void) {
+    TEST_ASSERT_TRUE(layout.loadBuiltin(LAYOUT_JIS));
+    TEST_ASSERT_EQUAL('"', layout.charOf(0x1F, true));
+    TEST_ASSERT_EQUAL('\0', layout.charOf(0x27, true));
+    TEST_ASSERT_EQUAL(':', layout.charOf(0x34, false));
+    TEST_ASSERT_EQUAL('_', layout.charOf(0x87, true));
+    TEST_ASSERT_EQUAL('|', layout.charOf(0x89, true));
+}
+
+void test_keypad(void) {
+    for (int id = LAYOUT_US; id <= LAYOUT_JIS; id++) {
+        TEST_ASSERT_TRUE(layout.loadBuiltin((KeyLayoutId)id));
+        TEST_ASSERT_EQUAL('1', layout.charOf(0x59, false));
+        TEST_ASSERT_EQUAL('1', layout.charOf(0x59, true));
+        TEST_ASSERT_EQUAL('0', layout.charOf(0x62, false));
+        TEST_ASSERT_EQUAL('/', layout.charOf(0x54, false));
+        TEST_ASSERT_EQUAL('.', layout.charOf(0x63, false));
+        // テンキーのEnterは文字なし
+        TEST_ASSERT_EQUAL('\0', layout.charOf(0x58, false));
+    }
+}
+
+void test_printable_coverage(void) {
+    // 0x1E〜0x38の数字・記号キーは、どちらの配列でもShiftなしで文字がある（JISの0x35 半角/全角を除く）
+    for (int id = LAYOUT_US; id <= LAYOUT_JIS; id++) {
+        TEST_ASSERT_TRUE(layout.loadBuiltin((KeyLayoutId)id));
+        for (uint8_t keycode = 0x1E; keycode <= 0x38; keycode++) {
+            if (keycode >= 0x28 && keycode <= 0x2C) {
+                continue;  // Enter, Esc, BackSpace, Tab, Space
+            }
+            if (id == LAYOUT_JIS && keycode == 0x35) {
+                continue;
+            }
+            TEST_ASSERT_TRUE(layout.charOf(keycode, false) != '\0');
+        }
+    }
+}
+
+void test_no_user_builtin(void) {
+    TEST_ASSERT_FALSE(layout.loadBuiltin(LAYOUT_USER));
+    TEST_ASSERT_EQUAL(LAYOUT_JIS, layout.getId());
+}
+
+void test_load_binary(void) {
+    const uint8_t data[] = {'K', 'L', 1, 2, 0x04, 'Q', 'Q', 0x14, 'A', 'A'};
+    TEST_ASSERT_TRUE(layout.loadBinary(LAYOUT_USER, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(LAYOUT_USER, layout.getId());
+    TEST_ASSERT_EQUAL('Q', layout.charOf(0x04, false));
+    TEST_ASSERT_EQUAL('A', layout.charOf(0x14, true));
+    // ファイルにないキーは文字なし
+    TEST_ASSERT_EQUAL('\0', layout.charOf(0x05, false));
+}
+
+void test_load_binary_rejects_invalid(void) {
+    const uint8_t bad_magic[] = {'K', 'X', 1, 1, 0x04, 'Q', 'Q'};
+    const uint8_t bad_version[] = {'K', 'L', 2, 1, 0x04, 'Q', 'Q'};
+    const uint8_t bad_length[] = {'K', 'L', 1, 2, 0x04, 'Q', 'Q'};
+    const uint8_t bad_char[] = {'K', 'L', 1, 1, 0x04, ' ', 'Q'};
+
+    TEST_ASSERT_FALSE(layout.loadBinary(LAYOUT_USER, bad_magic, sizeof(bad_magic)));
+    TEST_ASSERT_FALSE(layout.loadBinary(LAYOUT_USER, bad_version, sizeof(bad_version)));
+    TEST_ASSERT_FALSE(layout.loadBinary(LAYOUT_USER, bad_length, sizeof(bad_length)));
+    TEST_ASSERT_FALSE(layout.loadBinary(LAYOUT_USER, bad_char, sizeof(bad_char)));
+    TEST_ASSERT_FALSE(layout.loadBinary(LAYOUT_USER, bad_char, 2));
+
+    // 現在の配列は変わらない
+    TEST_ASSERT_EQUAL(LAYOUT_JIS, layout.getId());
+    TEST_ASSERT_EQUAL('A', layout.charOf(0x04, false));
+}
+
+void test_shift_modifiers(void) {
+    TEST_ASSERT_TRUE(KeyLayout::isShift(0x02));   // 左Shift
+    TEST_ASSERT_TRUE(KeyLayout::isShift(0x20));   // 右Shift
+    TEST_ASSERT_FALSE(KeyLayout::isShift(0x01));  // 左Ctrl
+    TEST_ASSERT_FALSE(KeyLayout::isShift(0x00));
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_default_is_jis);
+    RUN_TEST(test_letters_and_digits);
+    RUN_TEST(test_us_symbols);
+    RUN_TEST(test_jis_symbols);
+    RUN_TEST(test_keypad);
+    RUN_TEST(test_printable_coverage);
+    RUN_TEST(test_no_user_builtin);
+    RUN_TEST(test_load_binary);
+    RUN_TEST(test_load_binary_rejects_invalid);
+    RUN_TEST(test_shift_modifiers);
+    return UNITY_END();
+}
@@ -0,0 +1,1440 @@
+// PC上でのテスト用: MAX3421E のソフトウェアモデル（max3421_sim.h）
+#include "max3421_sim.h"
+#include "host/usbh.h"  // tusb.h は含めない（osal_none.h の宣言で osal_task_delay() が弱いシンボルになる）
+#include <string.h>
+
+extern "C" void hcd_int_handler(uint8_t rhport, bool in_isr);
+
+//--------------------------------------------------------------------+
+// MAX3421E レジスタ（データシートのレジスタ番号）
+//--------------------------------------------------------------------+
+
+enum {
+    REG_RCVFIFO = 1,
+    REG_SNDFIFO = 2,
+    REG_SUDFIFO = 4,
+    REG_RCVBC = 6,
+    REG_SNDBC = 7,
+    REG_USBIRQ = 13,
+    REG_USBCTL = 15,
+    REG_CPUCTL = 16,
+    REG_PINCTL = 17,
+    REG_REVISION = 18,
+    REG_HIRQ = 25,
+    REG_HIEN = 26,
+    REG_MODE = 27,
+    REG_PERADDR = 28,
+    REG_HCTL = 29,
+    REG_HXFR = 30,
+    REG_HRSL = 31,
+    REG_NUM = 32
+};
+
+enum {
+    USBIRQ_OSCOK = 0x01,
+    USBCTL_CHIPRES = 0x20,
+    CPUCTL_IE = 0x01,
+    PINCTL_PRESERVED = 0x1f,
+
+    HIRQ_BUSEVENT = 0x01,
+    HIRQ_RCVDAV = 0x04,
+    HIRQ_SNDBAV = 0x08,
+    HIRQ_CONDET = 0x20,
+    HIRQ_FRAME = 0x40,
+    HIRQ_HXFRDN = 0x80,
+
+    MODE_LOWSPEED = 0x02,
+    MODE_SOFKAENAB = 0x08,
+
+    HCTL_BUSRST = 0x01,
+    HCTL_RCVTOG0 = 0x10,
+    HCTL_RCVTOG1 = 0x20,
+    HCTL_SNDTOG0 = 0x40,
+    HCTL_SNDTOG1 = 0x80,
+
+    HXFR_SETUP = 0x10,
+    HXFR_OUT_NIN = 0x20,
+    HXFR_HS = 0x80,
+
+    HRSL_RCVTOGRD = 0x10,
+    HRSL_SNDTOGRD = 0x20,
+    HRSL_KSTATUS = 0x40,
+    HRSL_JSTATUS = 0x80
+};
+
+enum {
+    HRSL_SUCCESS = 0,
+    HRSL_NAK = 4,
+    HRSL_STALL = 5,
+    HRSL_TOG_ERR = 6,
+    HRSL_TIMEOUT = 14
+};
+
+// 時間（ナノ秒）
+#define FRAME_NS 1000000ull      // SOF の間隔
+#define BUS_RESET_NS 50000000ull // BUSRST の長さ（50ms）
+#define HUB_PORT_RESET_NS 10000000ull  // ハブのポートリセットの長さ（10ms）
+#define FS_BIT_NS 83ull          // フルスピード 12Mbps の1ビット
+
+// USB パケットのビット数（SYNC・PID・CRC・EOP を含む）
+#define TOKEN_BITS 35u
+#define HANDSHAKE_BITS 19u
+#define TURNAROUND_BITS 8u
+#define TIMEOUT_BITS 18u
+#define DATA_BITS(len) (35u + 8u * (len))
+
+#define EP0_SIZE 8
+#define SERVICE_CALL_MAX 1000  // INT が解除されない場合に hcd_int_handler() を呼ぶ上限
+#define ASYNC_DATA_MAX 64      // 非同期 SPI トランザクションのデータの最大長（FIFO の大きさ）
+#define SIM_DEVICE_MAX (1 + MAX3421_SIM_HUB_PORT_MAX)  // ルートのデバイスとハブの下流のデバイス
+#define SIM_NO_PARENT 0xff     // ルートポートに接続されている
+
+//--------------------------------------------------------------------+
+// HID キーボードの記述子
+//--------------------------------------------------------------------+
+
+static const uint8_t desc_report[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,              // Usage Page (Generic Desktop), Usage (Keyboard)
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00,  // 修飾キー
+    0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,              // 予約
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01,  // LED
+    0x29, 0x05, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03,
+    0x91, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65,  // キーコード
+    0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+    0xC0
+};
+
+static const uint8_t desc_device[] = {
+    18, 0x01, 0x00, 0x02,  // bcdUSB 2.00
+    0x00, 0x00, 0x00,      // クラスはインターフェースで指定
+    EP0_SIZE,
+    0xFE, 0xCA, 0x01, 0x40,  // VID 0xCAFE, PID 0x4001
+    0x00, 0x01,
+    0x00, 0x00, 0x00,  // 文字列記述子なし
+    0x01
+};
+
+#define DESC_CONFIG_LEN (9 + 9 + 9 + 7 + 9 + 7)
+#define SERIAL_INDEX 3  // シリアル番号の文字列ディスクリプタのインデックス
+#define SERIAL_MAX 32   // シリアル番号の最大文字数
+
+//--------------------------------------------------------------------+
+// ハブの記述子
+//--------------------------------------------------------------------+
+
+static const uint8_t desc_device_hub[] = {
+    18, 0x01, 0x00, 0x02,  // bcdUSB 2.00
+    0x09, 0x00, 0x00,      // ハブ（フルスピード）
+    EP0_SIZE,
+    0xFE, 0xCA, 0x02, 0x40,  // VID 0xCAFE, PID 0x4002
+    0x00, 0x01,
+    0x00, 0x00, 0x00,
+    0x01
+};
+
+#define DESC_CONFIG_HUB_LEN (9 + 9 + 7)
+#define HUB_STATUS_INTERVAL 12  // ステータス変化の interrupt IN の bInterval（フレーム）
+
+// ポートの状態と変化（wPortStatus・wPortChange のビット）
+enum {
+    PORT_STAT_CONNECTION = 0x0001,
+    PORT_STAT_ENABLE = 0x0002,
+    PORT_STAT_RESET = 0x0010,
+    PORT_STAT_POWER = 0x0100
+};
+
+// ポートの機能（SET_FEATURE / CLEAR_FEATURE）
+enum {
+    PORT_FEAT_ENABLE = 1,
+    PORT_FEAT_RESET = 4,
+    PORT_FEAT_POWER = 8,
+    PORT_FEAT_C_CONNECTION = 16,
+    PORT_FEAT_C_ENABLE = 17,
+    PORT_FEAT_C_RESET = 20
+};
+#define BULK_OUT_EP 2
+#define BULK_OUT_SIZE 64
+
+//--------------------------------------------------------------------+
+// 状態
+//--------------------------------------------------------------------+
+
+enum CtrlStage {
+    CTRL_IDLE,
+    CTRL_DATA_IN,
+    CTRL_DATA_OUT,
+    CTRL_STATUS
+};
+
+enum SimDeviceKind {
+    SIM_KEYBOARD,  // HID キーボードと bulk OUT の複合デバイス
+    SIM_HUB
+};
+
+// ハブの下流ポート
+struct SimPort {
+    bool powered;
+    bool connected;
+    bool enabled;
+    bool resetting;
+    uint64_t reset_done_ns;
+    uint16_t change;  // wPortChange（C_CONNECTION・C_ENABLE・C_RESET）
+    uint8_t child;    // 接続されたデバイス（devs[] のインデックス、0 はなし）
+};
+
+struct SimDevice {
+    SimDeviceKind kind;
+    bool attached;
+    uint8_t parent;   // 接続先のハブ（devs[] のインデックス、SIM_NO_PARENT はルートポート）
+    uint8_t port;     // ハブのポート番号（1〜）
+    uint8_t address;
+    uint8_t pending_address;  // SET_ADDRESS のステータスステージで反映する
+    bool configured;
+    uint8_t in_toggle[16];
+    uint8_t out_toggle[16];
+
+    // コントロール転送
+    uint8_t setup[8];
+    CtrlStage stage;
+    bool stall;
+    uint8_t buf[256];
+    uint16_t len;
+    uint16_t pos;
+
+    // キーボード
+    uint8_t interval;
+    uint8_t led;
+    uint8_t report[8][MAX3421_SIM_REPORT_MAX];
+    uint8_t report_len[8];
+    uint8_t report_head;
+    uint8_t report_count;
+
+    // bulk OUT で受け取ったデータ
+    uint8_t bulk[MAX3421_SIM_BULK_OUT_MAX];
+    uint16_t bulk_len;
+
+    // スクリプト（[0..15] OUT、[16..31] IN）
+    Max3421SimResponse script[32];
+    uint16_t script_count[32];
+    uint16_t script_skip[32];  // スクリプトの前に通常どおり応答するトランザクション数
+
+    // ハブ
+    uint8_t port_count;
+    SimPort ports[MAX3421_SIM_HUB_PORT_MAX];
+};
+
+// 完了待ちの USB トランザクション（HXFR を書いた時点で応答を決め、完了時刻にチップに反映する）
+struct SimXfer {
+    bool busy;
+    uint64_t done_ns;
+    uint8_t result;
+    bool rcv;            // RCVFIFO にデータを入れる
+    uint8_t rcv_len;
+    uint8_t rcv_data[64];
+    bool snd;            // SNDFIFO のパケットを送信中
+    bool snd_release;    // SNDFIFO のバッファを解放する
+    bool snd_nak;        // SNDFIFO のパケットが NAK された（Host OUT NAK のエラッタ）
+    int8_t rcvtog;       // 完了後のトグル（-1 は変更なし）
+    int8_t sndtog;
+};
+
+// SPI と INT ピン（チップリセットの影響を受けない）
+struct SimBus {
+    bool cs;
+    bool cmd_done;
+    uint8_t cmd_reg;
+    bool cmd_write;
+    uint64_t cs_ns;  // CS アサート中に転送したバイトの時間
+    bool int_enabled;
+    bool int_locked_spi;  // 割り込み禁止中に CS がアサートされた
+    bool in_handler;
+};
+
+struct SimChip {
+    uint8_t reg[REG_NUM];
+
+    // FIFO
+    uint8_t sud[8];
+    uint8_t sud_pos;
+    uint8_t snd[2][64];
+    uint8_t snd_len[2];
+    uint8_t snd_fill;   // CPU が書き込むバッファ
+    uint8_t snd_pos;
+    uint8_t snd_count;  // SNDBC で送信待ちにしたバッファ数
+    bool snd_rewind;    // NAK の後、SNDBC = 0 で巻き戻すまで SNDFIFO は使えない
+    uint8_t rcv[2][64];
+    uint8_t rcv_len[2];
+    uint8_t rcv_head;
+    uint8_t rcv_count;
+    uint8_t rcv_pos;
+
+    uint8_t rcvtog;
+    uint8_t sndtog;
+
+    SimXfer xfer;
+    bool resetting;
+    uint64_t reset_done_ns;
+    bool sof;
+    uint64_t next_frame_ns;
+};
+
+// 非同期 SPI（tuh_max3421_spi_submit_api）のキュー（深さ1）
+// チップの状態は投入時に更新し（バス上で先に実行されたのと同じ）、受信データは完了時に渡す
+struct SimAsync {
+    bool enabled;
+    tuh_max3421_spi_xact_t *xact;  // 実行中のトランザクション
+    uint64_t done_ns;
+    uint8_t status;
+    uint8_t data[ASYNC_DATA_MAX];
+};
+
+// タイマー（tuh_max3421_wakeup_api）による hcd_int_handler() の呼び出し（ESP32 の esp_timer に相当）
+struct SimWake {
+    bool armed;
+    uint64_t at_ns;
+};
+
+// INT の処理（ESP32 の GPIO の ISR と割り込みタスク）
+struct SimIntr {
+    bool asserted;        // INT のアサートを検出済み（解除まで）
+    uint64_t asserted_ns;
+    bool task_pending;    // 割り込みタスクの起床待ち
+    uint64_t task_at_ns;
+};
+
+static Max3421SimConfig sim_config;
+static char serial_number[SERIAL_MAX + 1];
+static SimAsync async_spi;
+static SimWake wake;
+static SimIntr intr;
+static SimBus bus;
+static SimChip chip;
+static SimDevice devs[SIM_DEVICE_MAX];
+static SimDevice &dev = devs[0];  // ルートポートのデバイス
+static Max3421SimStats stats;
+static Max3421SimPollStats poll_stats;
+static uint32_t last_poll_frame;
+static uint64_t now_ns;
+
+//--------------------------------------------------------------------+
+// チップ
+//--------------------------------------------------------------------+
+
+static void update_sndbav(void) {
+    if (chip.snd_count < 2) {
+        chip.reg[REG_HIRQ] |= HIRQ_SNDBAV;
+    } else {
+        chip.reg[REG_HIRQ] &= (uint8_t)~HIRQ_SNDBAV;
+    }
+}
+
+static uint8_t hrsl_value(void) {
+    uint8_t hrsl = chip.reg[REG_HRSL] & 0x0f;
+    if (chip.rcvtog) {
+        hrsl |= HRSL_RCVTOGRD;
+    }
+    if (chip.sndtog) {
+        hrsl |= HRSL_SNDTOGRD;
+    }
+    // フルスピードのデバイスのアイドルは J
+    if (dev.attached && !chip.resetting) {
+        hrsl |= HRSL_JSTATUS;
+    }
+    return hrsl;
+}
+
+// PINCTL 以外のレジスタと FIFO をクリアする
+static void chip_reset(void) {
+    uint8_t const pinctl = chip.reg[REG_PINCTL];
+    memset(&chip, 0, sizeof(chip));
+    chip.reg[REG_PINCTL] = pinctl;
+    update_sndbav();
+}
+
+// 送信待ちの SNDFIFO バッファのうち最も古いもの
+static uint8_t snd_oldest(void) {
+    return (uint8_t)((chip.snd_fill + chip.snd_count) & 1);
+}
+
+static void start_frames(void) {
+    chip.sof = true;
+    chip.next_frame_ns = now_ns + FRAME_NS;
+}
+
+static void device_bus_reset(SimDevice &d) {
+    d.address = 0;
+    d.configured = false;
+    d.stage = CTRL_IDLE;
+    memset(d.in_toggle, 0, sizeof(d.in_toggle));
+    memset(d.out_toggle, 0, sizeof(d.out_toggle));
+    // ハブはポートの電源が切れ、下流のデバイスは見えなくなる
+    for (uint8_t i = 0; i < d.port_count; i++) {
+        SimPort &port = d.ports[i];
+        port.powered = false;
+        port.connected = false;
+        port.enabled = false;
+        port.resetting = false;
+        port.change = 0;
+    }
+}
+
+// ホストからパケットが届くか（ルートポートからハブのポートをたどる）
+static bool device_reachable(const SimDevice &d) {
+    if (!d.attached) {
+        return false;
+    }
+    if (d.parent == SIM_NO_PARENT) {
+        return !chip.resetting;
+    }
+    const SimDevice &hub = devs[d.parent];
+    const SimPort &port = hub.ports[d.port - 1];
+    return port.enabled && !port.resetting && device_reachable(hub);
+}
+
+// PERADDR のアドレスのデバイス。同じアドレスのデバイスが複数見えていれば addr_conflict に数える
+static SimDevice *device_find(uint8_t address) {
+    SimDevice *found = NULL;
+    for (uint8_t i = 0; i < SIM_DEVICE_MAX; i++) {
+        SimDevice &d = devs[i];
+        if (d.address != address || !device_reachable(d)) {
+            continue;
+        }
+        if (found) {
+            stats.addr_conflict++;
+        } else {
+            found = &d;
+        }
+    }
+    return found;
+}
+
+// 最も早く終わるハブのポートリセット
+static SimPort *hub_port_resetting(void) {
+    SimPort *next = NULL;
+    for (uint8_t i = 0; i < SIM_DEVICE_MAX; i++) {
+        SimDevice &d = devs[i];
+        if (d.kind != SIM_HUB || !d.attached) {
+            continue;
+        }
+        for (uint8_t p = 0; p < d.port_count; p++) {
+            SimPort &port = d.ports[p];
+            if (port.resetting && (!next || port.reset_done_ns < next->reset_done_ns)) {
+                next = &port;
+            }
+        }
+    }
+    return next;
+}
+
+static bool int_asserted(void) {
+    return (chip.reg[REG_CPUCTL] & CPUCTL_IE) && (chip.reg[REG_HIRQ] & chip.reg[REG_HIEN]);
+}
+
+// 次のイベントの時刻
+static uint64_t next_event_ns(void) {
+    uint64_t next = UINT64_MAX;
+    if (chip.xfer.busy && chip.xfer.done_ns < next) {
+        next = chip.xfer.done_ns;
+    }
+    if (chip.resetting && chip.reset_done_ns < next) {
+        next = chip.reset_done_ns;
+    }
+    if (chip.sof && chip.next_frame_ns < next) {
+        next = chip.next_frame_ns;
+    }
+    SimPort const *port = hub_port_resetting();
+    if (port && port->reset_done_ns < next) {
+        next = port->reset_done_ns;
+    }
+    return next;
+}
+
+static void complete_xfer(void) {
+    SimXfer &x = chip.xfer;
+    x.busy = false;
+    chip.reg[REG_HRSL] = x.result;
+    if (x.rcvtog >= 0) {
+        chip.rcvtog = (uint8_t)x.rcvtog;
+    }
+    if (x.sndtog >= 0) {
+        chip.sndtog = (uint8_t)x.sndtog;
+    }
+    if (x.snd_release && chip.snd_count) {
+        chip.snd_count--;
+        update_sndbav();
+    }
+    if (x.snd_nak) {
+        // Host OUT NAK のエラッタ: HXFR を書き直しても NAK されたパケットは再送されない。
+        // NAK されたバッファは書き込み位置が戻らないまま CPU 側に戻り、先に入れた次のパケットも失われる。
+        // SNDBC に 0 を書いて巻き戻し、パケットを入れ直す必要がある
+        chip.snd_fill = snd_oldest();
+        chip.snd_count = 0;
+        chip.snd_rewind = true;
+        update_sndbav();
+    }
+    if (x.rcv) {
+        if (chip.rcv_count < 2) {
+            uint8_t const idx = (uint8_t)((chip.rcv_head + chip.rcv_count) & 1);
+            memcpy(chip.rcv[idx], x.rcv_data, x.rcv_len);
+            chip.rcv_len[idx] = x.rcv_len;
+            chip.rcv_count++;
+            chip.reg[REG_HIRQ] |= HIRQ_RCVDAV;
+        } else {
+            stats.protocol_err++;
+        }
+    }
+    chip.reg[REG_HIRQ] |= HIRQ_HXFRDN;
+}
+
+// 時刻 t までのイベントを処理する（hcd_int_handler() は呼ばない）
+static void advance_to(uint64_t t) {
+    for (;;) {
+        uint64_t const next = next_event_ns();
+        if (next > t) {
+            break;
+        }
+        now_ns = next;
+        SimPort *port = hub_port_resetting();
+        if (chip.xfer.busy && chip.xfer.done_ns == next) {
+            complete_xfer();
+        } else if (chip.resetting && chip.reset_done_ns == next) {
+            // バスリセットの終了時に接続状態を検出し直す
+            chip.resetting = false;
+            chip.reg[REG_HCTL] &= (uint8_t)~HCTL_BUSRST;
+            chip.reg[REG_HIRQ] |= HIRQ_BUSEVENT;
+            if (dev.attached) {
+                chip.reg[REG_HIRQ] |= HIRQ_CONDET;
+            }
+            if (chip.reg[REG_MODE] & MODE_SOFKAENAB) {
+                start_frames();
+            }
+        } else if (port && port->reset_done_ns == next) {
+            // ハブのポートリセットの終了: ポートが有効になり C_RESET が立つ
+            port->resetting = false;
+            port->enabled = port->connected;
+            port->change |= PORT_STAT_RESET;
+        } else {
+            stats.frames++;
+            chip.next_frame_ns += FRAME_NS;
+            chip.reg[REG_HIRQ] |= HIRQ_FRAME;
+        }
+    }
+    if (t > now_ns) {
+        now_ns = t;
+    }
+}
+
+//--------------------------------------------------------------------+
+// デバイス
+//--------------------------------------------------------------------+
+
+static uint16_t build_config_desc(const SimDevice &d, uint8_t *buf) {
+    if (d.kind == SIM_HUB) {
+        const uint8_t desc_hub[DESC_CONFIG_HUB_LEN] = {
+            // 構成
+            9, 0x02, DESC_CONFIG_HUB_LEN, 0x00, 0x01, 0x01, 0x00, 0xE0, 0,
+            // インターフェース（ハブ）
+            9, 0x04, 0x00, 0x00, 0x01, 0x09, 0x00, 0x00, 0x00,
+            // interrupt IN（ステータス変化、ポート7まで1バイト）
+            7, 0x05, 0x81, 0x03, 0x01, 0x00, HUB_STATUS_INTERVAL
+        };
+        memcpy(buf, desc_hub, sizeof(desc_hub));
+        return sizeof(desc_hub);
+    }
+    const uint8_t desc[DESC_CONFIG_LEN] = {
+        // 構成
+        9, 0x02, DESC_CONFIG_LEN, 0x00, 0x02, 0x01, 0x00, 0xA0, 50,
+        // インターフェース（HID、ブート、キーボード）
+        9, 0x04, 0x00, 0x00, 0x01, 0x03, 0x01, 0x01, 0x00,
+        // HID
+        9, 0x21, 0x11, 0x01, 0x00, 0x01, 0x22, (uint8_t)sizeof(desc_report), 0x00,
+        // interrupt IN
+        7, 0x05, 0x81, 0x03, MAX3421_SIM_REPORT_MAX, 0x00, d.interval,
+        // インターフェース（ベンダー、ドライバなし）
+        9, 0x04, 0x01, 0x00, 0x01, 0xFF, 0x00, 0x00, 0x00,
+        // bulk OUT
+        7, 0x05, BULK_OUT_EP, 0x02, BULK_OUT_SIZE, 0x00, 0x00
+    };
+    memcpy(buf, desc, sizeof(desc));
+    return sizeof(desc);
+}
+
+// ハブのポートに接続されたデバイスを検出する
+static void hub_port_detect(SimPort &port) {
+    bool const connected = port.powered && port.child && devs[port.child].attached;
+    if (connected != port.connected) {
+        port.connected = connected;
+        port.change |= PORT_STAT_CONNECTION;
+        if (!connected) {
+            port.enabled = false;
+        }
+    }
+}
+
+// ハブのコントロール転送（標準リクエストとハブクラスのリクエスト）。IN のデータ長を返す
+static uint16_t hub_setup(SimDevice &d, const uint8_t *setup) {
+    uint8_t const bm_request_type = setup[0];
+    uint8_t const b_request = setup[1];
+    uint16_t const w_value = (uint16_t)(setup[2] | (setup[3] << 8));
+    uint16_t const w_index = (uint16_t)(setup[4] | (setup[5] << 8));
+    SimPort *port = (w_index >= 1 && w_index <= d.port_count) ? &d.ports[w_index - 1] : NULL;
+
+    switch ((bm_request_type << 8) | b_request) {
+        case 0x8006:  // GET_DESCRIPTOR
+            if ((w_value >> 8) == 0x01) {
+                memcpy(d.buf, desc_device_hub, sizeof(desc_device_hub));
+                return sizeof(desc_device_hub);
+            }
+            if ((w_value >> 8) == 0x02) {
+                return build_config_desc(d, d.buf);
+            }
+            break;
+        case 0xA006: {  // GET_DESCRIPTOR（ハブ記述子、タイプ 0 も受け付ける）
+            if ((w_value >> 8) != 0x29 && (w_value >> 8) != 0x00) {
+                break;
+            }
+            const uint8_t desc[9] = {9, 0x29, d.port_count, 0x00, 0x00, 1, 0, 0x00, 0xFF};
+            memcpy(d.buf, desc, sizeof(desc));
+            return sizeof(desc);
+        }
+        case 0x0005:  // SET_ADDRESS
+            d.pending_address = (uint8_t)(w_value & 0x7f);
+            return 0;
+        case 0x0009:  // SET_CONFIGURATION
+            d.configured = (w_value == 1);
+            memset(d.in_toggle + 1, 0, sizeof(d.in_toggle) - 1);
+            return 0;
+        case 0xA000:  // GET_STATUS（ハブ）
+            memset(d.buf, 0, 4);
+            return 4;
+        case 0x2001:  // CLEAR_FEATURE（ハブ）
+        case 0x2003:  // SET_FEATURE（ハブ）
+            return 0;
+        case 0xA300:  // GET_STATUS（ポート）
+            if (port) {
+                uint16_t const status = (uint16_t)((port->connected ? PORT_STAT_CONNECTION : 0) |
+                                                   (port->enabled ? PORT_STAT_ENABLE : 0) |
+                                                   (port->resetting ? PORT_STAT_RESET : 0) |
+                                                   (port->powered ? PORT_STAT_POWER : 0));
+                d.buf[0] = (uint8_t)status;
+                d.buf[1] = (uint8_t)(status >> 8);
+                d.buf[2] = (uint8_t)port->change;
+                d.buf[3] = (uint8_t)(port->change >> 8);
+                return 4;
+            }
+            break;
+        case 0x2303:  // SET_FEATURE（ポート）
+            if (port && w_value == PORT_FEAT_POWER) {
+                port->powered = true;
+                hub_port_detect(*port);
+                return 0;
+            }
+            if (port && w_value == PORT_FEAT_RESET) {
+                // リセット中のデバイスはアドレス0に戻る（10ms 後にポートが有効になる）
+                if (port->connected) {
+                    port->resetting = true;
+                    port->enabled = false;
+                    port->reset_done_ns = now_ns + HUB_PORT_RESET_NS;
+                    device_bus_reset(devs[port->child]);
+                }
+                return 0;
+            }
+            break;
+        case 0x2301:  // CLEAR_FEATURE（ポート）
+            if (port) {
+                switch (w_value) {
+                    case PORT_FEAT_ENABLE: port->enabled = false; break;
+                    case PORT_FEAT_C_CONNECTION: port->change &= (uint16_t)~PORT_STAT_CONNECTION; break;
+                    case PORT_FEAT_C_ENABLE: port->change &= (uint16_t)~PORT_STAT_ENABLE; break;
+                    case PORT_FEAT_C_RESET: port->change &= (uint16_t)~PORT_STAT_RESET; break;
+                    default: break;
+                }
+                return 0;
+            }
+            break;
+        default:
+            break;
+    }
+    d.stall = true;
+    return 0;
+}
+
+// キーボードのコントロール転送。IN のデータ長を返す
+static uint16_t keyboard_setup(SimDevice &d, const uint8_t *setup) {
+    uint8_t const bm_request_type = setup[0];
+    uint8_t const b_request = setup[1];
+    uint16_t const w_value = (uint16_t)(setup[2] | (setup[3] << 8));
+
+    uint16_t avail = 0;
+    switch ((bm_request_type << 8) | b_request) {
+        case 0x8006:  // GET_DESCRIPTOR
+            if ((w_value >> 8) == 0x01) {
+                memcpy(d.buf, desc_device, sizeof(desc_device));
+                if (serial_number[0]) {
+                    d.buf[16] = SERIAL_INDEX;
+                }
+                avail = sizeof(desc_device);
+            } else if ((w_value >> 8) == 0x02) {
+                avail = build_config_desc(d, d.buf);
+            } else if (w_value == (0x0300 | SERIAL_INDEX) && serial_number[0]) {
+                // UTF-16（言語 ID は見ない）
+                uint8_t const n = (uint8_t)strlen(serial_number);
+                d.buf[0] = (uint8_t)(2 + 2 * n);
+                d.buf[1] = 0x03;
+                for (uint8_t i = 0; i < n; i++) {
+                    d.buf[2 + 2 * i] = (uint8_t)serial_number[i];
+                    d.buf[3 + 2 * i] = 0;
+                }
+                avail = d.buf[0];
+            } else {
+                d.stall = true;  // シリアル番号のほかに文字列記述子はない
+            }
+            break;
+        case 0x8106:  // GET_DESCRIPTOR（HID レポート記述子）
+            if ((w_value >> 8) == 0x22) {
+                memcpy(d.buf, desc_report, sizeof(desc_report));
+                avail = sizeof(desc_report);
+            } else {
+                d.stall = true;
+            }
+            break;
+        case 0x0005:  // SET_ADDRESS
+            d.pending_address = (uint8_t)(w_value & 0x7f);
+            break;
+        case 0x0009:  // SET_CONFIGURATION
+            d.configured = (w_value == 1);
+            memset(d.in_toggle + 1, 0, sizeof(d.in_toggle) - 1);
+            memset(d.out_toggle + 1, 0, sizeof(d.out_toggle) - 1);
+            break;
+        case 0x0201:  // CLEAR_FEATURE(ENDPOINT_HALT)
+            d.in_toggle[setup[4] & 0x0f] = 0;
+            d.out_toggle[setup[4] & 0x0f] = 0;
+            break;
+        case 0x2109:  // SET_REPORT（LED）
+        case 0x210A:  // SET_IDLE
+        case 0x210B:  // SET_PROTOCOL
+            break;
+        default:
+            d.stall = true;
+            break;
+    }
+    return avail;
+}
+
+static void device_setup(SimDevice &d, const uint8_t *setup) {
+    uint8_t const bm_request_type = setup[0];
+    uint16_t const w_length = (uint16_t)(setup[6] | (setup[7] << 8));
+
+    memcpy(d.setup, setup, 8);
+    d.in_toggle[0] = 1;
+    d.out_toggle[0] = 1;
+    d.stall = false;
+    d.len = 0;
+    d.pos = 0;
+
+    uint16_t const avail = (d.kind == SIM_HUB) ? hub_setup(d, setup) : keyboard_setup(d, setup);
+
+    if (bm_request_type & 0x80) {
+        d.len = (w_length < avail) ? w_length : avail;
+        d.stage = CTRL_DATA_IN;
+    } else {
+        d.len = w_length;
+        d.stage = w_length ? CTRL_DATA_OUT : CTRL_STATUS;
+    }
+}
+
+// スクリプトの応答を1回分取り出す
+static Max3421SimResponse script_take(SimDevice &d, uint8_t ep_num, bool in) {
+    uint8_t const idx = (uint8_t)(ep_num + (in ? 16 : 0));
+    if (d.script_count[idx] == 0) {
+        return SIM_RESPONSE_NORMAL;
+    }
+    if (d.script_skip[idx]) {
+        d.script_skip[idx]--;
+        return SIM_RESPONSE_NORMAL;
+    }
+    d.script_count[idx]--;
+    return d.script[idx];
+}
+
+static void record_poll(void) {
+    uint32_t const frame = stats.frames;
+    if (poll_stats.count) {
+        uint32_t const gap = frame - last_poll_frame;
+        if (poll_stats.count == 1 || gap < poll_stats.gap_min) {
+            poll_stats.gap_min = gap;
+        }
+        if (gap > poll_stats.gap_max) {
+            poll_stats.gap_max = gap;
+        }
+    }
+    last_poll_frame = frame;
+    poll_stats.count++;
+}
+
+// IN トランザクションでデバイスが返すデータ（false は NAK）
+static bool device_in(SimDevice &d, uint8_t ep_num, uint8_t *data, uint8_t *len, uint8_t *result) {
+    if (ep_num == 0) {
+        if (d.stage != CTRL_DATA_IN || d.stall) {
+            *result = HRSL_STALL;
+            return false;
+        }
+        uint16_t const remain = d.len - d.pos;
+        *len = (uint8_t)((remain < EP0_SIZE) ? remain : EP0_SIZE);
+        memcpy(data, d.buf + d.pos, *len);
+        return true;
+    }
+    if (d.kind == SIM_HUB) {
+        // ステータス変化のあるポートのビットマップ（変化がなければ NAK）
+        uint8_t bitmap = 0;
+        for (uint8_t i = 0; i < d.port_count; i++) {
+            if (d.ports[i].change) {
+                bitmap |= (uint8_t)(1u << (i + 1));
+            }
+        }
+        if (ep_num != 1 || !d.configured) {
+            *result = HRSL_STALL;
+            return false;
+        }
+        if (bitmap == 0) {
+            *result = HRSL_NAK;
+            return false;
+        }
+        data[0] = bitmap;
+        *len = 1;
+        return true;
+    }
+    if (ep_num != 1 || !d.configured) {
+        *result = HRSL_STALL;
+        return false;
+    }
+    if (&d == &dev) {
+        record_poll();  // ルートポートのキーボードだけ
+    }
+    if (d.report_count == 0) {
+        *result = HRSL_NAK;
+        return false;
+    }
+    *len = d.report_len[d.report_head];
+    memcpy(data, d.report[d.report_head], *len);
+    return true;
+}
+
+// IN データを送り、ホストに ACK された
+static void device_in_acked(SimDevice &d, uint8_t ep_num, uint8_t len) {
+    if (ep_num == 0) {
+        d.pos = (uint16_t)(d.pos + len);
+        if (len < EP0_SIZE || d.pos >= d.len) {
+            d.stage = CTRL_STATUS;
+        }
+    } else if (d.kind == SIM_KEYBOARD) {
+        d.report_head = (uint8_t)((d.report_head + 1) & 7);
+        d.report_count--;
+    }
+}
+
+static uint8_t device_out(SimDevice &d, uint8_t ep_num, const uint8_t *data, uint8_t len) {
+    if (ep_num == BULK_OUT_EP && d.kind == SIM_KEYBOARD && d.configured) {
+        if (len > BULK_OUT_SIZE || d.bulk_len + len > MAX3421_SIM_BULK_OUT_MAX) {
+            return HRSL_STALL;
+        }
+        memcpy(d.bulk + d.bulk_len, data, len);
+        d.bulk_len = (uint16_t)(d.bulk_len + len);
+        return HRSL_SUCCESS;
+    }
+    if (ep_num != 0 || d.stage != CTRL_DATA_OUT || d.stall) {
+        return HRSL_STALL;
+    }
+    if (d.setup[1] == 0x09 && len) {
+        d.led = data[0];
+    }
+    d.pos = (uint16_t)(d.pos + len);
+    if (len < EP0_SIZE || d.pos >= d.len) {
+        d.stage = CTRL_STATUS;
+    }
+    return HRSL_SUCCESS;
+}
+
+static uint8_t device_status(SimDevice &d) {
+    if (d.stall || d.stage == CTRL_IDLE) {
+        return HRSL_STALL;
+    }
+    if (d.setup[0] == 0x00 && d.setup[1] == 0x05) {
+        d.address = d.pending_address;
+    }
+    d.stage = CTRL_IDLE;
+    return HRSL_SUCCESS;
+}
+
+//--------------------------------------------------------------------+
+// USB トランザクション
+//--------------------------------------------------------------------+
+
+static void start_xfer(uint8_t hxfr) {
+    SimXfer &x = chip.xfer;
+    if (x.busy) {
+        stats.protocol_err++;
+        return;
+    }
+    stats.usb_xact++;
+    memset(&x, 0, sizeof(x));
+    x.busy = true;
+    x.rcvtog = -1;
+    x.sndtog = -1;
+
+    uint8_t const ep_num = hxfr & 0x0f;
+    bool const setup = hxfr & HXFR_SETUP;
+    bool const out = hxfr & HXFR_OUT_NIN;
+    bool const hs = hxfr & HXFR_HS;
+    uint32_t bits = TOKEN_BITS + TURNAROUND_BITS;
+    x.snd = out && !hs && !setup;
+
+    // PERADDR のデバイス（ハブの下流のデバイスにはハブ経由で届く）
+    SimDevice *target = (chip.reg[REG_MODE] & MODE_LOWSPEED) ? NULL : device_find(chip.reg[REG_PERADDR]);
+    Max3421SimResponse const script = (setup || !target) ? SIM_RESPONSE_NORMAL : script_take(*target, ep_num, !out);
+
+    if (!target || script == SIM_RESPONSE_TIMEOUT) {
+        x.result = HRSL_TIMEOUT;
+        bits += TIMEOUT_BITS;
+        if (out && !hs) {
+            bits += DATA_BITS(chip.snd_len[snd_oldest()]);
+        }
+        stats.usb_timeout++;
+    } else if (setup) {
+        stats.setup++;
+        bits += DATA_BITS(8) + TURNAROUND_BITS + HANDSHAKE_BITS;
+        device_setup(*target, chip.sud);
+        x.result = HRSL_SUCCESS;
+    } else if (script == SIM_RESPONSE_NAK || script == SIM_RESPONSE_STALL) {
+        x.result = (script == SIM_RESPONSE_NAK) ? HRSL_NAK : HRSL_STALL;
+        bits += HANDSHAKE_BITS;
+        if (out && !hs) {
+            bits += DATA_BITS(chip.snd_len[snd_oldest()]) + TURNAROUND_BITS;
+            x.snd_nak = (script == SIM_RESPONSE_NAK);
+        }
+        if (ep_num == 1 && !out && target == &dev) {
+            record_poll();
+        }
+    } else if (hs) {
+        // ステータスステージ（DATA1 の長さ0のパケット、トグルは変わらない）
+        bits += DATA_BITS(0) + TURNAROUND_BITS + HANDSHAKE_BITS;
+        x.result = device_status(*target);
+    } else if (out) {
+        if (chip.snd_count == 0) {
+            stats.protocol_err++;  // SNDBC を書かずに HXFR を書いた
+        }
+        uint8_t const idx = snd_oldest();
+        uint8_t const len = chip.snd_len[idx];
+        bits += DATA_BITS(len) + TURNAROUND_BITS + HANDSHAKE_BITS;
+        x.result = device_out(*target, ep_num, chip.snd[idx], len);
+        if (x.result == HRSL_SUCCESS) {
+            // トグルが違うパケットは ACK されるがデバイスは捨てる
+            if (target->out_toggle[ep_num] != chip.sndtog) {
+                stats.toggle_err++;
+            } else {
+                target->out_toggle[ep_num] ^= 1;
+            }
+            x.sndtog = (int8_t)(chip.sndtog ^ 1);
+            x.snd_release = true;
+        }
+    } else {
+        uint8_t len = 0;
+        if (device_in(*target, ep_num, x.rcv_data, &len, &x.result)) {
+            bits += DATA_BITS(len) + TURNAROUND_BITS + HANDSHAKE_BITS;
+            device_in_acked(*target, ep_num, len);
+            if (target->in_toggle[ep_num] != chip.rcvtog) {
+                // トグルが違うパケットは ACK して捨てる（データは失われる）
+                stats.toggle_err++;
+                x.result = HRSL_TOG_ERR;
+            } else {
+                x.result = HRSL_SUCCESS;
+                x.rcv = true;
+                x.rcv_len = len;
+                x.rcvtog = (int8_t)(chip.rcvtog ^ 1);
+            }
+            target->in_toggle[ep_num] ^= 1;
+        } else {
+            bits += HANDSHAKE_BITS;
+        }
+    }
+
+    if (x.result == HRSL_NAK) {
+        stats.usb_nak++;
+    } else if (x.result == HRSL_STALL) {
+        stats.usb_stall++;
+    }
+    x.done_ns = now_ns + bits * FS_BIT_NS;
+    chip.reg[REG_HRSL] = (uint8_t)((chip.reg[REG_HRSL] & 0xf0) | 0x01);  // BUSY
+}
+
+//--------------------------------------------------------------------+
+// レジスタ
+//--------------------------------------------------------------------+
+
+static uint8_t reg_read(uint8_t reg) {
+    switch (reg) {
+        case REG_RCVFIFO: {
+            if (chip.rcv_count == 0 || chip.rcv_pos >= chip.rcv_len[chip.rcv_head]) {
+                stats.protocol_err++;
+                return 0;
+            }
+            return chip.rcv[chip.rcv_head][chip.rcv_pos++];
+        }
+        case REG_RCVBC:
+            return chip.rcv_count ? chip.rcv_len[chip.rcv_head] : 0;
+        case REG_REVISION:
+            return 0x13;
+        case REG_HRSL:
+            return hrsl_value();
+        default:
+            return chip.reg[reg];
+    }
+}
+
+static void reg_write(uint8_t reg, uint8_t data) {
+    switch (reg) {
+        case REG_SNDFIFO:
+            if (chip.snd_rewind) {
+                return;  // 巻き戻す前の書き込みはずれた位置に入る（パケットは使えない）
+            }
+            if (chip.snd_count >= 2 || chip.snd_pos >= 64) {
+                stats.protocol_err++;
+                return;
+            }
+            chip.snd[chip.snd_fill][chip.snd_pos++] = data;
+            break;
+        case REG_SUDFIFO:
+            chip.sud[chip.sud_pos] = data;
+            chip.sud_pos = (uint8_t)((chip.sud_pos + 1) & 7);
+            break;
+        case REG_SNDBC:
+            if (chip.snd_rewind) {
+                // 0 の書き込みで巻き戻す。それ以外はバッファを送信待ちにしない
+                if (data == 0) {
+                    chip.snd_rewind = false;
+                    chip.snd_pos = 0;
+                    stats.snd_rewind++;
+                }
+                return;
+            }
+            if (chip.snd_count >= 2) {
+                stats.protocol_err++;
+                return;
+            }
+            if (chip.xfer.busy && chip.xfer.snd) {
+                stats.snd_overlap++;
+            }
+            chip.reg[REG_SNDBC] = data;
+            chip.snd_len[chip.snd_fill] = data;
+            chip.snd_fill ^= 1;
+            chip.snd_pos = 0;
+            chip.snd_count++;
+            update_sndbav();
+            break;
+        case REG_USBCTL:
+            if (data & USBCTL_CHIPRES) {
+                chip_reset();
+            } else if (chip.reg[REG_USBCTL] & USBCTL_CHIPRES) {
+                chip.reg[REG_USBIRQ] |= USBIRQ_OSCOK;
+            }
+            chip.reg[REG_USBCTL] = data;
+            break;
+        case REG_PINCTL:
+            chip.reg[REG_PINCTL] = data & PINCTL_PRESERVED;
+            break;
+        case REG_HIRQ: {
+            // 1を書いたビットをクリアする（SNDBAV はクリアできない）
+            if (data & HIRQ_RCVDAV) {
+                if (chip.rcv_count) {
+                    chip.rcv_head ^= 1;
+                    chip.rcv_count--;
+                }
+                chip.rcv_pos = 0;
+            }
+            chip.reg[REG_HIRQ] &= (uint8_t)~(data & (uint8_t)~HIRQ_SNDBAV);
+            if (chip.rcv_count) {
+                chip.reg[REG_HIRQ] |= HIRQ_RCVDAV;
+            }
+            break;
+        }
+        case REG_MODE: {
+            bool const sof = data & MODE_SOFKAENAB;
+            chip.reg[REG_MODE] = data;
+            if (sof && !chip.sof && !chip.resetting) {
+                start_frames();
+            } else if (!sof) {
+                chip.sof = false;
+            }
+            break;
+        }
+        case REG_HCTL:
+            if (data & HCTL_BUSRST) {
+                chip.resetting = true;
+                chip.reset_done_ns = now_ns + BUS_RESET_NS;
+                chip.reg[REG_HCTL] |= HCTL_BUSRST;
+                chip.sof = false;
+                device_bus_reset(dev);
+            }
+            if (data & HCTL_RCVTOG0) {
+                chip.rcvtog = 0;
+            }
+            if (data & HCTL_RCVTOG1) {
+                chip.rcvtog = 1;
+            }
+            if (data & HCTL_SNDTOG0) {
+                chip.sndtog = 0;
+            }
+            if (data & HCTL_SNDTOG1) {
+                chip.sndtog = 1;
+            }
+            break;
+        case REG_HXFR:
+            chip.reg[REG_HXFR] = data;
+            start_xfer(data);
+            break;
+        case REG_RCVFIFO:
+        case REG_RCVBC:
+        case REG_REVISION:
+        case REG_HRSL:
+            break;  // 読み出し専用
+        default:
+            chip.reg[reg] = data;
+            break;
+    }
+}
+
+//--------------------------------------------------------------------+
+// API: tuh_max3421_*_api（hcd_max3421.c から呼ばれる）
+//--------------------------------------------------------------------+
+
+extern "C" void tuh_max3421_spi_cs_api(uint8_t rhport, bool active) {
+    (void)rhport;
+    if (active == bus.cs) {
+        stats.protocol_err++;
+        return;
+    }
+    if (active && async_spi.xact) {
+        // 非同期のトランザクションが終わるまでバスを待つ
+        stats.async_bus_wait++;
+        advance_to(async_spi.done_ns);
+    }
+    bus.cs = active;
+    if (active) {
+        bus.cmd_done = false;
+        bus.cs_ns = 0;
+        bus.int_locked_spi = !bus.int_enabled;
+        stats.spi_xact++;
+    } else {
+        // SPI の転送時間とトランザクションごとのオーバーヘッドだけ時間が進む
+        advance_to(now_ns + bus.cs_ns + sim_config.cs_overhead_ns);
+    }
+}
+
+// CS のアサート中に SPI のバイトを送受信する
+static void spi_transfer(uint8_t const *tx_buf, uint8_t *rx_buf, size_t xfer_bytes) {
+    for (size_t i = 0; i < xfer_bytes; i++) {
+        uint8_t const tx = tx_buf ? tx_buf[i] : 0;
+        uint8_t rx = 0;
+        if (!bus.cmd_done) {
+            // コマンドバイト: Reg[7:3] | 0 | Dir[1] | Ack[0]、同時に HIRQ が返る
+            bus.cmd_done = true;
+            bus.cmd_reg = tx >> 3;
+            bus.cmd_write = (tx & 0x02) != 0;
+            rx = chip.reg[REG_HIRQ];
+        } else if (bus.cmd_write) {
+            reg_write(bus.cmd_reg, tx);
+        } else {
+            rx = reg_read(bus.cmd_reg);
+        }
+        if (rx_buf) {
+            rx_buf[i] = rx;
+        }
+    }
+    stats.spi_bytes += xfer_bytes;
+    bus.cs_ns += (uint64_t)xfer_bytes * 8 * 1000000000ull / sim_config.spi_hz;
+}
+
+extern "C" bool tuh_max3421_spi_xfer_api(uint8_t rhport, uint8_t const *tx_buf, uint8_t *rx_buf, size_t xfer_bytes) {
+    (void)rhport;
+    if (!bus.cs) {
+        stats.protocol_err++;
+        return false;
+    }
+    spi_transfer(tx_buf, rx_buf, xfer_bytes);
+    return true;
+}
+
+extern "C" bool tuh_max3421_spi_submit_api(uint8_t rhport, tuh_max3421_spi_xact_t *xact) {
+    (void)rhport;
+    if (!async_spi.enabled || async_spi.xact) {
+        return false;
+    }
+    if (bus.cs || xact->len > ASYNC_DATA_MAX || !xact->complete_cb) {
+        stats.protocol_err++;
+        return false;
+    }
+
+    bus.cmd_done = false;
+    bus.cs_ns = 0;
+    stats.spi_xact++;
+    stats.async_xact++;
+    spi_transfer(&xact->cmd, &async_spi.status, 1);
+    spi_transfer(xact->tx_buf, async_spi.data, xact->len);
+
+    async_spi.xact = xact;
+    async_spi.done_ns = now_ns + bus.cs_ns + sim_config.cs_overhead_ns;
+    return true;
+}
+
+extern "C" void tuh_max3421_int_api(uint8_t rhport, bool enabled) {
+    (void)rhport;
+    if (enabled && bus.int_locked_spi) {
+        stats.spi_locks++;
+    }
+    bus.int_locked_spi = false;
+    bus.int_enabled = enabled;
+}
+
+extern "C" bool tuh_max3421_time_us_api(uint8_t rhport, uint32_t *time_us) {
+    (void)rhport;
+    if (!sim_config.timer) {
+        return false;
+    }
+    *time_us = (uint32_t)(now_ns / 1000);
+    return true;
+}
+
+extern "C" bool tuh_max3421_wakeup_api(uint8_t rhport, uint32_t delay_us) {
+    (void)rhport;
+    if (!sim_config.timer) {
+        return false;
+    }
+    wake.armed = (delay_us != 0);
+    wake.at_ns = now_ns + (uint64_t)delay_us * 1000;
+    return true;
+}
+
+// usbh.c の osal_task_delay()（OPT_OS_NONE ではフレーム番号を待つ）の代わりに時間を進める
+extern "C" void osal_task_delay(uint32_t msec) {
+    max3421_sim_run_us(msec * 1000);
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void max3421_sim_init(const Max3421SimConfig *config) {
+    sim_config = *config;
+    memset(&async_spi, 0, sizeof(async_spi));
+    memset(&wake, 0, sizeof(wake));
+    memset(&intr, 0, sizeof(intr));
+    memset(&bus, 0, sizeof(bus));
+    memset(&chip, 0, sizeof(chip));
+    memset(devs, 0, sizeof(devs));
+    memset(serial_number, 0, sizeof(serial_number));
+    memset(&stats, 0, sizeof(stats));
+    memset(&poll_stats, 0, sizeof(poll_stats));
+    last_poll_frame = 0;
+    now_ns = 0;
+    dev.parent = SIM_NO_PARENT;
+    dev.interval = config->interval;
+    update_sndbav();
+}
+
+// ルートポートのデバイスを kind にし、ハブの下流のデバイスを外す
+static void root_device_set(SimDeviceKind kind, uint8_t port_count) {
+    for (uint8_t i = 1; i < SIM_DEVICE_MAX; i++) {
+        memset(&devs[i], 0, sizeof(devs[i]));
+    }
+    dev.kind = kind;
+    dev.port_count = port_count;
+    memset(dev.ports, 0, sizeof(dev.ports));
+    dev.attached = true;
+    device_bus_reset(dev);
+    chip.reg[REG_HIRQ] |= HIRQ_CONDET;
+}
+
+void max3421_sim_attach(void) {
+    root_device_set(SIM_KEYBOARD, 0);
+}
+
+void max3421_sim_serial(const char *serial) {
+    memset(serial_number, 0, sizeof(serial_number));
+    if (serial) {
+        strncpy(serial_number, serial, SERIAL_MAX);
+    }
+}
+
+void max3421_sim_attach_hub(uint8_t ports, uint8_t keyboards) {
+    if (ports > MAX3421_SIM_HUB_PORT_MAX) {
+        ports = MAX3421_SIM_HUB_PORT_MAX;
+    }
+    if (keyboards > ports) {
+        keyboards = ports;
+    }
+    dev.report_count = 0;
+    root_device_set(SIM_HUB, ports);
+    for (uint8_t i = 0; i < keyboards; i++) {
+        SimDevice &kbd = devs[1 + i];
+        kbd.kind = SIM_KEYBOARD;
+        kbd.attached = true;
+        kbd.parent = 0;
+        kbd.port = (uint8_t)(i + 1);
+        kbd.interval = sim_config.interval;
+        dev.ports[i].child = (uint8_t)(1 + i);
+    }
+}
+
+void max3421_sim_detach(void) {
+    dev.attached = false;
+    device_bus_reset(dev);
+    dev.report_count = 0;
+    chip.reg[REG_HIRQ] |= HIRQ_CONDET;
+}
+
+void max3421_sim_script(uint8_t ep_addr, Max3421SimResponse response, uint16_t count) {
+    max3421_sim_script_after(ep_addr, 0, response, count);
+}
+
+void max3421_sim_script_after(uint8_t ep_addr, uint16_t skip, Max3421SimResponse response, uint16_t count) {
+    uint8_t const idx = (uint8_t)((ep_addr & 0x0f) + ((ep_addr & 0x80) ? 16 : 0));
+    dev.script[idx] = response;
+    dev.script_count[idx] = (response == SIM_RESPONSE_NORMAL) ? 0 : count;
+    dev.script_skip[idx] = skip;
+}
+
+bool max3421_sim_key_report(const uint8_t *report, uint8_t len) {
+    if (dev.report_count >= 8 || len > MAX3421_SIM_REPORT_MAX) {
+        return false;
+    }
+    uint8_t const idx = (uint8_t)((dev.report_head + dev.report_count) & 7);
+    memcpy(dev.report[idx], report, len);
+    dev.report_len[idx] = len;
+    dev.report_count++;
+    return true;
+}
+
+void max3421_sim_async_spi(bool enable) {
+    async_spi.enabled = enable;
+}
+
+// 非同期のトランザクションの完了を通知する（受信データはここで渡す）
+static void async_spi_complete(void) {
+    tuh_max3421_spi_xact_t *xact = async_spi.xact;
+    async_spi.xact = NULL;
+    xact->status = async_spi.status;
+    if (xact->rx_buf) {
+        memcpy(xact->rx_buf, async_spi.data, xact->len);
+    }
+    xact->complete_cb(sim_config.rhport, xact, true);
+}
+
+void max3421_sim_run_us(uint32_t us) {
+    uint64_t const end = now_ns + (uint64_t)us * 1000;
+    for (;;) {
+        if (async_spi.xact && now_ns >= async_spi.done_ns && !bus.in_handler) {
+            async_spi_complete();
+        }
+        // INT がアサートされている間とタイマーの時刻には割り込みハンドラを呼ぶ（ハンドラ内の SPI で時間が進む）
+        if (!bus.in_handler && wake.armed && now_ns >= wake.at_ns) {
+            wake.armed = false;
+            bus.in_handler = true;
+            stats.int_calls++;
+            stats.wakeups++;
+            hcd_int_handler(sim_config.rhport, false);
+            bus.in_handler = false;
+        }
+        if (!bus.in_handler && bus.int_enabled && int_asserted() && !intr.asserted) {
+            // INT の立ち下がり: ISR が割り込みタスクを起こし、タスクが起床してから処理する
+            intr.asserted = true;
+            intr.asserted_ns = now_ns;
+            stats.int_edges++;
+            intr.task_pending = true;
+            intr.task_at_ns = now_ns + sim_config.task_wake_ns;
+        }
+        if (!bus.in_handler && intr.task_pending && now_ns >= intr.task_at_ns) {
+            intr.task_pending = false;
+            for (int n = 0; bus.int_enabled && int_asserted(); n++) {
+                if (n == SERVICE_CALL_MAX) {
+                    stats.protocol_err++;
+                    break;
+                }
+                bus.in_handler = true;
+                stats.int_calls++;
+                hcd_int_handler(sim_config.rhport, false);
+                bus.in_handler = false;
+            }
+        }
+        if (intr.asserted && !(bus.int_enabled && int_asserted())) {
+            intr.asserted = false;
+            intr.task_pending = false;
+            stats.int_service_ns += now_ns - intr.asserted_ns;
+        }
+        uint64_t next = next_event_ns();
+        if (async_spi.xact && async_spi.done_ns < next) {
+            next = async_spi.done_ns;
+        }
+        if (wake.armed && wake.at_ns < next) {
+            next = wake.at_ns;
+        }
+        if (intr.task_pending && intr.task_at_ns < next) {
+            next = intr.task_at_ns;
+        }
+        if (next > end || now_ns >= end) {
+            break;
+        }
+        advance_to(next);
+    }
+    advance_to(end);
+}
+
+uint64_t max3421_sim_time_us(void) {
+    return now_ns / 1000;
+}
+
+Max3421SimStats max3421_sim_stats(void) {
+    return stats;
+}
+
+Max3421SimPollStats max3421_sim_poll_stats(void) {
+    return poll_stats;
+}
+
+void max3421_sim_poll_stats_reset(void) {
+    memset(&poll_stats, 0, sizeof(poll_stats));
+}
+
+uint8_t max3421_sim_device_address(void) {
+    return dev.address;
+}
+
+bool max3421_sim_device_configured(void) {
+    return dev.configured;
+}
+
+uint8_t max3421_sim_configured_count(void) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < SIM_DEVICE_MAX; i++) {
+        if (devs[i].kind == SIM_KEYBOARD && devs[i].configured && device_reachable(devs[i])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint8_t max3421_sim_device_led(void) {
+    return dev.led;
+}
+
+uint8_t max3421_sim_report_queued(void) {
+    return dev.report_count;
+}
+
+uint16_t max3421_sim_bulk_out_take(uint8_t *buf, uint16_t size) {
+    uint16_t const len = (dev.bulk_len < size) ? dev.bulk_len : size;
+    memcpy(buf, dev.bulk, len);
+    dev.bulk_len = 0;
+    return len;
+}
@@ -0,0 +1,128 @@
+// PC上でのテスト用: MAX3421E のソフトウェアモデル
+// tuh_max3421_spi_xfer_api / tuh_max3421_spi_cs_api / tuh_max3421_int_api を実装し、
+// 実機と同じ hcd_max3421.c・usbh.c・hid_host.c を PC 上で動かす
+// - レジスタ、SUDFIFO、SNDFIFO/RCVFIFO（ダブルバッファ）、HIRQ/HIEN、INT ピン（レベル）
+// - フルスピードの HID キーボード（ブートプロトコル）と bulk OUT（EP2、64バイト）の複合デバイスを1台接続できる
+// - 代わりにハブを接続し、その下流にキーボードを複数台つなげる（ポートの電源・リセット・ステータス変化）
+// - エンドポイントごとに NAK / STALL / 無応答をスクリプトで指定できる
+// - OUT の NAK の後は SNDFIFO を巻き戻す（SNDBC = 0）までパケットを送れない（Host OUT NAK のエラッタ）
+// - 時間は SPI のバイト数と USB トランザクションのビット数から進める（サイクル近似）
+#ifndef MAX3421_SIM_H
+#define MAX3421_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// デバイスの応答（スクリプト）
+enum Max3421SimResponse {
+    SIM_RESPONSE_NORMAL,   // デバイスの通常の応答
+    SIM_RESPONSE_NAK,      // NAK
+    SIM_RESPONSE_STALL,    // STALL
+    SIM_RESPONSE_TIMEOUT   // 応答なし
+};
+
+// モデルの設定
+struct Max3421SimConfig {
+    uint8_t rhport;           // hcd_int_handler() に渡すポート番号
+    uint32_t spi_hz;          // SPI クロック
+    uint32_t cs_overhead_ns;  // 1回の SPI トランザクション（CS のアサート）ごとのオーバーヘッド
+    uint8_t interval;         // キーボードの interrupt IN の bInterval（フレーム）
+    bool timer;               // タイマー（tuh_max3421_time_us_api / tuh_max3421_wakeup_api）を提供する（ESP32 と同じ）
+    uint32_t task_wake_ns;    // INT のアサートから割り込みタスクが hcd_int_handler() を呼ぶまでの時間（ISR からのタスクの起床）
+};
+
+// 統計（max3421_sim_init() からの累計）
+struct Max3421SimStats {
+    uint64_t spi_bytes;      // SPI のバイト数（コマンドバイトを含む）
+    uint32_t spi_xact;       // SPI トランザクション数（CS のアサート回数）
+    uint32_t usb_xact;       // USB トランザクション数（HXFR の書き込み回数）
+    uint32_t usb_nak;        // NAK の応答数
+    uint32_t usb_stall;      // STALL の応答数
+    uint32_t usb_timeout;    // 無応答の数
+    uint32_t setup;          // SETUP トランザクション数（コントロール転送数）
+    uint32_t toggle_err;     // データトグルの不一致（HCD のトグル管理の誤り）
+    uint32_t frames;         // SOF 数
+    uint32_t int_calls;      // hcd_int_handler() の呼び出し回数（タイマーによる呼び出しを含む）
+    uint32_t int_edges;      // INT のアサート（割り込みタスクの起床の契機）の数
+    uint64_t int_service_ns; // INT のアサートから解除までの時間の合計（割り込みの処理の遅延）
+    uint32_t wakeups;        // タイマー（tuh_max3421_wakeup_api）による hcd_int_handler() の呼び出し回数
+    uint32_t spi_locks;      // SPI アクセスを含む割り込み禁止区間（tuh_max3421_int_api(false)〜(true)）の数
+    uint32_t async_xact;     // 非同期 SPI トランザクション数（tuh_max3421_spi_submit_api）
+    uint32_t async_bus_wait; // 非同期のトランザクション中に同期の SPI アクセスが来てバスを待った回数
+    uint32_t snd_overlap;    // OUT パケットの送信中に SNDFIFO のもう一方のバッファに次のパケットを入れた回数
+    uint32_t snd_rewind;     // OUT の NAK の後の SNDFIFO の巻き戻し（SNDBC = 0）の回数
+    uint32_t protocol_err;   // HCD の誤った操作（転送中の HXFR、FIFO のあふれ、CS の外での SPI など）
+    uint32_t addr_conflict;  // 同じアドレスのデバイスが複数つながっている状態でのトランザクション（アドレス0の重複など）
+};
+
+// interrupt IN のポーリング間隔（フレーム数）
+struct Max3421SimPollStats {
+    uint32_t count;     // IN トークンの数
+    uint32_t gap_min;   // 連続する IN トークンの間隔の最小値
+    uint32_t gap_max;   // 最大値
+};
+
+#define MAX3421_SIM_REPORT_MAX 8  // キーボードのレポート長（ブートプロトコル）
+#define MAX3421_SIM_BULK_OUT_MAX 4096  // bulk OUT で受け取れるデータの量
+#define MAX3421_SIM_HUB_PORT_MAX 4     // ハブのポート数の上限
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// モデルを初期化する（デバイスは未接続、時間は0）
+void max3421_sim_init(const struct Max3421SimConfig *config);
+
+// デバイスを接続・切断する（CONDET 割り込み）
+void max3421_sim_attach(void);
+void max3421_sim_detach(void);
+
+// キーボードのシリアル番号の文字列（ASCII、NULL または空文字列でなし。初期値はなし）
+// 次の接続から、デバイスディスクリプタの iSerialNumber と文字列ディスクリプタで返す
+void max3421_sim_serial(const char *serial);
+
+// キーボードの代わりにハブ（ports ポート）を接続し、ポート1から keyboards 台のキーボードをつなぐ
+// キーボードはハブのポートの電源が入ると検出される。max3421_sim_attach() でキーボードに戻る
+void max3421_sim_attach_hub(uint8_t ports, uint8_t keyboards);
+
+// エンドポイント（0x80 は EP0 IN、0x00 は EP0 OUT）の次の count 回のトランザクションの応答を指定する
+// SETUP には適用されない。SIM_RESPONSE_NORMAL でスクリプトを取り消す
+void max3421_sim_script(uint8_t ep_addr, enum Max3421SimResponse response, uint16_t count);
+
+// max3421_sim_script() と同じだが、skip 回のトランザクションに通常どおり応答してから適用する（転送の途中の NAK など）
+void max3421_sim_script_after(uint8_t ep_addr, uint16_t skip, enum Max3421SimResponse response, uint16_t count);
+
+// キーボードのレポートをキューに入れる（len がレポート長より短いとショートパケットになる）
+bool max3421_sim_key_report(const uint8_t *report, uint8_t len);
+
+// 非同期 SPI のバックエンド（tuh_max3421_spi_submit_api）を有効にする（初期値は無効）
+// トランザクションはバスの転送時間の後に完了し、max3421_sim_run_us() の中で完了コールバックを呼ぶ
+void max3421_sim_async_spi(bool enable);
+
+// 時間を進める。INT がアサートされている間とタイマーの時刻には hcd_int_handler() を呼ぶ（ESP32 の割り込みタスクに相当）
+void max3421_sim_run_us(uint32_t us);
+
+// シミュレーション時間（マイクロ秒）
+uint64_t max3421_sim_time_us(void);
+
+// 統計
+struct Max3421SimStats max3421_sim_stats(void);
+struct Max3421SimPollStats max3421_sim_poll_stats(void);
+void max3421_sim_poll_stats_reset(void);
+
+// デバイスの状態
+uint8_t max3421_sim_device_address(void);
+bool max3421_sim_device_configured(void);
+uint8_t max3421_sim_configured_count(void);  // 構成済みのキーボードの数（ハブの下流を含む）
+uint8_t max3421_sim_device_led(void);  // SET_REPORT（Output）で受け取った LED の状態
+uint8_t max3421_sim_report_queued(void);
+
+// bulk OUT で受け取ったデータを取り出す（取り出した分は消える）
+uint16_t max3421_sim_bulk_out_take(uint8_t *buf, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAX3421_SIM_H
@@ -0,0 +1,837 @@
+// MAX3421E のソフトウェアモデル上で hcd_max3421.c・usbh.c・hid_host.c を動かすテスト
+// （pio test -e native -f test_max3421_sim -v）
+// USB 転送ごとの SPI バイト数・SPI トランザクション数を表示する
+// HCD の SPI アクセスを書き換えるときは、前後でこの結果を比較する
+#include <unity.h>
+#include "max3421_sim.h"
+#include "tusb.h"
+
+#define RHPORT 1
+#define KEY_INTERVAL 10  // キーボードの bInterval（フレーム）
+#define NAK_LIMIT 5      // コントロール転送の NAK の上限（TUH_MAX3421_NAK_RETRY_BOUNDED）
+#define STEP_US 125      // tuh_task() を呼ぶ間隔
+#define TASK_WAKE_NS 10000  // ISR から割り込みタスクが起床するまでの時間（ESP32 の FreeRTOS のコンテキストスイッチ程度）
+#define HUB_PORTS 4      // ハブのポート数
+#define HUB_KEYBOARDS 3  // ハブにつなぐキーボードの数
+#define DESC_CACHE_MAX 4 // ディスクリプタキャッシュのエントリ数
+
+// hcd_max3421.c の API（Adafruit_USBH_Host.h と同じ）
+extern "C" bool tuh_max3421_nak_stats(uint8_t rhport, uint8_t daddr, uint8_t ep_addr, uint32_t *nak_count);
+extern "C" uint32_t tuh_max3421_int_stats(uint8_t rhport);
+extern "C" void tuh_max3421_stats_reset(uint8_t rhport);
+extern "C" uint32_t hcd_frame_number(uint8_t rhport);
+
+//--------------------------------------------------------------------+
+// TinyUSB コールバック
+//--------------------------------------------------------------------+
+
+static bool hid_mounted = false;
+static uint8_t hid_mount_count = 0;
+static uint8_t hid_addr = 0;
+static uint8_t hid_idx = 0;
+static uint32_t report_count = 0;
+static uint8_t last_report[MAX3421_SIM_REPORT_MAX];
+static uint16_t last_report_len = 0;
+
+static bool ctrl_done = false;
+static xfer_result_t ctrl_result = XFER_RESULT_INVALID;
+
+// 列挙中（クラスドライバの構成中）の別のデバイスへのコントロール転送
+static bool ctrl_during_enum = false;     // 2台目のキーボードのマウント時に1台目へ SET_REPORT を送る
+static uint8_t ctrl_during_enum_addr = 0; // 1台目のキーボード
+static bool ctrl_during_enum_submitted = false;
+static void ctrl_complete_cb(tuh_xfer_t *xfer);
+
+// ディスクリプタキャッシュ（ESP32 では NVS に保存する。ここではメモリ上）
+struct DescCacheEntry {
+    tuh_desc_cache_key_t key;  // 列挙のたびに読むデバイスディスクリプタとシリアル番号が一致したときだけ使う
+    uint8_t desc_type;
+    uint8_t index;
+    uint16_t len;
+    uint8_t desc[CFG_TUH_ENUMERATION_BUFSIZE];
+};
+static DescCacheEntry desc_cache[DESC_CACHE_MAX];
+static uint8_t desc_cache_count = 0;
+
+static DescCacheEntry *desc_cache_find(tuh_desc_cache_key_t const *key, uint8_t desc_type, uint8_t index) {
+    for (uint8_t i = 0; i < desc_cache_count; i++) {
+        DescCacheEntry *entry = &desc_cache[i];
+        if (entry->desc_type == desc_type && entry->index == index &&
+            memcmp(&entry->key, key, sizeof(tuh_desc_cache_key_t)) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+extern "C" {
+
+uint16_t tuh_descriptor_cache_load_cb(tuh_desc_cache_key_t const *key, uint8_t desc_type, uint8_t index,
+                                      uint8_t *buf, uint16_t bufsize) {
+    DescCacheEntry const *entry = desc_cache_find(key, desc_type, index);
+    if (entry == NULL || entry->len > bufsize) {
+        return 0;
+    }
+    memcpy(buf, entry->desc, entry->len);
+    return entry->len;
+}
+
+void tuh_descriptor_cache_store_cb(tuh_desc_cache_key_t const *key, uint8_t desc_type, uint8_t index,
+                                   uint8_t const *desc, uint16_t len) {
+    DescCacheEntry *entry = desc_cache_find(key, desc_type, index);
+    if (entry == NULL) {
+        if (desc_cache_count >= DESC_CACHE_MAX || len > sizeof(entry->desc)) {
+            return;
+        }
+        entry = &desc_cache[desc_cache_count++];
+    }
+    entry->key = *key;
+    entry->desc_type = desc_type;
+    entry->index = index;
+    entry->len = len;
+    memcpy(entry->desc, desc, len);
+}
+
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t idx, uint8_t const *report_desc, uint16_t desc_len) {
+    (void)report_desc;
+    (void)desc_len;
+    hid_mounted = true;
+    hid_mount_count++;
+    hid_addr = dev_addr;
+    hid_idx = idx;
+    tuh_hid_receive_report(dev_addr, idx);
+
+    if (ctrl_during_enum && hid_mount_count == 1) {
+        ctrl_during_enum_addr = dev_addr;
+    } else if (ctrl_during_enum && hid_mount_count == 2) {
+        // このデバイスのクラスドライバはまだ構成中（usbh_driver_set_config_complete() の前）
+        static uint8_t led = 0x01;  // Num Lock
+        static tusb_control_request_t const request = {
+            {TUSB_REQ_RCPT_INTERFACE, TUSB_REQ_TYPE_CLASS, TUSB_DIR_OUT},
+            HID_REQ_CONTROL_SET_REPORT, (HID_REPORT_TYPE_OUTPUT << 8), 0, sizeof(led)};
+        tuh_xfer_t xfer = {};
+        xfer.daddr = ctrl_during_enum_addr;
+        xfer.ep_addr = 0;
+        xfer.setup = &request;
+        xfer.buffer = &led;
+        xfer.complete_cb = ctrl_complete_cb;
+        ctrl_during_enum_submitted = tuh_control_xfer(&xfer);
+    }
+}
+
+void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t idx) {
+    (void)dev_addr;
+    (void)idx;
+    hid_mounted = false;
+    hid_mount_count--;
+}
+
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t idx, uint8_t const *report, uint16_t len) {
+    report_count++;
+    last_report_len = len;
+    memcpy(last_report, report, (len < sizeof(last_report)) ? len : sizeof(last_report));
+    tuh_hid_receive_report(dev_addr, idx);
+}
+
+void tuh_hid_report_sent_cb(uint8_t dev_addr, uint8_t idx, uint8_t const *report, uint16_t len) {
+    (void)dev_addr;
+    (void)idx;
+    (void)report;
+    (void)len;
+}
+
+void tuh_hid_set_report_complete_cb(uint8_t dev_addr, uint8_t idx, uint8_t report_id, uint8_t report_type,
+                                    uint16_t len) {
+    (void)dev_addr;
+    (void)idx;
+    (void)report_id;
+    (void)report_type;
+    (void)len;
+    ctrl_done = true;
+}
+
+void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t idx, uint8_t protocol) {
+    (void)dev_addr;
+    (void)idx;
+    (void)protocol;
+}
+
+}  // extern "C"
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// メインループ（tuh_task()）と MAX3421E を ms ミリ秒分動かす
+static void run_ms(uint32_t ms) {
+    for (uint32_t i = 0; i < ms * 1000 / STEP_US; i++) {
+        tuh_task();
+        max3421_sim_run_us(STEP_US);
+    }
+}
+
+// 条件が成り立つまで動かす（最大 timeout_ms ミリ秒）
+template <typename F>
+static bool run_until(F cond, uint32_t timeout_ms) {
+    uint64_t const end = max3421_sim_time_us() + (uint64_t)timeout_ms * 1000;
+    while (!cond()) {
+        if (max3421_sim_time_us() >= end) {
+            return false;
+        }
+        tuh_task();
+        max3421_sim_run_us(STEP_US);
+    }
+    return true;
+}
+
+static void ctrl_complete_cb(tuh_xfer_t *xfer) {
+    ctrl_result = xfer->result;
+    ctrl_done = true;
+}
+
+// 区間の SPI・USB の統計を count 回の転送あたりで表示する（区間中の FRAME 割り込みとポーリングも含む）
+static void print_cost(const char *name, const Max3421SimStats &before, const Max3421SimStats &after,
+                       uint32_t count) {
+    double const n = count ? count : 1;
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%-22s %5u xfer  %6.1f SPI xact  %7.1f SPI bytes  %5.1f USB xact  %6.1f locks  (/xfer)",
+             name, (unsigned)count, (after.spi_xact - before.spi_xact) / n, (after.spi_bytes - before.spi_bytes) / n,
+             (after.usb_xact - before.usb_xact) / n, (after.spi_locks - before.spi_locks) / n);
+    TEST_MESSAGE(msg);
+}
+
+static void assert_no_error(void) {
+    Max3421SimStats const stats = max3421_sim_stats();
+    TEST_ASSERT_EQUAL(0, stats.protocol_err);
+    TEST_ASSERT_EQUAL(0, stats.toggle_err);
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_enumeration(void) {
+    Max3421SimStats const before = max3421_sim_stats();
+    max3421_sim_attach();
+    TEST_ASSERT_TRUE(run_until([] { return hid_mounted; }, 2000));
+    Max3421SimStats const after = max3421_sim_stats();
+
+    TEST_ASSERT_EQUAL(1, hid_addr);
+    TEST_ASSERT_EQUAL(1, max3421_sim_device_address());
+    TEST_ASSERT_TRUE(max3421_sim_device_configured());
+    TEST_ASSERT_EQUAL(0, after.usb_timeout);
+    assert_no_error();
+
+    // GET_DESCRIPTOR x5、SET_ADDRESS、SET_CONFIGURATION、SET_IDLE、SET_PROTOCOL
+    TEST_ASSERT_EQUAL(9, after.setup - before.setup);
+    print_cost("enumeration (+frames)", before, after, after.setup - before.setup);
+}
+
+void test_key_report(void) {
+    static const uint8_t report[MAX3421_SIM_REPORT_MAX] = {0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint32_t const count = report_count;
+
+    TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 1; }, 100));
+    TEST_ASSERT_EQUAL(sizeof(report), last_report_len);
+    TEST_ASSERT_EQUAL_MEMORY(report, last_report, sizeof(report));
+    assert_no_error();
+}
+
+void test_poll_interval(void) {
+    // キー入力がない間も bInterval ごとにポーリングされる（NAK）
+    run_ms(KEY_INTERVAL * 2);
+    max3421_sim_poll_stats_reset();
+    Max3421SimStats const before = max3421_sim_stats();
+    uint32_t const frame = hcd_frame_number(RHPORT);
+    run_ms(KEY_INTERVAL * 50);
+    Max3421SimStats const after = max3421_sim_stats();
+    Max3421SimPollStats const poll = max3421_sim_poll_stats();
+
+    TEST_ASSERT_GREATER_THAN(45, poll.count);
+    TEST_ASSERT_LESS_OR_EQUAL(51, poll.count);
+    TEST_ASSERT_EQUAL(KEY_INTERVAL, poll.gap_min);
+    TEST_ASSERT_EQUAL(KEY_INTERVAL, poll.gap_max);
+    TEST_ASSERT_EQUAL(poll.count, after.usb_nak - before.usb_nak);
+    // SPI バスのロックは割り込みハンドラの呼び出しごとに1回
+    TEST_ASSERT_EQUAL(after.int_calls - before.int_calls, after.spi_locks - before.spi_locks);
+    // FRAME_IRQ は使わず、フレーム番号はタイマーから求める。割り込みハンドラはポーリングの時刻（タイマー）と
+    // NAK の HXFRDN の2回だけ呼ばれる
+    TEST_ASSERT_UINT32_WITHIN(1, after.frames - before.frames, hcd_frame_number(RHPORT) - frame);
+    TEST_ASSERT_UINT32_WITHIN(1, poll.count, after.wakeups - before.wakeups);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * (poll.count + 1), after.int_calls - before.int_calls);
+    assert_no_error();
+
+    print_cost("idle poll (+frames)", before, after, poll.count);
+    print_cost("idle frame", before, after, after.frames - before.frames);
+}
+
+void test_key_report_burst(void) {
+    // 連続したキー入力は1回のポーリングで1レポートずつ受け取る
+    uint8_t report[MAX3421_SIM_REPORT_MAX] = {0};
+    uint32_t const count = report_count;
+
+    Max3421SimStats const before = max3421_sim_stats();
+    for (uint8_t i = 0; i < 8; i++) {
+        report[2] = (uint8_t)(0x04 + i);
+        TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    }
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 8; }, KEY_INTERVAL * 10));
+    Max3421SimStats const after = max3421_sim_stats();
+
+    TEST_ASSERT_EQUAL(0x04 + 7, last_report[2]);
+    TEST_ASSERT_EQUAL(0, max3421_sim_report_queued());
+    assert_no_error();
+    print_cost("key report (+frames)", before, after, report_count - count);
+}
+
+void test_short_packet(void) {
+    static const uint8_t report[3] = {0x00, 0x00, 0x05};
+    uint32_t const count = report_count;
+
+    TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 1; }, KEY_INTERVAL * 2));
+    TEST_ASSERT_EQUAL(sizeof(report), last_report_len);
+    TEST_ASSERT_EQUAL_MEMORY(report, last_report, sizeof(report));
+    assert_no_error();
+}
+
+void test_interrupt_stall(void) {
+    // STALL は長さ0のレポートとして通知され、次のポーリングでデータトグルがずれない
+    static const uint8_t report[MAX3421_SIM_REPORT_MAX] = {0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint32_t const stall = max3421_sim_stats().usb_stall;
+    uint32_t const count = report_count;
+
+    max3421_sim_script(0x81, SIM_RESPONSE_STALL, 1);
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 1; }, KEY_INTERVAL * 2));
+    TEST_ASSERT_EQUAL(0, last_report_len);
+    TEST_ASSERT_EQUAL(stall + 1, max3421_sim_stats().usb_stall);
+
+    TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 2; }, KEY_INTERVAL * 2));
+    TEST_ASSERT_EQUAL_MEMORY(report, last_report, sizeof(report));
+    assert_no_error();
+}
+
+void test_set_report_out(void) {
+    // コントロール OUT のデータステージ（SNDFIFO）
+    static uint8_t led = 0x02;  // Caps Lock
+    ctrl_done = false;
+
+    Max3421SimStats const before = max3421_sim_stats();
+    TEST_ASSERT_TRUE(tuh_hid_set_report(hid_addr, hid_idx, 0, HID_REPORT_TYPE_OUTPUT, &led, sizeof(led)));
+    TEST_ASSERT_TRUE(run_until([] { return ctrl_done; }, 100));
+    Max3421SimStats const after = max3421_sim_stats();
+
+    TEST_ASSERT_EQUAL(0x02, max3421_sim_device_led());
+    assert_no_error();
+    print_cost("SET_REPORT (+frames)", before, after, 1);
+}
+
+void test_control_nak_timeout(void) {
+    // TUH_MAX3421_NAK_RETRY_BOUNDED: NAK_LIMIT 回の NAK でタイムアウトする
+    static uint8_t desc[18];
+    uint32_t nak_before = 0;
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x80, &nak_before));
+
+    max3421_sim_script(0x80, SIM_RESPONSE_NAK, 1000);
+    ctrl_done = false;
+    TEST_ASSERT_TRUE(tuh_descriptor_get_device(hid_addr, desc, sizeof(desc), ctrl_complete_cb, 0));
+    TEST_ASSERT_TRUE(run_until([] { return ctrl_done; }, 100));
+    TEST_ASSERT_EQUAL(XFER_RESULT_TIMEOUT, ctrl_result);
+
+    uint32_t nak_after = 0;
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x80, &nak_after));
+    TEST_ASSERT_EQUAL(NAK_LIMIT, nak_after - nak_before);
+
+    // スクリプトを取り消すと次の転送は成功する
+    max3421_sim_script(0x80, SIM_RESPONSE_NORMAL, 0);
+    ctrl_done = false;
+    Max3421SimStats const before = max3421_sim_stats();
+    TEST_ASSERT_TRUE(tuh_descriptor_get_device(hid_addr, desc, sizeof(desc), ctrl_complete_cb, 0));
+    TEST_ASSERT_TRUE(run_until([] { return ctrl_done; }, 100));
+    Max3421SimStats const after = max3421_sim_stats();
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, ctrl_result);
+    TEST_ASSERT_EQUAL(18, desc[0]);
+    TEST_ASSERT_EQUAL(0x4001, desc[10] | (desc[11] << 8));
+    assert_no_error();
+    print_cost("GET_DESCRIPTOR (+frames)", before, after, 1);
+}
+
+void test_endpoint_lookup(void) {
+    // 開いたエンドポイントだけが (アドレス, エンドポイント, 方向) から見つかる
+    uint32_t nak = 0;
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x81, &nak));
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x00, &nak));
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x80, &nak));
+    TEST_ASSERT_FALSE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x01, &nak));
+    TEST_ASSERT_FALSE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x82, &nak));
+    TEST_ASSERT_FALSE(tuh_max3421_nak_stats(RHPORT, hid_addr + 1, 0x81, &nak));
+    TEST_ASSERT_FALSE(tuh_max3421_nak_stats(RHPORT, 0xff, 0x81, &nak));
+}
+
+void test_stats(void) {
+    // リセット後は0から数え、割り込み回数はモデルの hcd_int_handler() 呼び出し回数と一致する
+    tuh_max3421_stats_reset(RHPORT);
+    tuh_xfer_stats_reset();
+    uint32_t nak = 1;
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x81, &nak));
+    TEST_ASSERT_EQUAL(0, nak);
+    TEST_ASSERT_EQUAL(0, tuh_max3421_int_stats(RHPORT));
+
+    Max3421SimStats const before = max3421_sim_stats();
+    uint8_t const report[MAX3421_SIM_REPORT_MAX] = {0, 0, 0x04, 0, 0, 0, 0, 0};
+    uint32_t const count = report_count;
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    }
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 3; }, 200));
+
+    uint8_t desc[18];
+    ctrl_done = false;
+    TEST_ASSERT_TRUE(tuh_descriptor_get_device(hid_addr, desc, sizeof(desc), ctrl_complete_cb, 0));
+    TEST_ASSERT_TRUE(run_until([] { return ctrl_done; }, 100));
+    run_ms(3 * KEY_INTERVAL);  // レポートがないポーリングは NAK になる
+    Max3421SimStats const after = max3421_sim_stats();
+
+    tuh_xfer_stats_t xfer;
+    tuh_xfer_stats_get(&xfer);
+    TEST_ASSERT_EQUAL(3, xfer.count[TUH_XFER_STATS_HID]);
+    TEST_ASSERT_EQUAL(1, xfer.count[TUH_XFER_STATS_CONTROL]);
+    TEST_ASSERT_EQUAL(0, xfer.count[TUH_XFER_STATS_APP]);
+    TEST_ASSERT_EQUAL(after.int_calls - before.int_calls, tuh_max3421_int_stats(RHPORT));
+    TEST_ASSERT_TRUE(tuh_max3421_nak_stats(RHPORT, hid_addr, 0x81, &nak));
+    TEST_ASSERT_TRUE(nak > 0);
+    assert_no_error();
+}
+
+void test_async_spi(void) {
+    // 非同期 SPI のバックエンドでも同じ結果になる（8バイト以上の RCVFIFO の読み出しが非同期になる）
+    max3421_sim_async_spi(true);
+    Max3421SimStats const before = max3421_sim_stats();
+
+    uint8_t report[MAX3421_SIM_REPORT_MAX] = {0};
+    uint32_t const count = report_count;
+    for (uint8_t i = 0; i < 8; i++) {
+        report[2] = (uint8_t)(0x10 + i);
+        TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    }
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 8; }, KEY_INTERVAL * 10));
+    TEST_ASSERT_EQUAL(sizeof(report), last_report_len);
+    TEST_ASSERT_EQUAL_MEMORY(report, last_report, sizeof(report));
+    Max3421SimStats const after = max3421_sim_stats();
+    TEST_ASSERT_EQUAL(8, after.async_xact - before.async_xact);
+    TEST_ASSERT_EQUAL(before.async_bus_wait, after.async_bus_wait);  // 読み出し中は SPI にアクセスしない
+
+    // ショートパケット（8バイト未満）は同期で読む
+    static const uint8_t short_report[3] = {0x00, 0x00, 0x05};
+    TEST_ASSERT_TRUE(max3421_sim_key_report(short_report, sizeof(short_report)));
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 9; }, KEY_INTERVAL * 2));
+    TEST_ASSERT_EQUAL_MEMORY(short_report, last_report, sizeof(short_report));
+    TEST_ASSERT_EQUAL(after.async_xact, max3421_sim_stats().async_xact);
+
+    // コントロール転送の DATA ステージ（8 + 8 + 2 バイト）
+    uint8_t desc[18] = {0};
+    ctrl_done = false;
+    TEST_ASSERT_TRUE(tuh_descriptor_get_device(hid_addr, desc, sizeof(desc), ctrl_complete_cb, 0));
+    TEST_ASSERT_TRUE(run_until([] { return ctrl_done; }, 100));
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, ctrl_result);
+    TEST_ASSERT_EQUAL(18, desc[0]);
+    TEST_ASSERT_EQUAL(0x4001, desc[10] | (desc[11] << 8));
+
+    // 列挙
+    max3421_sim_detach();
+    TEST_ASSERT_TRUE(run_until([] { return !hid_mounted; }, 100));
+    max3421_sim_attach();
+    TEST_ASSERT_TRUE(run_until([] { return hid_mounted; }, 2000));
+    TEST_ASSERT_TRUE(max3421_sim_device_configured());
+
+    max3421_sim_async_spi(false);
+    run_ms(1);
+    assert_no_error();
+    print_cost("async key report", before, after, 8);
+}
+
+static bool bulk_done = false;
+static xfer_result_t bulk_result = XFER_RESULT_INVALID;
+static uint32_t bulk_len = 0;
+
+static void bulk_complete_cb(tuh_xfer_t *xfer) {
+    bulk_result = xfer->result;
+    bulk_len = xfer->actual_len;
+    bulk_done = true;
+}
+
+// bulk OUT（EP2）に len バイト書き込む
+static bool bulk_write(const uint8_t *data, uint16_t len) {
+    bulk_done = false;
+    tuh_xfer_t xfer = {};
+    xfer.daddr = hid_addr;
+    xfer.ep_addr = 0x02;
+    xfer.buflen = len;
+    xfer.buffer = (uint8_t *)data;
+    xfer.complete_cb = bulk_complete_cb;
+    return tuh_edpt_xfer(&xfer) && run_until([] { return bulk_done; }, 200);
+}
+
+void test_bulk_out_double_buffer(void) {
+    // SNDFIFO のダブルバッファ: パケットの送信中に次のパケットを入れる
+    // ドライバのないインターフェースのエンドポイントはアプリケーションが開く
+    tusb_desc_endpoint_t desc_ep = {};
+    desc_ep.bLength = sizeof(desc_ep);
+    desc_ep.bDescriptorType = TUSB_DESC_ENDPOINT;
+    desc_ep.bEndpointAddress = 0x02;
+    desc_ep.bmAttributes.xfer = TUSB_XFER_BULK;
+    desc_ep.wMaxPacketSize = 64;
+    TEST_ASSERT_TRUE(tuh_edpt_open(hid_addr, &desc_ep));
+
+    static uint8_t data[MAX3421_SIM_BULK_OUT_MAX];
+    static uint8_t received[MAX3421_SIM_BULK_OUT_MAX];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+
+    // 2048バイト（32パケット）: 最後以外のパケットの送信中に次を入れる
+    Max3421SimStats const before = max3421_sim_stats();
+    uint64_t const start = max3421_sim_time_us();
+    TEST_ASSERT_TRUE(bulk_write(data, 2048));
+    uint64_t const elapsed = max3421_sim_time_us() - start;
+    Max3421SimStats const after = max3421_sim_stats();
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, bulk_result);
+    TEST_ASSERT_EQUAL(2048, bulk_len);
+    TEST_ASSERT_EQUAL(2048, max3421_sim_bulk_out_take(received, sizeof(received)));
+    TEST_ASSERT_EQUAL_MEMORY(data, received, 2048);
+    TEST_ASSERT_EQUAL(31, after.snd_overlap - before.snd_overlap);
+    TEST_ASSERT_EQUAL(32, after.usb_xact - before.usb_xact);
+
+    char msg[100];
+    snprintf(msg, sizeof(msg), "bulk OUT 2048 bytes in %u us (%.0f KB/s)", (unsigned)elapsed,
+             2048.0 * 1000 / (double)(elapsed ? elapsed : 1));
+    TEST_MESSAGE(msg);
+    print_cost("bulk OUT 64B packet", before, after, 32);
+
+    // 端数のあるパケット（64 x 3 + 10）: 最後のショートパケットも先に入れる
+    TEST_ASSERT_TRUE(bulk_write(data, 202));
+    TEST_ASSERT_EQUAL(202, bulk_len);
+    TEST_ASSERT_EQUAL(202, max3421_sim_bulk_out_take(received, sizeof(received)));
+    TEST_ASSERT_EQUAL_MEMORY(data, received, 202);
+
+    // NAK（次のフレームで再送）: NAK のたびに SNDFIFO を巻き戻して入れ直す。キーボードのポーリングも続く
+    Max3421SimStats const nak_before = max3421_sim_stats();
+    uint32_t const count = report_count;
+    uint8_t const report[MAX3421_SIM_REPORT_MAX] = {0, 0, 0x06, 0, 0, 0, 0, 0};
+    TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    max3421_sim_script(0x02, SIM_RESPONSE_NAK, 3);
+    TEST_ASSERT_TRUE(bulk_write(data + 100, 1000));
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, bulk_result);
+    TEST_ASSERT_EQUAL(1000, bulk_len);
+    TEST_ASSERT_EQUAL(1000, max3421_sim_bulk_out_take(received, sizeof(received)));
+    TEST_ASSERT_EQUAL_MEMORY(data + 100, received, 1000);
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 1; }, KEY_INTERVAL * 2));
+    TEST_ASSERT_EQUAL(3, max3421_sim_stats().snd_rewind - nak_before.snd_rewind);
+
+    // 転送の途中の NAK: 5番目のパケットの送信中に入れた6番目は失われるので、5番目の後に入れ直す。
+    // 以降の転送はシングルバッファ（2〜6番目の先入れの5回だけが重なる）
+    Max3421SimStats const mid_before = max3421_sim_stats();
+    max3421_sim_script_after(0x02, 4, SIM_RESPONSE_NAK, 1);
+    TEST_ASSERT_TRUE(bulk_write(data, 640));
+    Max3421SimStats const mid_after = max3421_sim_stats();
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, bulk_result);
+    TEST_ASSERT_EQUAL(640, bulk_len);
+    TEST_ASSERT_EQUAL(640, max3421_sim_bulk_out_take(received, sizeof(received)));
+    TEST_ASSERT_EQUAL_MEMORY(data, received, 640);
+    TEST_ASSERT_EQUAL(1, mid_after.snd_rewind - mid_before.snd_rewind);
+    TEST_ASSERT_EQUAL(11, mid_after.usb_xact - mid_before.usb_xact);
+    TEST_ASSERT_EQUAL(5, mid_after.snd_overlap - mid_before.snd_overlap);
+
+    max3421_sim_script(0x02, SIM_RESPONSE_NORMAL, 0);
+    assert_no_error();
+}
+
+// bulk OUT の NAK をすべての再送方式で確認する（最初のパケットの NAK と、先入れ中のパケットの NAK）
+static void set_nak_policy_bulk(uint8_t policy) {
+    tuh_configure_max3421_t cfg;
+    cfg.nak_policy_control = TUH_MAX3421_NAK_RETRY_BOUNDED;
+    cfg.nak_policy_bulk = policy;
+    cfg.nak_limit = NAK_LIMIT;
+    cfg.nak_timeout_ms = 0;
+    TEST_ASSERT_TRUE(tuh_configure(RHPORT, TUH_CFGID_MAX3421, &cfg));
+}
+
+void test_bulk_out_nak_policies(void) {
+    static uint8_t data[MAX3421_SIM_BULK_OUT_MAX];
+    static uint8_t received[MAX3421_SIM_BULK_OUT_MAX];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 13 + 5);
+    }
+
+    uint8_t const policies[] = {TUH_MAX3421_NAK_RETRY_IMMEDIATE, TUH_MAX3421_NAK_RETRY_NEXT_FRAME,
+                                TUH_MAX3421_NAK_RETRY_BOUNDED};
+    for (uint8_t policy : policies) {
+        set_nak_policy_bulk(policy);
+
+        // 最初のパケットが NAK_LIMIT 未満の回数 NAK される
+        Max3421SimStats const before = max3421_sim_stats();
+        max3421_sim_script(0x02, SIM_RESPONSE_NAK, NAK_LIMIT - 1);
+        TEST_ASSERT_TRUE_MESSAGE(bulk_write(data, 300), "NAK on first packet");
+        TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, bulk_result);
+        TEST_ASSERT_EQUAL(300, max3421_sim_bulk_out_take(received, sizeof(received)));
+        TEST_ASSERT_EQUAL_MEMORY(data, received, 300);
+        TEST_ASSERT_EQUAL(NAK_LIMIT - 1, max3421_sim_stats().snd_rewind - before.snd_rewind);
+
+        // 2番目のパケットの送信中に3番目を入れた後、2番目が NAK される
+        Max3421SimStats const mid_before = max3421_sim_stats();
+        max3421_sim_script_after(0x02, 1, SIM_RESPONSE_NAK, 2);
+        TEST_ASSERT_TRUE_MESSAGE(bulk_write(data + 7, 500), "NAK on preloaded packet");
+        TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, bulk_result);
+        TEST_ASSERT_EQUAL(500, max3421_sim_bulk_out_take(received, sizeof(received)));
+        TEST_ASSERT_EQUAL_MEMORY(data + 7, received, 500);
+        TEST_ASSERT_EQUAL(2, max3421_sim_stats().snd_rewind - mid_before.snd_rewind);
+
+        max3421_sim_script(0x02, SIM_RESPONSE_NORMAL, 0);
+        assert_no_error();
+    }
+
+    set_nak_policy_bulk(TUH_MAX3421_NAK_RETRY_NEXT_FRAME);
+}
+
+// キーボードのレポート 8 個と bulk OUT 2048 バイトの INT の処理の遅延（アサートから解除まで）の平均（ナノ秒）と bulk OUT の時間
+static void run_int_latency(uint32_t *key_ns, uint32_t *bulk_ns, uint32_t *bulk_us) {
+    static uint8_t data[2048];
+    uint8_t report[MAX3421_SIM_REPORT_MAX] = {0};
+    uint32_t const count = report_count;
+
+    Max3421SimStats const before = max3421_sim_stats();
+    for (uint8_t i = 0; i < 8; i++) {
+        report[2] = (uint8_t)(0x20 + i);
+        TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    }
+    TEST_ASSERT_TRUE(run_until([count] { return report_count == count + 8; }, KEY_INTERVAL * 10));
+    TEST_ASSERT_EQUAL_MEMORY(report, last_report, sizeof(report));
+    Max3421SimStats const middle = max3421_sim_stats();
+
+    uint64_t const start = max3421_sim_time_us();
+    TEST_ASSERT_TRUE(bulk_write(data, sizeof(data)));
+    *bulk_us = (uint32_t)(max3421_sim_time_us() - start);
+    Max3421SimStats const after = max3421_sim_stats();
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, bulk_result);
+    TEST_ASSERT_EQUAL(sizeof(data), max3421_sim_bulk_out_take(data, sizeof(data)));
+
+    *key_ns = (uint32_t)((middle.int_service_ns - before.int_service_ns) / (middle.int_edges - before.int_edges));
+    *bulk_ns = (uint32_t)((after.int_service_ns - middle.int_service_ns) / (after.int_edges - middle.int_edges));
+}
+
+void test_int_latency(void) {
+    // 割り込みタスクの経路: INT のアサートから解除までの遅延のうち、タスクの起床（TASK_WAKE_NS）とハンドラの処理の内訳
+    uint32_t key_ns = 0, bulk_ns = 0, bulk_us = 0;
+    run_int_latency(&key_ns, &bulk_ns, &bulk_us);
+
+    char msg[120];
+    snprintf(msg, sizeof(msg), "INT latency key report  %6u ns (handler %6u ns)", (unsigned)key_ns,
+             (unsigned)(key_ns - TASK_WAKE_NS));
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "INT latency bulk OUT    %6u ns (handler %6u ns)", (unsigned)bulk_ns,
+             (unsigned)(bulk_ns - TASK_WAKE_NS));
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "bulk OUT 2048 bytes     %6u us", (unsigned)bulk_us);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_TRUE(key_ns >= TASK_WAKE_NS);
+    TEST_ASSERT_TRUE(bulk_ns >= TASK_WAKE_NS);
+    assert_no_error();
+}
+
+// ハブの下流の複数のキーボードを並行して列挙する（デバウンスの待ちが重なる）
+void test_hub_enumeration(void) {
+    max3421_sim_detach();
+    TEST_ASSERT_TRUE(run_until([] { return hid_mount_count == 0; }, 100));
+    tuh_enum_stats_reset();
+
+    Max3421SimStats const before = max3421_sim_stats();
+    uint64_t const start_us = max3421_sim_time_us();
+    max3421_sim_attach_hub(HUB_PORTS, HUB_KEYBOARDS);
+    TEST_ASSERT_TRUE(run_until([] { return hid_mount_count == HUB_KEYBOARDS; }, 5000));
+    uint32_t const bringup_ms = (uint32_t)((max3421_sim_time_us() - start_us) / 1000);
+    Max3421SimStats const after = max3421_sim_stats();
+
+    TEST_ASSERT_EQUAL(HUB_KEYBOARDS, max3421_sim_configured_count());
+    TEST_ASSERT_EQUAL(0, after.addr_conflict - before.addr_conflict);
+    assert_no_error();
+
+    // ハブと HUB_KEYBOARDS 台のキーボード。キーボードのデバウンスは重なる
+    tuh_enum_stats_t enum_stats;
+    tuh_enum_stats_get(&enum_stats);
+    TEST_ASSERT_EQUAL(1 + HUB_KEYBOARDS, enum_stats.devices);
+    TEST_ASSERT_EQUAL(0, enum_stats.failed);
+    TEST_ASSERT_TRUE(enum_stats.concurrent_max > 1);
+
+    char msg[120];
+    snprintf(msg, sizeof(msg), "hub + %u keyboards bring-up %u ms (enumeration %u ms, %u concurrent)",
+             (unsigned)HUB_KEYBOARDS, (unsigned)bringup_ms, (unsigned)enum_stats.bringup_ms,
+             (unsigned)enum_stats.concurrent_max);
+    TEST_MESSAGE(msg);
+    print_cost("hub enumeration", before, after, after.setup - before.setup);
+}
+
+void test_ctrl_during_enumeration(void) {
+    // ハブの下の2台目のキーボードのクラスドライバの構成中に、マウント済みの1台目に SET_REPORT を送る。
+    // 構成が終わるまで待たされ、その後に完了する
+    max3421_sim_detach();
+    TEST_ASSERT_TRUE(run_until([] { return hid_mount_count == 0; }, 100));
+
+    ctrl_during_enum = true;
+    ctrl_during_enum_submitted = false;
+    ctrl_done = false;
+    ctrl_result = XFER_RESULT_INVALID;
+    max3421_sim_attach_hub(HUB_PORTS, HUB_KEYBOARDS);
+    TEST_ASSERT_TRUE(run_until([] { return hid_mount_count == HUB_KEYBOARDS; }, 5000));
+    ctrl_during_enum = false;
+
+    TEST_ASSERT_TRUE(ctrl_during_enum_submitted);
+    TEST_ASSERT_TRUE(run_until([] { return ctrl_done; }, 100));
+    TEST_ASSERT_EQUAL(XFER_RESULT_SUCCESS, ctrl_result);
+    TEST_ASSERT_EQUAL(HUB_KEYBOARDS, max3421_sim_configured_count());
+    assert_no_error();
+}
+
+// 抜き差しで同じ時間だけ動かし、接続から最初のキー入力までの時間と SETUP の数を測る
+static void replug_to_first_key(uint32_t *elapsed_us, uint32_t *setups) {
+    static const uint8_t report[MAX3421_SIM_REPORT_MAX] = {0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    max3421_sim_detach();
+    TEST_ASSERT_TRUE(run_until([] { return hid_mount_count == 0; }, 100));
+    tuh_enum_stats_reset();
+
+    Max3421SimStats const before = max3421_sim_stats();
+    uint32_t const reports = report_count;
+    uint64_t const start_us = max3421_sim_time_us();
+    max3421_sim_attach();
+    TEST_ASSERT_TRUE(max3421_sim_key_report(report, sizeof(report)));
+    TEST_ASSERT_TRUE(run_until([reports] { return report_count > reports; }, 2000));
+    *elapsed_us = (uint32_t)(max3421_sim_time_us() - start_us);
+    *setups = max3421_sim_stats().setup - before.setup;
+
+    TEST_ASSERT_EQUAL(0, memcmp(report, last_report, sizeof(report)));
+    assert_no_error();
+}
+
+// 抜き差しでは構成ディスクリプタと HID レポートディスクリプタをキャッシュから取り、接続のデバウンスを短くする
+void test_descriptor_cache(void) {
+    desc_cache_count = 0;
+    max3421_sim_serial("KB0001");
+    tuh_enum_stats_t enum_stats;
+
+    // 初回: キャッシュは空。バスから読んで保存し、デバウンスは 450ms 待つ
+    uint32_t miss_us = 0;
+    uint32_t miss_setups = 0;
+    replug_to_first_key(&miss_us, &miss_setups);
+    tuh_enum_stats_get(&enum_stats);
+    TEST_ASSERT_EQUAL(10, miss_setups);
+    TEST_ASSERT_EQUAL(0, enum_stats.cache_hit);
+    TEST_ASSERT_EQUAL(2, enum_stats.cache_miss);
+    TEST_ASSERT_EQUAL(2, desc_cache_count);
+
+    // 2回目: デバウンスは 100ms。構成ディスクリプタの全体とレポートディスクリプタの GET_DESCRIPTOR が減る
+    uint32_t hit_us = 0;
+    uint32_t hit_setups = 0;
+    replug_to_first_key(&hit_us, &hit_setups);
+    tuh_enum_stats_get(&enum_stats);
+    TEST_ASSERT_EQUAL(8, hit_setups);
+    TEST_ASSERT_EQUAL(2, enum_stats.cache_hit);
+    TEST_ASSERT_EQUAL(0, enum_stats.cache_miss);
+    TEST_ASSERT_TRUE(hit_us + 300000 < miss_us);
+
+    // 同じ型番の別の個体（シリアル番号が違う）は別のエントリになる
+    max3421_sim_serial("KB0002");
+    uint32_t other_us = 0;
+    uint32_t other_setups = 0;
+    replug_to_first_key(&other_us, &other_setups);
+    tuh_enum_stats_get(&enum_stats);
+    TEST_ASSERT_EQUAL(10, other_setups);
+    TEST_ASSERT_EQUAL(0, enum_stats.cache_hit);
+    TEST_ASSERT_EQUAL(2, enum_stats.cache_miss);
+    TEST_ASSERT_EQUAL(4, desc_cache_count);
+    TEST_ASSERT_TRUE(other_us > hit_us + 300000);
+
+    // 先頭9バイトと長さが合わない構成ディスクリプタは使わず、デバウンスの残りを待ってバスから読み直す
+    // （レポートディスクリプタはキャッシュから）
+    for (uint8_t i = 0; i < desc_cache_count; i++) {
+        if (desc_cache[i].desc_type == TUSB_DESC_CONFIGURATION) {
+            desc_cache[i].desc[8]++;  // bMaxPower
+        }
+    }
+    uint32_t bad_us = 0;
+    uint32_t bad_setups = 0;
+    replug_to_first_key(&bad_us, &bad_setups);
+    tuh_enum_stats_get(&enum_stats);
+    TEST_ASSERT_EQUAL(9, bad_setups);
+    TEST_ASSERT_EQUAL(1, enum_stats.cache_hit);
+    TEST_ASSERT_EQUAL(1, enum_stats.cache_miss);
+    TEST_ASSERT_TRUE(bad_us > hit_us + 300000);
+
+    max3421_sim_serial(NULL);
+
+    char msg[120];
+    snprintf(msg, sizeof(msg), "plug to first key: %u us (cache miss, %u setups), %u us (cache hit, %u setups)",
+             (unsigned)miss_us, (unsigned)miss_setups, (unsigned)hit_us, (unsigned)hit_setups);
+    TEST_MESSAGE(msg);
+}
+
+void test_reattach(void) {
+    max3421_sim_detach();
+    TEST_ASSERT_TRUE(run_until([] { return !hid_mounted; }, 100));
+
+    max3421_sim_attach();
+    TEST_ASSERT_TRUE(run_until([] { return hid_mounted; }, 2000));
+    TEST_ASSERT_TRUE(max3421_sim_device_configured());
+    assert_no_error();
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    Max3421SimConfig config;
+    config.rhport = RHPORT;
+    config.spi_hz = 26000000;  // Adafruit_USBH_Host（ESP32）と同じ
+    config.cs_overhead_ns = 1000;
+    config.interval = KEY_INTERVAL;
+    config.timer = true;
+    config.task_wake_ns = TASK_WAKE_NS;
+    max3421_sim_init(&config);
+
+    tuh_configure_max3421_t cfg;
+    cfg.nak_policy_control = TUH_MAX3421_NAK_RETRY_BOUNDED;
+    cfg.nak_policy_bulk = TUH_MAX3421_NAK_RETRY_NEXT_FRAME;
+    cfg.nak_limit = NAK_LIMIT;
+    cfg.nak_timeout_ms = 0;
+    tuh_configure(RHPORT, TUH_CFGID_MAX3421, &cfg);
+    tuh_init(RHPORT);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_enumeration);
+    RUN_TEST(test_key_report);
+    RUN_TEST(test_poll_interval);
+    RUN_TEST(test_key_report_burst);
+    RUN_TEST(test_short_packet);
+    RUN_TEST(test_interrupt_stall);
+    RUN_TEST(test_set_report_out);
+    RUN_TEST(test_control_nak_timeout);
+    RUN_TEST(test_endpoint_lookup);
+    RUN_TEST(test_stats);
+    RUN_TEST(test_async_spi);
+    RUN_TEST(test_bulk_out_double_buffer);
+    RUN_TEST(test_bulk_out_nak_policies);
+    RUN_TEST(test_int_latency);
+    RUN_TEST(test_hub_enumeration);
+    RUN_TEST(test_ctrl_during_enumeration);
+    RUN_TEST(test_descriptor_cache);
+    RUN_TEST(test_reattach);
+    return UNITY_END();
+}
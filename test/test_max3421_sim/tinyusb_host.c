@@ -0,0 +1,9 @@
+// PC上でのテスト用: 実機と同じ TinyUSB ホストスタック（MAX3421E、ハブ、HID）のソースをビルドする
+// ライブラリ全体は native 環境では lib_ignore しているため、必要なソースだけをここでまとめてコンパイルする
+// 設定は arduino/ports/native/tusb_config_native.h（-D TUSB_NATIVE）
+#include "tusb.c"
+#include "common/tusb_fifo.c"
+#include "host/usbh.c"
+#include "host/hub.c"
+#include "class/hid/hid_host.c"
+#include "portable/analog/max3421/hcd_max3421.c"
@@ -0,0 +1,204 @@
+// RomajiConverter のテスト（pio test -e native）
+#include <unity.h>
+#include "AllocCounter.h"
+#include "RomajiConverter.h"
+
+// HIDキーコード
+#define KEY(c) ((uint8_t)(0x04 + ((c) - 'a')))
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static RomajiConverter converter;
+
+void setUp(void) {
+    converter = RomajiConverter();
+    converter.setMode(MODE_ROMAJI);
+}
+
+void tearDown(void) {
+}
+
+// ローマ字列を入力し、最後のキーの結果を返す
+static RomajiResult type(const char *romaji) {
+    RomajiResult result = {ROMAJI_NO_CLIP, NULL, ""};
+    for (const char *p = romaji; *p; p++) {
+        result = converter.processKey(KEY(*p));
+    }
+    return result;
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_vowel(void) {
+    RomajiResult r = type("a");
+    TEST_ASSERT_TRUE(r.hasKana());
+    TEST_ASSERT_EQUAL_STRING("あ", r.kana);
+    TEST_ASSERT_EQUAL_STRING("a", r.romaji);
+    TEST_ASSERT_EQUAL(STATE_INITIAL, converter.getState());
+}
+
+void test_consonant_pending(void) {
+    RomajiResult r = type("ky");
+    TEST_ASSERT_FALSE(r.hasKana());
+    TEST_ASSERT_NULL(r.kana);
+    TEST_ASSERT_EQUAL(STATE_CONSONANT, converter.getState());
+    TEST_ASSERT_EQUAL_STRING("ky", converter.getCurrentRomaji());
+}
+
+void test_youon(void) {
+    RomajiResult r = type("kya");
+    TEST_ASSERT_EQUAL_STRING("きゃ", r.kana);
+    TEST_ASSERT_EQUAL_STRING("kya", r.romaji);
+    TEST_ASSERT_EQUAL_STRING(r.kana, RomajiConverter::clipKana(r.clipId));
+}
+
+void test_n_then_consonant(void) {
+    RomajiResult r = type("nk");
+    TEST_ASSERT_EQUAL_STRING("ん", r.kana);
+    TEST_ASSERT_EQUAL_STRING("n", r.romaji);
+    TEST_ASSERT_EQUAL_STRING("k", converter.getCurrentRomaji());
+}
+
+void test_nn_keeps_n_wait(void) {
+    RomajiResult r = type("nn");
+    TEST_ASSERT_EQUAL_STRING("ん", r.kana);
+    TEST_ASSERT_EQUAL_STRING("nn", r.romaji);
+    TEST_ASSERT_EQUAL(STATE_N_WAIT, converter.getState());
+}
+
+void test_sokuon(void) {
+    RomajiResult r = type("kk");
+    TEST_ASSERT_EQUAL_STRING("っ", r.kana);
+    TEST_ASSERT_EQUAL_STRING("k", r.romaji);
+    TEST_ASSERT_EQUAL_STRING("k", converter.getCurrentRomaji());
+}
+
+void test_invalid_restarts(void) {
+    RomajiResult r = type("ks");
+    TEST_ASSERT_FALSE(r.hasKana());
+    TEST_ASSERT_EQUAL_STRING("s", converter.getCurrentRomaji());
+}
+
+void test_flush_n(void) {
+    type("n");
+    RomajiResult r = converter.flushPending();
+    TEST_ASSERT_EQUAL_STRING("ん", r.kana);
+    TEST_ASSERT_EQUAL_STRING("n", r.romaji);
+    TEST_ASSERT_EQUAL(STATE_INITIAL, converter.getState());
+
+    converter.setMode(MODE_KATAKANA);
+    type("n");
+    TEST_ASSERT_EQUAL_STRING("ン", converter.flushPending().kana);
+}
+
+void test_flush_consonant(void) {
+    type("ky");
+    RomajiResult r = converter.flushPending();
+    TEST_ASSERT_FALSE(r.hasKana());
+    TEST_ASSERT_EQUAL_STRING("ky", r.romaji);
+    TEST_ASSERT_EQUAL(STATE_INITIAL, converter.getState());
+
+    // 確定後は新しい入力として扱う
+    TEST_ASSERT_EQUAL_STRING("あ", type("a").kana);
+}
+
+void test_flush_initial(void) {
+    type("ka");
+    RomajiResult r = converter.flushPending();
+    TEST_ASSERT_FALSE(r.hasKana());
+    TEST_ASSERT_EQUAL_STRING("", r.romaji);
+}
+
+void test_backspace_pending(void) {
+    type("ky");
+    TEST_ASSERT_EQUAL('y', converter.backspace());
+    TEST_ASSERT_EQUAL_STRING("k", converter.getCurrentRomaji());
+    TEST_ASSERT_EQUAL_STRING("か", type("a").kana);
+
+    TEST_ASSERT_EQUAL('\0', converter.backspace());
+    TEST_ASSERT_EQUAL(STATE_INITIAL, converter.getState());
+}
+
+void test_alphabet_mode_ignored(void) {
+    converter.setMode(MODE_ALPHABET);
+    RomajiResult r = type("a");
+    TEST_ASSERT_FALSE(r.hasKana());
+}
+
+void test_toggle_mode_cycle(void) {
+    converter = RomajiConverter();
+    TEST_ASSERT_EQUAL(MODE_ALPHABET, converter.getMode());
+    converter.toggleMode();
+    TEST_ASSERT_EQUAL(MODE_ROMAJI, converter.getMode());
+    converter.toggleMode();
+    TEST_ASSERT_EQUAL(MODE_KATAKANA, converter.getMode());
+    converter.toggleMode();
+    TEST_ASSERT_EQUAL(MODE_ALPHABET, converter.getMode());
+}
+
+void test_katakana(void) {
+    converter.setMode(MODE_KATAKANA);
+    RomajiResult r = type("kya");
+    TEST_ASSERT_EQUAL_STRING("キャ", r.kana);
+    TEST_ASSERT_EQUAL_STRING("kya", r.romaji);
+    TEST_ASSERT_EQUAL_STRING("きゃ", RomajiConverter::clipKana(r.clipId));
+    TEST_ASSERT_EQUAL_STRING("キャ", RomajiConverter::clipKatakana(r.clipId));
+
+    TEST_ASSERT_EQUAL_STRING("ッ", type("tt").kana);
+    TEST_ASSERT_EQUAL_STRING("ン", type("nk").kana);
+    TEST_ASSERT_EQUAL_STRING("ヴ", type("tvu").kana);
+    TEST_ASSERT_EQUAL_STRING("ヮ", type("xwa").kana);
+}
+
+void test_same_clip_in_both_modes(void) {
+    // ひらがなとカタカナは同じ音声クリップ番号を使う
+    RomajiResult hira = type("sha");
+    converter.setMode(MODE_KATAKANA);
+    RomajiResult kata = type("sha");
+    TEST_ASSERT_EQUAL(hira.clipId, kata.clipId);
+    TEST_ASSERT_EQUAL_STRING("しゃ", hira.kana);
+    TEST_ASSERT_EQUAL_STRING("シャ", kata.kana);
+}
+
+void test_no_heap_allocation(void) {
+    const char *text = "kyouhaiitenkidesunexttsuttecchanshinbunfujixtsuvuwolyaqq";
+
+    size_t const before = alloc_count;
+    for (int n = 0; n < 100; n++) {
+        for (const char *p = text; *p; p++) {
+            RomajiResult r = converter.processKey(KEY(*p));
+            (void)r;
+            (void)converter.getCurrentRomaji();
+            (void)converter.getState();
+        }
+    }
+    TEST_ASSERT_EQUAL(0, alloc_count - before);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_vowel);
+    RUN_TEST(test_consonant_pending);
+    RUN_TEST(test_youon);
+    RUN_TEST(test_n_then_consonant);
+    RUN_TEST(test_nn_keeps_n_wait);
+    RUN_TEST(test_sokuon);
+    RUN_TEST(test_invalid_restarts);
+    RUN_TEST(test_flush_n);
+    RUN_TEST(test_flush_consonant);
+    RUN_TEST(test_flush_initial);
+    RUN_TEST(test_backspace_pending);
+    RUN_TEST(test_alphabet_mode_ignored);
+    RUN_TEST(test_toggle_mode_cycle);
+    RUN_TEST(test_katakana);
+    RUN_TEST(test_same_clip_in_both_modes);
+    RUN_TEST(test_no_heap_allocation);
+    return UNITY_END();
+}
@@ -0,0 +1,130 @@
+// RomajiConverter のベンチマーク（pio test -e native -f test_romaji_bench -v）
+// キー処理のスループット（keys/s）と1キーあたりのヒープ確保回数を表示する
+// 変換処理を書き換えるときは、前後でこの結果を比較する
+#include <unity.h>
+#include "AllocCounter.h"
+#include "RomajiConverter.h"
+#include <chrono>
+
+// HIDキーコード
+#define KEY(c) ((uint8_t)(0x04 + ((c) - 'a')))
+
+// 1回の計測で処理するキー数
+#define BENCH_KEYS 10000000
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+// 日本語の文章のローマ字入力（ヘボン式・訓令式・拗音・促音・nを含む）
+static const char *const bench_text =
+    "kyouhaiitenkidesune"
+    "watashihagakkounisanjuppunkakatteikimasu"
+    "konnichiha"
+    "shinbunwoyondekaramatchawonomimashita"
+    "fairuwohozonsurutokihakonobotanwoosite"
+    "tyottomattekudasai"
+    "vaiorinnoensougakikoeru"
+    "nyuugakushikinotameniwaxtsuhanakatta";
+
+static uint8_t bench_keys[BENCH_KEYS];
+static uint32_t checksum = 0;
+
+struct BenchResult {
+    double keys_per_sec;
+    double ns_per_key;
+    double allocs_per_key;
+};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static BenchResult run_bench(InputMode mode) {
+    RomajiConverter converter;
+    converter.setMode(mode);
+
+    size_t const alloc_before = alloc_count;
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+        RomajiResult const r = converter.processKey(bench_keys[i]);
+        checksum += r.clipId;
+    }
+    std::chrono::steady_clock::time_point const end = std::chrono::steady_clock::now();
+    size_t const allocs = alloc_count - alloc_before;
+
+    double const sec = std::chrono::duration<double>(end - start).count();
+    BenchResult result;
+    result.keys_per_sec = BENCH_KEYS / sec;
+    result.ns_per_key = sec * 1e9 / BENCH_KEYS;
+    result.allocs_per_key = (double)allocs / BENCH_KEYS;
+    return result;
+}
+
+static void print_result(const char *name, const BenchResult &result) {
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%-10s %8.2f Mkeys/s  %7.1f ns/key  %.3f allocs/key", name,
+             result.keys_per_sec / 1e6, result.ns_per_key, result.allocs_per_key);
+    TEST_MESSAGE(msg);
+}
+
+static void fill_text_keys(void) {
+    size_t const len = strlen(bench_text);
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+        bench_keys[i] = KEY(bench_text[i % len]);
+    }
+}
+
+static void fill_random_keys(void) {
+    // すべてのキーコード（0x00〜0xFF）を含む擬似乱数列
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < BENCH_KEYS; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        bench_keys[i] = (uint8_t)x;
+    }
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_bench_text_romaji(void) {
+    fill_text_keys();
+    BenchResult const result = run_bench(MODE_ROMAJI);
+    print_result("romaji", result);
+    TEST_ASSERT_TRUE(result.allocs_per_key == 0);
+}
+
+void test_bench_text_katakana(void) {
+    fill_text_keys();
+    BenchResult const result = run_bench(MODE_KATAKANA);
+    print_result("katakana", result);
+    TEST_ASSERT_TRUE(result.allocs_per_key == 0);
+}
+
+void test_bench_random_keycodes(void) {
+    fill_random_keys();
+    BenchResult const result = run_bench(MODE_ROMAJI);
+    print_result("random", result);
+    TEST_ASSERT_TRUE(result.allocs_per_key == 0);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_text_romaji);
+    RUN_TEST(test_bench_text_katakana);
+    RUN_TEST(test_bench_random_keycodes);
+
+    // 最適化で処理が省略されないように結果を使う
+    char msg[64];
+    snprintf(msg, sizeof(msg), "checksum %u", (unsigned)checksum);
+    TEST_MESSAGE(msg);
+    return UNITY_END();
+}
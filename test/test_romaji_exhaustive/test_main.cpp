@@ -0,0 +1,246 @@
+// RomajiConverter の網羅テスト（pio test -e native）
+// 長さ SEQ_LEN_MAX までのすべてのアルファベット列と、到達可能なすべての状態 x すべてのキーコード（0x00〜0xFF）を調べる
+#include <unity.h>
+#include "AllocCounter.h"
+#include "RomajiConverter.h"
+#include <map>
+#include <set>
+#include <string>
+
+// HIDキーコード
+#define KEY(c) ((uint8_t)(0x04 + ((c) - 'a')))
+
+// 網羅するアルファベット列の最大長（26^4 = 456976通り）
+#define SEQ_LEN_MAX 4
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static std::map<std::string, std::string> rule_kana;  // ローマ字 -> かな
+static std::set<std::string> rule_prefix;             // ローマ字の真の接頭辞（"", "k", "ky", "n"など）
+static std::set<std::string> reached_prefix;          // 到達した入力途中のローマ字
+
+static char fail_msg[256];
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void build_rule_index(void) {
+    for (size_t i = 0; i < ROMAJI_RULE_NUM; i++) {
+        std::string const romaji = ROMAJI_RULES[i].romaji;
+        rule_kana[romaji] = ROMAJI_RULES[i].kana;
+        for (size_t len = 0; len < romaji.size(); len++) {
+            rule_prefix.insert(romaji.substr(0, len));
+        }
+    }
+}
+
+// 確定したかなと、確定に使われたローマ字の組み合わせが正しいか
+// 対応表にある組み合わせ、促音（子音1文字 -> っ）、n（"n"/"nn" -> ん）のいずれか
+static bool is_valid_output(const RomajiResult &r) {
+    std::string const romaji = r.romaji;
+    std::string const kana = RomajiConverter::clipKana(r.clipId);
+
+    if (strcmp(r.kana, kana.c_str()) != 0) {
+        return false;
+    }
+    std::map<std::string, std::string>::const_iterator it = rule_kana.find(romaji);
+    if (it != rule_kana.end() && it->second == kana) {
+        return true;
+    }
+    if (kana == "っ") {
+        return romaji.size() == 1 && romaji[0] != 'n' && !strchr("aiueo", romaji[0]);
+    }
+    if (kana == "ん") {
+        return romaji == "n" || romaji == "nn";
+    }
+    return false;
+}
+
+// 1キー分の結果を検査する（失敗時はfail_msgに内容を書いてfalseを返す）
+static bool check_step(const RomajiConverter &before, const RomajiConverter &after, uint8_t keycode,
+                       const RomajiResult &r) {
+    std::string const prefix = after.getCurrentRomaji();
+    char const c = (keycode >= 0x04 && keycode <= 0x1d) ? (char)('a' + keycode - 0x04) : '\0';
+
+    if (c == '\0') {
+        // アルファベット以外は何も確定せず、状態も変わらない
+        if (r.hasKana() || prefix != before.getCurrentRomaji()) {
+            snprintf(fail_msg, sizeof(fail_msg), "\"%s\" + 0x%02X changed state", before.getCurrentRomaji(), keycode);
+            return false;
+        }
+        return true;
+    }
+
+    if (r.hasKana() && !is_valid_output(r)) {
+        snprintf(fail_msg, sizeof(fail_msg), "\"%s\" + '%c' -> \"%s\" (%s)", before.getCurrentRomaji(), c, r.kana,
+                 r.romaji);
+        return false;
+    }
+    // 母音は必ずかなを確定する
+    if (strchr("aiueo", c) && !r.hasKana()) {
+        snprintf(fail_msg, sizeof(fail_msg), "\"%s\" + '%c' dropped a vowel", before.getCurrentRomaji(), c);
+        return false;
+    }
+    // 入力途中のローマ字は対応表の接頭辞のみ
+    if (prefix.size() > ROMAJI_PREFIX_MAX || !rule_prefix.count(prefix)) {
+        snprintf(fail_msg, sizeof(fail_msg), "\"%s\" + '%c' -> invalid state \"%s\"", before.getCurrentRomaji(), c,
+                 prefix.c_str());
+        return false;
+    }
+    // 状態の種類と入力途中のローマ字が一致する
+    RomajiState const state = after.getState();
+    if ((state == STATE_INITIAL) != prefix.empty() || (state == STATE_N_WAIT) != (prefix == "n")) {
+        snprintf(fail_msg, sizeof(fail_msg), "\"%s\" has state %d", prefix.c_str(), (int)state);
+        return false;
+    }
+    return true;
+}
+
+// ひらがなとカタカナのコンバータに同じ列を入力し、深さ優先ですべての列を調べる
+static bool walk(const RomajiConverter &hira, const RomajiConverter &kata, int depth) {
+    reached_prefix.insert(hira.getCurrentRomaji());
+    if (depth == SEQ_LEN_MAX) {
+        return true;
+    }
+    for (char c = 'a'; c <= 'z'; c++) {
+        RomajiConverter h = hira;
+        RomajiConverter k = kata;
+        RomajiResult const rh = h.processKey(KEY(c));
+        RomajiResult const rk = k.processKey(KEY(c));
+
+        if (!check_step(hira, h, KEY(c), rh)) {
+            return false;
+        }
+        // カタカナは出力表のみが異なる
+        if (rh.clipId != rk.clipId || strcmp(h.getCurrentRomaji(), k.getCurrentRomaji()) != 0 ||
+            (rk.hasKana() && strcmp(rk.kana, RomajiConverter::clipKatakana(rk.clipId)) != 0)) {
+            snprintf(fail_msg, sizeof(fail_msg), "katakana differs at \"%s\" + '%c'", hira.getCurrentRomaji(), c);
+            return false;
+        }
+        if (!walk(h, k, depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+void test_every_rule_from_initial(void) {
+    for (size_t i = 0; i < ROMAJI_RULE_NUM; i++) {
+        const char *romaji = ROMAJI_RULES[i].romaji;
+        // 他のローマ字の接頭辞になっているもの（"n"）は次の入力まで確定しない
+        if (rule_prefix.count(romaji)) {
+            continue;
+        }
+        RomajiConverter converter;
+        converter.setMode(MODE_ROMAJI);
+        RomajiResult r = {ROMAJI_NO_CLIP, NULL, ""};
+        for (const char *p = romaji; *p; p++) {
+            r = converter.processKey(KEY(*p));
+        }
+        TEST_ASSERT_TRUE(r.hasKana());
+        TEST_ASSERT_EQUAL_STRING(ROMAJI_RULES[i].kana, r.kana);
+        TEST_ASSERT_EQUAL_STRING(romaji, r.romaji);
+        TEST_ASSERT_EQUAL(STATE_INITIAL, converter.getState());
+    }
+}
+
+void test_all_sequences(void) {
+    RomajiConverter hira;
+    RomajiConverter kata;
+    hira.setMode(MODE_ROMAJI);
+    kata.setMode(MODE_KATAKANA);
+
+    size_t const before = alloc_count;
+    bool const ok = walk(hira, kata, 0);
+    size_t const allocs = alloc_count - before;
+    if (!ok) {
+        TEST_MESSAGE(fail_msg);
+    }
+    TEST_ASSERT_TRUE(ok);
+    // std::set への挿入以外のヒープ確保はない
+    TEST_ASSERT_LESS_OR_EQUAL(reached_prefix.size() * 2, allocs);
+}
+
+void test_all_keycodes_from_every_state(void) {
+    // 到達可能な状態はすべて対応表の接頭辞から入力できる
+    for (std::set<std::string>::const_iterator it = reached_prefix.begin(); it != reached_prefix.end(); ++it) {
+        RomajiConverter start;
+        start.setMode(MODE_ROMAJI);
+        for (size_t i = 0; i < it->size(); i++) {
+            start.processKey(KEY((*it)[i]));
+        }
+        TEST_ASSERT_EQUAL_STRING(it->c_str(), start.getCurrentRomaji());
+
+        for (int keycode = 0; keycode <= 0xFF; keycode++) {
+            RomajiConverter converter = start;
+            RomajiResult const r = converter.processKey((uint8_t)keycode);
+            bool const ok = check_step(start, converter, (uint8_t)keycode, r);
+            if (!ok) {
+                TEST_MESSAGE(fail_msg);
+            }
+            TEST_ASSERT_TRUE(ok);
+        }
+    }
+}
+
+void test_reached_every_prefix(void) {
+    // 対応表の接頭辞はすべて状態として到達できる
+    for (std::set<std::string>::const_iterator it = rule_prefix.begin(); it != rule_prefix.end(); ++it) {
+        if (!reached_prefix.count(*it)) {
+            snprintf(fail_msg, sizeof(fail_msg), "prefix \"%s\" is unreachable", it->c_str());
+            TEST_MESSAGE(fail_msg);
+        }
+        TEST_ASSERT_TRUE(reached_prefix.count(*it) != 0);
+    }
+}
+
+void test_backspace_from_every_state(void) {
+    // 入力途中のローマ字から1文字削除すると、その接頭辞の状態になる
+    for (std::set<std::string>::const_iterator it = reached_prefix.begin(); it != reached_prefix.end(); ++it) {
+        RomajiConverter converter;
+        converter.setMode(MODE_ROMAJI);
+        for (size_t i = 0; i < it->size(); i++) {
+            converter.processKey(KEY((*it)[i]));
+        }
+        if (it->empty()) {
+            TEST_ASSERT_EQUAL('\0', converter.backspace());
+            continue;
+        }
+        TEST_ASSERT_EQUAL((*it)[it->size() - 1], converter.backspace());
+        TEST_ASSERT_EQUAL_STRING(it->substr(0, it->size() - 1).c_str(), converter.getCurrentRomaji());
+    }
+}
+
+void test_alphabet_mode_ignores_every_keycode(void) {
+    RomajiConverter converter;
+    for (int keycode = 0; keycode <= 0xFF; keycode++) {
+        RomajiResult const r = converter.processKey((uint8_t)keycode);
+        TEST_ASSERT_FALSE(r.hasKana());
+        TEST_ASSERT_EQUAL(STATE_INITIAL, converter.getState());
+    }
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    build_rule_index();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_rule_from_initial);
+    RUN_TEST(test_all_sequences);
+    RUN_TEST(test_all_keycodes_from_every_state);
+    RUN_TEST(test_reached_every_prefix);
+    RUN_TEST(test_backspace_from_every_state);
+    RUN_TEST(test_alphabet_mode_ignores_every_keycode);
+    return UNITY_END();
+}